@@ -1,3 +1,6 @@
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+
 #if defined(USE_NIMBLE)
 #include <NimBLEDevice.h>
 #include <NimBLEServer.h>
@@ -11,8 +14,8 @@
 #include "BLEHIDDevice.h"
 #endif // USE_NIMBLE
 #include "HIDTypes.h"
+#include "HidDescriptor.h"
 #include <driver/adc.h>
-#include "sdkconfig.h"
 
 #include "BleKeyboard.h"
 
@@ -25,11 +28,17 @@
 #endif
 
 
+// retries of a notification the stack had no buffers for, waiting twice as long each time
+#define MAX_NOTIFY_RETRIES 8
+#define MAX_NOTIFY_BACKOFF_TICKS 16
+
 // Report IDs:
 #define KEYBOARD_ID 0x01
 #define MEDIA_KEYS_ID 0x02
+#define VOLUME_ID 0x03
+#define SYSTEM_CONTROL_ID 0x04
 
-static const uint8_t _hidReportDescriptor[] = {
+static constexpr auto KEYBOARD_COLLECTION = hidDescriptor(
   USAGE_PAGE(1),      0x01,          // USAGE_PAGE (Generic Desktop Ctrls)
   USAGE(1),           0x06,          // USAGE (Keyboard)
   COLLECTION(1),      0x01,          // COLLECTION (Application)
@@ -63,12 +72,45 @@ static const uint8_t _hidReportDescriptor[] = {
   USAGE_MINIMUM(1),   0x00,          //   USAGE_MINIMUM (0)
   USAGE_MAXIMUM(1),   0x65,          //   USAGE_MAXIMUM (0x65)
   HIDINPUT(1),        0x00,          //   INPUT (Data,Array,Abs,No Wrap,Linear,Preferred State,No Null Position)
-  END_COLLECTION(0),                 // END_COLLECTION
-  // ------------------------------------------------- Media Keys
+  END_COLLECTION(0)                  // END_COLLECTION
+);
+
+static constexpr auto NKRO_KEYBOARD_COLLECTION = hidDescriptor(
+  USAGE_PAGE(1),      0x01,          // USAGE_PAGE (Generic Desktop Ctrls)
+  USAGE(1),           0x06,          // USAGE (Keyboard)
+  COLLECTION(1),      0x01,          // COLLECTION (Application)
+  // ------------------------------------------------- Keyboard
+  REPORT_ID(1),       KEYBOARD_ID,   //   REPORT_ID (1)
+  USAGE_PAGE(1),      0x07,          //   USAGE_PAGE (Kbrd/Keypad)
+  USAGE_MINIMUM(1),   0xE0,          //   USAGE_MINIMUM (0xE0)
+  USAGE_MAXIMUM(1),   0xE7,          //   USAGE_MAXIMUM (0xE7)
+  LOGICAL_MINIMUM(1), 0x00,          //   LOGICAL_MINIMUM (0)
+  LOGICAL_MAXIMUM(1), 0x01,          //   Logical Maximum (1)
+  REPORT_SIZE(1),     0x01,          //   REPORT_SIZE (1)
+  REPORT_COUNT(1),    0x08,          //   REPORT_COUNT (8)
+  HIDINPUT(1),        0x02,          //   INPUT (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+  REPORT_COUNT(1),    0x05,          //   REPORT_COUNT (5) ; 5 bits (Num lock, Caps lock, Scroll lock, Compose, Kana)
+  USAGE_PAGE(1),      0x08,          //   USAGE_PAGE (LEDs)
+  USAGE_MINIMUM(1),   0x01,          //   USAGE_MINIMUM (0x01) ; Num Lock
+  USAGE_MAXIMUM(1),   0x05,          //   USAGE_MAXIMUM (0x05) ; Kana
+  HIDOUTPUT(1),       0x02,          //   OUTPUT (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+  REPORT_COUNT(1),    0x01,          //   REPORT_COUNT (1) ; 3 bits (Padding)
+  REPORT_SIZE(1),     0x03,          //   REPORT_SIZE (3)
+  HIDOUTPUT(1),       0x01,          //   OUTPUT (Const,Array,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+  REPORT_COUNT(1),    0x80,          //   REPORT_COUNT (128) ; one bit per key
+  REPORT_SIZE(1),     0x01,          //   REPORT_SIZE (1)
+  USAGE_PAGE(1),      0x07,          //   USAGE_PAGE (Kbrd/Keypad)
+  USAGE_MINIMUM(1),   0x00,          //   USAGE_MINIMUM (0)
+  USAGE_MAXIMUM(1),   0x7F,          //   USAGE_MAXIMUM (0x7F)
+  HIDINPUT(1),        0x02,          //   INPUT (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+  END_COLLECTION(0)                  // END_COLLECTION
+);
+
+static constexpr auto CONSUMER_COLLECTION = hidDescriptor(
   USAGE_PAGE(1),      0x0C,          // USAGE_PAGE (Consumer)
   USAGE(1),           0x01,          // USAGE (Consumer Control)
   COLLECTION(1),      0x01,          // COLLECTION (Application)
-  REPORT_ID(1),       MEDIA_KEYS_ID, //   REPORT_ID (3)
+  REPORT_ID(1),       MEDIA_KEYS_ID, //   REPORT_ID (2)
   USAGE_PAGE(1),      0x0C,          //   USAGE_PAGE (Consumer)
   LOGICAL_MINIMUM(1), 0x00,          //   LOGICAL_MINIMUM (0)
   LOGICAL_MAXIMUM(1), 0x01,          //   LOGICAL_MAXIMUM (1)
@@ -91,8 +133,48 @@ static const uint8_t _hidReportDescriptor[] = {
   USAGE(2),           0x83, 0x01,    //   Usage (Media sel)   ; bit 6: 64
   USAGE(2),           0x8A, 0x01,    //   Usage (Mail)        ; bit 7: 128
   HIDINPUT(1),        0x02,          //   INPUT (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+  // ------------------------------------------------- Volume
+  REPORT_ID(1),       VOLUME_ID,     //   REPORT_ID (3)
+  USAGE_PAGE(1),      0x0C,          //   USAGE_PAGE (Consumer)
+  USAGE(1),           0xE0,          //   USAGE (Volume)
+  LOGICAL_MINIMUM(1), 0x81,          //   LOGICAL_MINIMUM (-127)
+  LOGICAL_MAXIMUM(1), 0x7F,          //   LOGICAL_MAXIMUM (127)
+  REPORT_SIZE(1),     0x08,          //   REPORT_SIZE (8)
+  REPORT_COUNT(1),    0x01,          //   REPORT_COUNT (1) ; signed steps
+  HIDINPUT(1),        0x06,          //   INPUT (Data,Var,Rel,No Wrap,Linear,Preferred State,No Null Position)
   END_COLLECTION(0)                  // END_COLLECTION
-};
+);
+
+static constexpr auto SYSTEM_CONTROL_COLLECTION = hidDescriptor(
+  USAGE_PAGE(1),      0x01,          // USAGE_PAGE (Generic Desktop Ctrls)
+  USAGE(1),           0x80,          // USAGE (System Control)
+  COLLECTION(1),      0x01,          // COLLECTION (Application)
+  REPORT_ID(1),       SYSTEM_CONTROL_ID, //   REPORT_ID (4)
+  LOGICAL_MINIMUM(1), 0x00,          //   LOGICAL_MINIMUM (0)
+  LOGICAL_MAXIMUM(1), 0x01,          //   LOGICAL_MAXIMUM (1)
+  REPORT_SIZE(1),     0x01,          //   REPORT_SIZE (1)
+  REPORT_COUNT(1),    0x03,          //   REPORT_COUNT (3)
+  USAGE(1),           0x81,          //   USAGE (System Power Down) ; bit 0: 1
+  USAGE(1),           0x82,          //   USAGE (System Sleep)      ; bit 1: 2
+  USAGE(1),           0x83,          //   USAGE (System Wake Up)    ; bit 2: 4
+  HIDINPUT(1),        0x02,          //   INPUT (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+  REPORT_COUNT(1),    0x05,          //   REPORT_COUNT (5) ; 5 bits (Padding)
+  HIDINPUT(1),        0x01,          //   INPUT (Const,Array,Abs,No Wrap,Linear,Preferred State,No Null Position)
+  END_COLLECTION(0)                  // END_COLLECTION
+);
+
+static constexpr auto _hidReportDescriptor =
+  hidCollection<BLE_KEYBOARD_KEYBOARD && !BLE_KEYBOARD_NKRO>(KEYBOARD_COLLECTION) +
+  hidCollection<BLE_KEYBOARD_KEYBOARD && BLE_KEYBOARD_NKRO>(NKRO_KEYBOARD_COLLECTION) +
+  hidCollection<BLE_KEYBOARD_CONSUMER>(CONSUMER_COLLECTION) +
+  hidCollection<BLE_KEYBOARD_SYSTEM_CONTROL>(SYSTEM_CONTROL_COLLECTION);
+
+static_assert(BLE_KEYBOARD_KEYBOARD || BLE_KEYBOARD_CONSUMER || BLE_KEYBOARD_SYSTEM_CONTROL, "BleKeyboard needs at least one collection");
+static_assert(!BLE_KEYBOARD_KEYBOARD || hidReportBits(_hidReportDescriptor, KEYBOARD_ID, 0x80) == sizeof(KeyboardReport) * 8, "keyboard input report does not match KeyboardReport");
+static_assert(!BLE_KEYBOARD_KEYBOARD || hidReportBits(_hidReportDescriptor, KEYBOARD_ID, 0x90) == 8, "keyboard LED output report must be one byte");
+static_assert(!BLE_KEYBOARD_CONSUMER || hidReportBits(_hidReportDescriptor, MEDIA_KEYS_ID, 0x80) == sizeof(MediaKeyReport) * 8, "media key report does not match MediaKeyReport");
+static_assert(!BLE_KEYBOARD_CONSUMER || hidReportBits(_hidReportDescriptor, VOLUME_ID, 0x80) == 8, "volume report must be one signed byte");
+static_assert(!BLE_KEYBOARD_SYSTEM_CONTROL || hidReportBits(_hidReportDescriptor, SYSTEM_CONTROL_ID, 0x80) == 8, "system control report must be one byte");
 
 BleKeyboard::BleKeyboard(std::string deviceName, std::string deviceManufacturer, uint8_t batteryLevel) 
     : hid(0)
@@ -105,13 +187,29 @@ void BleKeyboard::begin(void)
   BLEDevice::init(deviceName);
   BLEServer* pServer = BLEDevice::createServer();
   pServer->setCallbacks(this);
+  server = pServer;
 
   hid = new BLEHIDDevice(pServer);
+  // only the collections in the report map get characteristics, each one is a GATT attribute to discover
+#if BLE_KEYBOARD_KEYBOARD
   inputKeyboard = hid->inputReport(KEYBOARD_ID);  // <-- input REPORTID from report map
   outputKeyboard = hid->outputReport(KEYBOARD_ID);
+  outputKeyboard->setCallbacks(this);
+  inputKeyboard->setCallbacks(this);
+#endif
+#if BLE_KEYBOARD_CONSUMER
   inputMediaKeys = hid->inputReport(MEDIA_KEYS_ID);
+  inputVolume = hid->inputReport(VOLUME_ID);
+  inputMediaKeys->setCallbacks(this);
+  inputVolume->setCallbacks(this);
+#endif
+#if BLE_KEYBOARD_SYSTEM_CONTROL
+  inputSystemControl = hid->inputReport(SYSTEM_CONTROL_ID);
+  inputSystemControl->setCallbacks(this);
+#endif
 
-  outputKeyboard->setCallbacks(this);
+  reportQueue = xQueueCreate(REPORT_QUEUE_LENGTH, sizeof(QueuedReport));
+  xTaskCreate(sendReports, "hid", 4096, this, 2, &senderTask);
 
   hid->manufacturer()->setValue(deviceManufacturer);
 
@@ -130,7 +228,17 @@ void BleKeyboard::begin(void)
 
 #endif // USE_NIMBLE
 
-  hid->reportMap((uint8_t*)_hidReportDescriptor, sizeof(_hidReportDescriptor));
+  if (batteryCharacteristicUUID != nullptr)
+  {
+#if defined(USE_NIMBLE)
+    batteryCharacteristic = hid->batteryService()->createCharacteristic(batteryCharacteristicUUID, NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+#else
+    batteryCharacteristic = hid->batteryService()->createCharacteristic(batteryCharacteristicUUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY);
+    batteryCharacteristic->addDescriptor(new BLE2902());
+#endif // USE_NIMBLE
+  }
+
+  hid->reportMap((uint8_t*)_hidReportDescriptor.data, _hidReportDescriptor.size);
   hid->startServices();
 
   onStarted(pServer);
@@ -159,13 +267,29 @@ void BleKeyboard::setBatteryLevel(uint8_t level) {
     this->hid->setBatteryLevel(this->batteryLevel);
 }
 
+//must be called before begin, adds a read/notify characteristic to the battery service
+void BleKeyboard::addBatteryCharacteristic(const char* uuid) {
+  this->batteryCharacteristicUUID = uuid;
+}
+
+void BleKeyboard::setBatteryCharacteristic(const uint8_t* value, size_t size) {
+  if (this->batteryCharacteristic == nullptr)
+    return;
+
+  this->batteryCharacteristic->setValue((uint8_t*)value, size);
+  if (this->isConnected())
+    this->batteryCharacteristic->notify();
+}
+
 //must be called before begin in order to set the name
 void BleKeyboard::setName(std::string deviceName) {
   this->deviceName = deviceName;
 }
 
 /**
- * @brief Sets the waiting time (in milliseconds) between multiple keystrokes in NimBLE mode.
+ * @brief Sets a minimum gap (in milliseconds) between reports, 7 by default. Some
+ * hosts drop a press followed too closely by its release. The sender task sleeps,
+ * nothing spins. With 0, reports are only paced by the stack running out of buffers.
  * 
  * @param ms Time in milliseconds
  */
@@ -173,6 +297,55 @@ void BleKeyboard::setDelay(uint32_t ms) {
   this->_delay_ms = ms;
 }
 
+/**
+ * @brief Lets the keyboard ask the host for connection parameters: the active ones
+ * as soon as there is a key report or markActive() is called, the idle ones once
+ * nothing happened for idleAfter_ms. Call before begin. NimBLE only.
+ */
+void BleKeyboard::setConnectionPolicy(const ConnParams& active, const ConnParams& idle, uint32_t idleAfter_ms) {
+  this->connectionPolicy.configure(active, idle, idleAfter_ms);
+}
+
+// switch to the active parameters ahead of the reports, e.g. on a button edge
+void BleKeyboard::markActive(void) {
+  if (!this->isConnected() || reportQueue == nullptr || !connectionPolicy.isEnabled())
+    return;
+
+  // one marker in the queue is enough, the sender handles it before any report behind it
+  if (activityQueued.exchange(true))
+    return;
+
+  QueuedReport marker = {};
+  if (xQueueSend(reportQueue, &marker, 0) != pdTRUE)
+    activityQueued = false;
+}
+
+// the parameters the host actually granted, both intervals hold the interval in use
+bool BleKeyboard::getConnParams(ConnParams* granted) {
+#if defined(USE_NIMBLE)
+  if (!this->isConnected() || server == nullptr)
+    return false;
+
+  NimBLEConnInfo info = server->getPeerInfo(0);
+  granted->minInterval = info.getConnInterval();
+  granted->maxInterval = info.getConnInterval();
+  granted->latency = info.getConnLatency();
+  granted->timeout = info.getConnTimeout();
+  return true;
+#else
+  return false;
+#endif // USE_NIMBLE
+}
+
+void BleKeyboard::requestConnParams(const ConnParams* params) {
+#if defined(USE_NIMBLE)
+  if (params == nullptr || !this->isConnected())
+    return;
+
+  server->updateConnParams(connHandle, params->minInterval, params->maxInterval, params->latency, params->timeout);
+#endif // USE_NIMBLE
+}
+
 void BleKeyboard::set_vendor_id(uint16_t vid) { 
 	this->vid = vid; 
 }
@@ -185,30 +358,193 @@ void BleKeyboard::set_version(uint16_t version) {
 	this->version = version; 
 }
 
-void BleKeyboard::sendReport(KeyReport* keys)
+size_t BleKeyboard::pendingReports(void) {
+  return reportQueue ? uxQueueMessagesWaiting(reportQueue) : 0;
+}
+
+ReportStats BleKeyboard::getReportStats(void) {
+  return {reportStats.sent, reportStats.retries, reportStats.dropped, reportStats.volumeSteps, reportStats.volumeReports};
+}
+
+// Key reports are only added by the caller's task, so the room is still there when
+// they are queued. The activity marker (NimBLE host task, on connect) and the volume
+// report (requeued by the sender) can be added at any time, they use the reserved slots.
+bool BleKeyboard::hasQueueRoom(uint8_t reports)
 {
-  if (this->isConnected())
+  return reportQueue && uxQueueSpacesAvailable(reportQueue) >= (UBaseType_t)reports + REPORT_QUEUE_RESERVED;
+}
+
+// copies the report for the sender task, never blocks
+bool BleKeyboard::queueReport(BLECharacteristic* characteristic, const void* data, size_t size)
+{
+  // no characteristic means the collection is not part of this build
+  if (characteristic == nullptr || !this->isConnected() || reportQueue == nullptr)
+    return false;
+
+  QueuedReport report;
+  report.characteristic = characteristic;
+  report.size = size;
+  if (size)
+    memcpy(report.data, data, size);
+
+  bool reserved = characteristic == inputVolume;
+  if ((!reserved && !hasQueueRoom(1)) || xQueueSend(reportQueue, &report, 0) != pdTRUE)
   {
-    this->inputKeyboard->setValue((uint8_t*)keys, sizeof(KeyReport));
-    this->inputKeyboard->notify();
-#if defined(USE_NIMBLE)        
-    // vTaskDelay(delayTicks);
-    this->delay_ms(_delay_ms);
-#endif // USE_NIMBLE
-  }	
+    reportStats.dropped++;
+    return false;
+  }
+  return true;
 }
 
-void BleKeyboard::sendReport(MediaKeyReport* keys)
+#if BLE_KEYBOARD_NKRO
+// the boot report's keys are moved into the bitmap the host expects
+bool BleKeyboard::sendReport(KeyReport* keys)
 {
-  if (this->isConnected())
+  NkroReport report = {};
+  report.modifiers = keys->modifiers;
+  for (uint8_t i = 0; i < 6; i++)
+    if (keys->keys[i] < 0x80)
+      report.keys[keys->keys[i] >> 3] |= 1 << (keys->keys[i] & 7);
+  report.keys[0] &= ~1;  // usage 0 is an empty slot, not a key
+  return sendReport(&report);
+}
+
+bool BleKeyboard::sendReport(NkroReport* keys)
+{
+  return queueReport(this->inputKeyboard, keys, sizeof(NkroReport));
+}
+#else
+bool BleKeyboard::sendReport(KeyReport* keys)
+{
+  return queueReport(this->inputKeyboard, keys, sizeof(KeyReport));
+}
+#endif
+
+bool BleKeyboard::sendReport(MediaKeyReport* keys)
+{
+  return queueReport(this->inputMediaKeys, keys, sizeof(MediaKeyReport));
+}
+
+bool BleKeyboard::stepVolume(int8_t steps)
+{
+  if (inputVolume == nullptr || !this->isConnected() || reportQueue == nullptr)
+    return false;
+
+  reportStats.volumeSteps += steps < 0 ? -steps : steps;
+  pendingVolume += steps;
+
+  // one queued volume report at a time, it takes every step added before it is sent
+  if (volumeQueued.exchange(true))
+    return true;
+
+  if (!queueReport(this->inputVolume, nullptr, 0))
   {
-    this->inputMediaKeys->setValue((uint8_t*)keys, sizeof(MediaKeyReport));
-    this->inputMediaKeys->notify();
-#if defined(USE_NIMBLE)        
-    //vTaskDelay(delayTicks);
-    this->delay_ms(_delay_ms);
+    // the volume report has a reserved slot, only a lost connection gets here. The
+    // sender may have taken some of the steps already, so drop what is left rather
+    // than take back steps that went out.
+    pendingVolume = 0;
+    volumeQueued = false;
+    return false;
+  }
+  return true;
+}
+
+// take the steps for one volume report, anything past the report's range stays pending
+int8_t takeVolumeSteps(std::atomic<int16_t>& pending)
+{
+  int16_t steps = pending.exchange(0);
+  int16_t report = steps > 127 ? 127 : steps < -127 ? -127 : steps;
+  if (report != steps)
+    pending += steps - report;
+  return report;
+}
+
+void BleKeyboard::sendReports(void* arg)
+{
+  BleKeyboard* keyboard = (BleKeyboard*)arg;
+  QueuedReport report;
+  uint32_t connection = 0;
+
+  for (;;)
+  {
+    uint32_t now_ms = esp_timer_get_time() / 1000;
+    if (connection != keyboard->connectionCount)
+    {
+      connection = keyboard->connectionCount;
+      keyboard->connectionPolicy.reset(now_ms);
+    }
+
+    // wake up for the idle switch when there is one due
+    uint32_t idle_ms = keyboard->connectionPolicy.msUntilIdle(now_ms);
+    TickType_t wait = idle_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(idle_ms) + 1;
+
+    if (xQueueReceive(keyboard->reportQueue, &report, wait) != pdTRUE)
+    {
+      keyboard->requestConnParams(keyboard->connectionPolicy.onTick(esp_timer_get_time() / 1000));
+      continue;
+    }
+
+    keyboard->requestConnParams(keyboard->connectionPolicy.onActivity(esp_timer_get_time() / 1000));
+
+    if (report.characteristic == nullptr)
+    {
+      keyboard->activityQueued = false;
+      continue;
+    }
+
+    if (report.characteristic == keyboard->inputVolume)
+    {
+      // steps added from here on need a report of their own
+      keyboard->volumeQueued = false;
+
+      int8_t steps = takeVolumeSteps(keyboard->pendingVolume);
+      if (keyboard->pendingVolume != 0 && !keyboard->volumeQueued.exchange(true))
+      {
+        if (xQueueSend(keyboard->reportQueue, &report, 0) != pdTRUE)
+          keyboard->volumeQueued = false;
+      }
+      if (steps == 0)
+        continue;
+
+      report.data[0] = steps;
+      report.size = 1;
+      keyboard->reportStats.volumeReports++;
+    }
+
+    TickType_t backoff = 1;
+    uint8_t retries = 0;
+    bool sent = false;
+
+    while (keyboard->isConnected())
+    {
+      keyboard->notifyStatus = 0;
+      report.characteristic->setValue(report.data, report.size);
+      report.characteristic->notify();
+
+#if defined(USE_NIMBLE)
+      // the stack is out of buffers, give the link time to drain and send it again
+      if (keyboard->notifyStatus == BLE_HS_ENOMEM && retries < MAX_NOTIFY_RETRIES)
+      {
+        keyboard->reportStats.retries++;
+        retries++;
+        vTaskDelay(backoff);
+        backoff = backoff < MAX_NOTIFY_BACKOFF_TICKS ? backoff * 2 : backoff;
+        continue;
+      }
 #endif // USE_NIMBLE
-  }	
+
+      sent = keyboard->notifyStatus == 0;
+      break;
+    }
+
+    if (sent)
+      keyboard->reportStats.sent++;
+    else
+      keyboard->reportStats.dropped++;
+
+    if (keyboard->_delay_ms)
+      vTaskDelay(pdMS_TO_TICKS(keyboard->_delay_ms));
+  }
 }
 
 extern
@@ -351,53 +687,124 @@ const uint8_t _asciimap[128] =
 
 uint8_t USBPutChar(uint8_t c);
 
-// press() adds the specified key (printing, non-printing, or modifier)
-// to the persistent key report and sends the report.  Because of the way
-// USB HID works, the host acts like the key remains pressed until we
-// call release(), releaseAll(), or otherwise clear the report and resend.
-size_t BleKeyboard::press(uint8_t k)
+// maps a character or key constant to its usage and the modifier bits it needs,
+// modifier keys have no usage. Returns false if the character cannot be typed.
+static bool keyUsage(uint8_t k, uint8_t& usage, uint8_t& modifiers)
 {
-	uint8_t i;
+	modifiers = 0;
 	if (k >= 136) {			// it's a non-printing key (not a modifier)
-		k = k - 136;
+		usage = k - 136;
 	} else if (k >= 128) {	// it's a modifier key
-		_keyReport.modifiers |= (1<<(k-128));
-		k = 0;
+		usage = 0;
+		modifiers = 1<<(k-128);
 	} else {				// it's a printing key
-		k = pgm_read_byte(_asciimap + k);
-		if (!k) {
-			setWriteError();
-			return 0;
-		}
-		if (k & 0x80) {						// it's a capital letter or other character reached with shift
-			_keyReport.modifiers |= 0x02;	// the left shift modifier
-			k &= 0x7F;
+		usage = pgm_read_byte(_asciimap + k);
+		if (!usage)
+			return false;
+		if (usage & 0x80) {	// it's a capital letter or other character reached with shift
+			modifiers = 0x02;
+			usage &= 0x7F;
 		}
 	}
+	return true;
+}
 
-	// Add k to the key report only if it's not already present
-	// and if there is an empty slot.
-	if (_keyReport.keys[0] != k && _keyReport.keys[1] != k &&
-		_keyReport.keys[2] != k && _keyReport.keys[3] != k &&
-		_keyReport.keys[4] != k && _keyReport.keys[5] != k) {
-
-		for (i=0; i<6; i++) {
-			if (_keyReport.keys[i] == 0x00) {
-				_keyReport.keys[i] = k;
-				break;
-			}
-		}
-		if (i == 6) {
-			setWriteError();
-			return 0;
+#if BLE_KEYBOARD_NKRO
+// the bitmap has a bit for every usage up to 0x7F, pressing or releasing a key is one bit
+static bool canAddKey(const NkroReport& /*report*/, uint8_t usage)
+{
+	return usage < 0x80;
+}
+
+static bool hasKey(const NkroReport& report, uint8_t usage)
+{
+	return usage < 0x80 && (report.keys[usage >> 3] & (1 << (usage & 7)));
+}
+
+static bool addKey(NkroReport& report, uint8_t usage)
+{
+	if (usage >= 0x80)
+		return false;
+	report.keys[usage >> 3] |= 1 << (usage & 7);
+	return true;
+}
+
+static void removeKey(NkroReport& report, uint8_t usage)
+{
+	if (usage < 0x80)
+		report.keys[usage >> 3] &= ~(1 << (usage & 7));
+}
+#else
+static bool canAddKey(const KeyReport& report, uint8_t /*usage*/)
+{
+	for (uint8_t i = 0; i < 6; i++)
+		if (report.keys[i] == 0)
+			return true;
+	return false;
+}
+
+static bool hasKey(const KeyReport& report, uint8_t usage)
+{
+	for (uint8_t i = 0; i < 6; i++)
+		if (report.keys[i] == usage)
+			return true;
+	return false;
+}
+
+// takes the first empty slot, false if all six are held
+static bool addKey(KeyReport& report, uint8_t usage)
+{
+	for (uint8_t i = 0; i < 6; i++) {
+		if (report.keys[i] == 0) {
+			report.keys[i] = usage;
+			return true;
 		}
 	}
-	sendReport(&_keyReport);
-	return 1;
+	return false;
+}
+
+// checks all positions in case the key is present more than once (which it shouldn't be)
+static void removeKey(KeyReport& report, uint8_t usage)
+{
+	for (uint8_t i = 0; i < 6; i++)
+		if (report.keys[i] == usage)
+			report.keys[i] = 0;
+}
+#endif
+
+// press() adds the specified key (printing, non-printing, or modifier)
+// to the persistent key report and sends the report.  Because of the way
+// USB HID works, the host acts like the key remains pressed until we
+// call release(), releaseAll(), or otherwise clear the report and resend.
+size_t BleKeyboard::press(uint8_t k)
+{
+	if (!hasQueueRoom(1)) {
+		setWriteError();
+		return 0;
+	}
+	uint8_t usage, modifiers;
+	if (!keyUsage(k, usage, modifiers)) {
+		setWriteError();
+		return 0;
+	}
+	_keyReport.modifiers |= modifiers;
+
+	// Add the key to the key report only if it's not already present
+	// and if there is room for it.
+	if (usage && !hasKey(_keyReport, usage) && !addKey(_keyReport, usage)) {
+		setWriteError();
+		return 0;
+	}
+	return sendReport(&_keyReport);
 }
 
 size_t BleKeyboard::press(const MediaKeyReport k)
 {
+	if (!hasQueueRoom(1)) {
+		setWriteError();
+		return 0;
+	}
+
     uint16_t k_16 = k[1] | (k[0] << 8);
     uint16_t mediaKeyReport_16 = _mediaKeyReport[1] | (_mediaKeyReport[0] << 8);
 
@@ -405,8 +812,7 @@ size_t BleKeyboard::press(const MediaKeyReport k)
     _mediaKeyReport[0] = (uint8_t)((mediaKeyReport_16 & 0xFF00) >> 8);
     _mediaKeyReport[1] = (uint8_t)(mediaKeyReport_16 & 0x00FF);
 
-	sendReport(&_mediaKeyReport);
-	return 1;
+	return sendReport(&_mediaKeyReport);
 }
 
 // release() takes the specified key out of the persistent key report and
@@ -414,33 +820,15 @@ size_t BleKeyboard::press(const MediaKeyReport k)
 // it shouldn't be repeated any more.
 size_t BleKeyboard::release(uint8_t k)
 {
-	uint8_t i;
-	if (k >= 136) {			// it's a non-printing key (not a modifier)
-		k = k - 136;
-	} else if (k >= 128) {	// it's a modifier key
-		_keyReport.modifiers &= ~(1<<(k-128));
-		k = 0;
-	} else {				// it's a printing key
-		k = pgm_read_byte(_asciimap + k);
-		if (!k) {
-			return 0;
-		}
-		if (k & 0x80) {							// it's a capital letter or other character reached with shift
-			_keyReport.modifiers &= ~(0x02);	// the left shift modifier
-			k &= 0x7F;
-		}
-	}
+	uint8_t usage, modifiers;
+	if (!keyUsage(k, usage, modifiers))
+		return 0;
+	_keyReport.modifiers &= ~modifiers;
 
-	// Test the key report to see if k is present.  Clear it if it exists.
-	// Check all positions in case the key is present more than once (which it shouldn't be)
-	for (i=0; i<6; i++) {
-		if (0 != k && _keyReport.keys[i] == k) {
-			_keyReport.keys[i] = 0x00;
-		}
-	}
+	if (usage)
+		removeKey(_keyReport, usage);
 
-	sendReport(&_keyReport);
-	return 1;
+	return sendReport(&_keyReport);
 }
 
 size_t BleKeyboard::release(const MediaKeyReport k)
@@ -451,26 +839,25 @@ size_t BleKeyboard::release(const MediaKeyReport k)
     _mediaKeyReport[0] = (uint8_t)((mediaKeyReport_16 & 0xFF00) >> 8);
     _mediaKeyReport[1] = (uint8_t)(mediaKeyReport_16 & 0x00FF);
 
-	sendReport(&_mediaKeyReport);
-	return 1;
+	return sendReport(&_mediaKeyReport);
 }
 
 void BleKeyboard::releaseAll(void)
 {
-	_keyReport.keys[0] = 0;
-	_keyReport.keys[1] = 0;
-	_keyReport.keys[2] = 0;
-	_keyReport.keys[3] = 0;
-	_keyReport.keys[4] = 0;
-	_keyReport.keys[5] = 0;
+	memset(_keyReport.keys, 0, sizeof(_keyReport.keys));
 	_keyReport.modifiers = 0;
     _mediaKeyReport[0] = 0;
     _mediaKeyReport[1] = 0;
 	sendReport(&_keyReport);
 }
 
+// write() only queues the key when both reports fit, so a full queue never leaves a key held down
 size_t BleKeyboard::write(uint8_t c)
 {
+	if (!hasQueueRoom(2)) {
+		setWriteError();
+		return 0;
+	}
 	uint8_t p = press(c);  // Keydown
 	release(c);            // Keyup
 	return p;              // just return the result of press() since release() almost always returns 1
@@ -478,49 +865,130 @@ size_t BleKeyboard::write(uint8_t c)
 
 size_t BleKeyboard::write(const MediaKeyReport c)
 {
+	if (!hasQueueRoom(2)) {
+		setWriteError();
+		return 0;
+	}
 	uint16_t p = press(c);  // Keydown
 	release(c);            // Keyup
 	return p;              // just return the result of press() since release() almost always returns 1
 }
 
+size_t BleKeyboard::writeSystemControl(uint8_t control)
+{
+	if (!hasQueueRoom(2)) {
+		setWriteError();
+		return 0;
+	}
+	size_t p = queueReport(inputSystemControl, &control, 1);
+	uint8_t none = 0;
+	queueReport(inputSystemControl, &none, 1);
+	return p;
+}
+
+// Types the buffer by adding one key per report on top of the keys already held, so
+// the host still sees the presses in order, and only releases them when a key
+// repeats, the modifiers change or the report is full (never with the NKRO report).
+// "hello" goes out as h, he, hel, release, l, lo, release: 7 reports instead of 10. Reports are queued
+// for the sender task, this returns the number of characters queued.
 size_t BleKeyboard::write(const uint8_t *buffer, size_t size) {
+	if (!this->isConnected())
+		return 0;
+
+	// keys held with press() stay down, typing uses the free slots
+	KeyboardReport base = _keyReport;
+	KeyboardReport report = base;
+	uint8_t typed = 0;
+	uint8_t typedModifiers = 0;
 	size_t n = 0;
-	while (size--) {
-		if (*buffer != '\r') {
-			if (write(*buffer)) {
-			  n++;
-			} else {
-			  break;
-			}
+
+	for (; size; size--, buffer++) {
+		if (*buffer == '\r')
+			continue;
+
+		uint8_t usage, modifiers;
+		if (!keyUsage(*buffer, usage, modifiers)) {
+			setWriteError();
+			break;
 		}
-		buffer++;
+
+		bool repeat = usage && hasKey(report, usage);
+		bool flush = typed && (repeat || modifiers != typedModifiers || (usage && !canAddKey(report, usage)));
+
+		// room for this key and the release that ends the run, so nothing is left held down
+		if (!hasQueueRoom(flush ? 3 : 2)) {
+			setWriteError();
+			break;
+		}
+
+		if (flush) {
+			sendReport(&base);
+			report = base;
+			typed = 0;
+		}
+
+		// held keys fill the report or the key itself is held
+		if (usage && (hasKey(report, usage) || !addKey(report, usage))) {
+			setWriteError();
+			break;
+		}
+		report.modifiers = base.modifiers | modifiers;
+		typedModifiers = modifiers;
+		typed++;
+
+		sendReport(&report);
+		n++;
 	}
+
+	if (typed)
+		sendReport(&base);
+
 	return n;
 }
 
+#if !defined(USE_NIMBLE)
+static void setNotifications(BLECharacteristic* characteristic, bool enabled) {
+  if (characteristic == nullptr)
+    return;
+
+  BLE2902* desc = (BLE2902*)characteristic->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
+  desc->setNotifications(enabled);
+}
+#endif // !USE_NIMBLE
+
 void BleKeyboard::onConnect(BLEServer* pServer) {
   this->connected = true;
 
 #if !defined(USE_NIMBLE)
 
-  BLE2902* desc = (BLE2902*)this->inputKeyboard->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
-  desc->setNotifications(true);
-  desc = (BLE2902*)this->inputMediaKeys->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
-  desc->setNotifications(true);
+  setNotifications(this->inputKeyboard, true);
+  setNotifications(this->inputMediaKeys, true);
+  setNotifications(this->inputVolume, true);
+  setNotifications(this->inputSystemControl, true);
 
 #endif // !USE_NIMBLE
 
 }
 
+#if defined(USE_NIMBLE)
+void BleKeyboard::onConnect(BLEServer* pServer, ble_gap_conn_desc* desc) {
+  this->connHandle = desc->conn_handle;
+  this->connectionCount++;
+
+  // a connection is mostly made to send keys, start on the active parameters
+  this->markActive();
+}
+#endif // USE_NIMBLE
+
 void BleKeyboard::onDisconnect(BLEServer* pServer) {
   this->connected = false;
 
 #if !defined(USE_NIMBLE)
 
-  BLE2902* desc = (BLE2902*)this->inputKeyboard->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
-  desc->setNotifications(false);
-  desc = (BLE2902*)this->inputMediaKeys->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
-  desc->setNotifications(false);
+  setNotifications(this->inputKeyboard, false);
+  setNotifications(this->inputMediaKeys, false);
+  setNotifications(this->inputVolume, false);
+  setNotifications(this->inputSystemControl, false);
 
   advertising->start();
 
@@ -533,13 +1001,13 @@ void BleKeyboard::onWrite(BLECharacteristic* me) {
   ESP_LOGI(LOG_TAG, "special keys: %d", *value);
 }
 
-void BleKeyboard::delay_ms(uint64_t ms) {
-  uint64_t m = esp_timer_get_time();
-  if(ms){
-    uint64_t e = (m + (ms * 1000));
-    if(m > e){ //overflow
-        while(esp_timer_get_time() > e) { }
-    }
-    while(esp_timer_get_time() < e) {}
-  }
-}
\ No newline at end of file
+#if defined(USE_NIMBLE)
+void BleKeyboard::onStatus(BLECharacteristic* me, Status s, int code) {
+#else
+void BleKeyboard::onStatus(BLECharacteristic* me, Status s, uint32_t code) {
+#endif // USE_NIMBLE
+  // the sender task reads this right after notify() returns
+  this->notifyStatus = (s == Status::SUCCESS_NOTIFY || s == Status::SUCCESS_INDICATE) ? 0 : (code ? code : -1);
+}
+
+#endif // CONFIG_BT_ENABLED
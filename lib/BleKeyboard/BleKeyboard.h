@@ -25,6 +25,28 @@
 
 #include "Print.h"
 
+// collections in the report map, set with -D in build_flags. A consumer-only
+// remote leaves out the keyboard's two characteristics and its LED callback.
+#ifndef BLE_KEYBOARD_KEYBOARD
+#define BLE_KEYBOARD_KEYBOARD 1
+#endif
+#ifndef BLE_KEYBOARD_CONSUMER
+#define BLE_KEYBOARD_CONSUMER 1
+#endif
+#ifndef BLE_KEYBOARD_SYSTEM_CONTROL
+#define BLE_KEYBOARD_SYSTEM_CONTROL 0
+#endif
+// N-key rollover: the keyboard report is a bitmap of usages instead of the
+// boot protocol's six key array, so any number of keys can be held at once
+#ifndef BLE_KEYBOARD_NKRO
+#define BLE_KEYBOARD_NKRO 0
+#endif
+#include "ConnectionPolicy.h"
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
 
 const uint8_t KEY_LEFT_CTRL = 0x80;
 const uint8_t KEY_LEFT_SHIFT = 0x81;
@@ -94,6 +116,11 @@ const MediaKeyReport KEY_MEDIA_WWW_BACK = {0, 32};
 const MediaKeyReport KEY_MEDIA_CONSUMER_CONTROL_CONFIGURATION = {0, 64}; // Media Selection
 const MediaKeyReport KEY_MEDIA_EMAIL_READER = {0, 128};
 
+// system control bits, needs BLE_KEYBOARD_SYSTEM_CONTROL
+const uint8_t SYSTEM_POWER_DOWN = 1;
+const uint8_t SYSTEM_SLEEP = 2;
+const uint8_t SYSTEM_WAKE_UP = 4;
+
 
 //  Low level key report: up to 6 keys and shift, ctrl etc at once
 typedef struct
@@ -103,22 +130,87 @@ typedef struct
   uint8_t keys[6];
 } KeyReport;
 
+//  N-key rollover report: shift, ctrl etc and one bit for each of the usages 0x00-0x7F
+typedef struct
+{
+  uint8_t modifiers;
+  uint8_t keys[16];
+} NkroReport;
+
+#if BLE_KEYBOARD_NKRO
+typedef NkroReport KeyboardReport;
+#else
+typedef KeyReport KeyboardReport;
+#endif
+
+// reports waiting for the sender task, write() needs room for two
+const uint8_t REPORT_QUEUE_LENGTH = 32;
+
+// slots only the volume report and the activity marker may take, there is never
+// more than one of each in the queue
+const uint8_t REPORT_QUEUE_RESERVED = 2;
+
+typedef struct
+{
+  BLECharacteristic* characteristic;
+  uint8_t size;
+  uint8_t data[sizeof(KeyboardReport)];
+} QueuedReport;
+
+typedef struct
+{
+  uint32_t sent;
+  uint32_t retries;  // notifications retried because the stack was out of buffers
+  uint32_t dropped;  // reports refused because the queue was full, or given up on
+  uint32_t volumeSteps;
+  uint32_t volumeReports;
+} ReportStats;
+
+// ReportStats as they are counted, from the caller's task and the sender task
+typedef struct
+{
+  std::atomic<uint32_t> sent{0};
+  std::atomic<uint32_t> retries{0};
+  std::atomic<uint32_t> dropped{0};
+  std::atomic<uint32_t> volumeSteps{0};
+  std::atomic<uint32_t> volumeReports{0};
+} ReportCounters;
+
 class BleKeyboard : public Print, public BLEServerCallbacks, public BLECharacteristicCallbacks
 {
 private:
   BLEHIDDevice* hid;
-  BLECharacteristic* inputKeyboard;
-  BLECharacteristic* outputKeyboard;
-  BLECharacteristic* inputMediaKeys;
+  BLECharacteristic* inputKeyboard = nullptr;
+  BLECharacteristic* outputKeyboard = nullptr;
+  BLECharacteristic* inputMediaKeys = nullptr;
+  BLECharacteristic* inputVolume = nullptr;
+  BLECharacteristic* inputSystemControl = nullptr;
   BLEAdvertising*    advertising;
-  KeyReport          _keyReport;
+  BLEServer*         server = nullptr;
+  KeyboardReport     _keyReport;
   MediaKeyReport     _mediaKeyReport;
   std::string        deviceName;
   std::string        deviceManufacturer;
   uint8_t            batteryLevel;
-  bool               connected = false;
+  const char*        batteryCharacteristicUUID = nullptr;
+  BLECharacteristic* batteryCharacteristic = nullptr;
+  // set by the BLE host task, read by the caller and the sender task
+  std::atomic<bool>  connected{false};
   uint32_t           _delay_ms = 7;
-  void delay_ms(uint64_t ms);
+  QueueHandle_t      reportQueue = nullptr;
+  TaskHandle_t       senderTask = nullptr;
+  volatile int       notifyStatus = 0;
+  ReportCounters     reportStats;
+  std::atomic<int16_t> pendingVolume{0};
+  std::atomic<bool>  volumeQueued{false};
+  ConnectionPolicy   connectionPolicy;
+  std::atomic<bool>  activityQueued{false};
+  uint16_t           connHandle = 0;
+  volatile uint32_t  connectionCount = 0;
+  void requestConnParams(const ConnParams* params);
+  bool queueReport(BLECharacteristic* characteristic, const void* data, size_t size);
+  bool hasQueueRoom(uint8_t reports);
+  static void sendReports(void* arg);
 
   uint16_t vid       = 0x05ac;
   uint16_t pid       = 0x820a;
@@ -128,8 +220,11 @@ public:
   BleKeyboard(std::string deviceName = "ESP32 Keyboard", std::string deviceManufacturer = "Espressif", uint8_t batteryLevel = 100);
   void begin(void);
   void end(void);
-  void sendReport(KeyReport* keys);
-  void sendReport(MediaKeyReport* keys);
+  bool sendReport(KeyReport* keys);
+#if BLE_KEYBOARD_NKRO
+  bool sendReport(NkroReport* keys);
+#endif
+  bool sendReport(MediaKeyReport* keys);
   size_t press(uint8_t k);
   size_t press(const MediaKeyReport k);
   size_t release(uint8_t k);
@@ -138,10 +233,19 @@ public:
   size_t write(const MediaKeyReport c);
   size_t write(const uint8_t *buffer, size_t size);
   void releaseAll(void);
+  bool stepVolume(int8_t steps);
+  size_t writeSystemControl(uint8_t control);
   bool isConnected(void);
   void setBatteryLevel(uint8_t level);
+  void addBatteryCharacteristic(const char* uuid);
+  void setBatteryCharacteristic(const uint8_t* value, size_t size);
   void setName(std::string deviceName);  
   void setDelay(uint32_t ms);
+  void setConnectionPolicy(const ConnParams& active, const ConnParams& idle, uint32_t idleAfter_ms);
+  void markActive(void);
+  bool getConnParams(ConnParams* granted);
+  size_t pendingReports(void);
+  ReportStats getReportStats(void);
 
   void set_vendor_id(uint16_t vid);
   void set_product_id(uint16_t pid);
@@ -149,8 +253,16 @@ public:
 protected:
   virtual void onStarted(BLEServer *pServer) { };
   virtual void onConnect(BLEServer* pServer) override;
+#if defined(USE_NIMBLE)
+  virtual void onConnect(BLEServer* pServer, ble_gap_conn_desc* desc) override;
+#endif // USE_NIMBLE
   virtual void onDisconnect(BLEServer* pServer) override;
   virtual void onWrite(BLECharacteristic* me) override;
+#if defined(USE_NIMBLE)
+  virtual void onStatus(BLECharacteristic* me, Status s, int code) override;
+#else
+  virtual void onStatus(BLECharacteristic* me, Status s, uint32_t code) override;
+#endif // USE_NIMBLE
 
 };
 
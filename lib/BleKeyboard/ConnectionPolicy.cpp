@@ -0,0 +1,49 @@
+#include "ConnectionPolicy.h"
+
+void ConnectionPolicy::configure(const ConnParams& active, const ConnParams& idle, uint32_t idleAfter_ms)
+{
+  this->active = active;
+  this->idle = idle;
+  this->idleAfter_ms = idleAfter_ms;
+  this->enabled = true;
+}
+
+bool ConnectionPolicy::isEnabled(void) const
+{
+  return enabled;
+}
+
+void ConnectionPolicy::reset(uint32_t now_ms)
+{
+  state = HOST_PICKED;
+  lastActivity_ms = now_ms;
+}
+
+const ConnParams* ConnectionPolicy::onActivity(uint32_t now_ms)
+{
+  lastActivity_ms = now_ms;
+
+  if (!enabled || state == ACTIVE)
+    return nullptr;
+
+  state = ACTIVE;
+  return &active;
+}
+
+const ConnParams* ConnectionPolicy::onTick(uint32_t now_ms)
+{
+  if (!enabled || state == IDLE || now_ms - lastActivity_ms < idleAfter_ms)
+    return nullptr;
+
+  state = IDLE;
+  return &idle;
+}
+
+uint32_t ConnectionPolicy::msUntilIdle(uint32_t now_ms) const
+{
+  if (!enabled || state == IDLE)
+    return UINT32_MAX;
+
+  uint32_t elapsed = now_ms - lastActivity_ms;
+  return elapsed < idleAfter_ms ? idleAfter_ms - elapsed : 0;
+}
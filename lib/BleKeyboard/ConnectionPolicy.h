@@ -0,0 +1,48 @@
+#ifndef ESP32_BLE_CONNECTION_POLICY_H
+#define ESP32_BLE_CONNECTION_POLICY_H
+
+#include <stdint.h>
+
+// connection parameters in BLE units: intervals of 1.25 ms, timeout of 10 ms
+typedef struct
+{
+  uint16_t minInterval;
+  uint16_t maxInterval;
+  uint16_t latency;
+  uint16_t timeout;
+} ConnParams;
+
+/**
+ * Decides which connection parameters to ask the host for: a short interval
+ * while keys are being used, a long interval with slave latency once the
+ * link has been idle for a while. Knows nothing about the BLE stack, the
+ * caller sends the requests it returns.
+ */
+class ConnectionPolicy
+{
+public:
+  void configure(const ConnParams& active, const ConnParams& idle, uint32_t idleAfter_ms);
+  bool isEnabled(void) const;
+
+  // a new connection runs on whatever the host picked
+  void reset(uint32_t now_ms);
+
+  // returns the parameters to request, or nullptr if nothing changes
+  const ConnParams* onActivity(uint32_t now_ms);
+  const ConnParams* onTick(uint32_t now_ms);
+
+  // time until onTick() has something to do, UINT32_MAX if never
+  uint32_t msUntilIdle(uint32_t now_ms) const;
+
+private:
+  enum State : uint8_t { HOST_PICKED, ACTIVE, IDLE };
+
+  ConnParams active = {};
+  ConnParams idle = {};
+  uint32_t idleAfter_ms = 0;
+  bool enabled = false;
+  State state = HOST_PICKED;
+  uint32_t lastActivity_ms = 0;
+};
+
+#endif // ESP32_BLE_CONNECTION_POLICY_H
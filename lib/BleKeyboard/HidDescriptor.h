@@ -0,0 +1,89 @@
+#ifndef ESP32_BLE_HID_DESCRIPTOR_H
+#define ESP32_BLE_HID_DESCRIPTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A HID report descriptor built at compile time. Collections are written as
+ * separate descriptors and joined with +, so a build only carries the ones it
+ * enables, and the report layouts can be checked with static_assert.
+ */
+template <size_t N>
+struct HidDescriptor
+{
+  // an empty descriptor still needs a byte of storage
+  uint8_t data[N ? N : 1];
+
+  static constexpr size_t size = N;
+};
+
+template <typename... T>
+constexpr HidDescriptor<sizeof...(T)> hidDescriptor(T... bytes)
+{
+  return {{(uint8_t)bytes...}};
+}
+
+template <size_t A, size_t B>
+constexpr HidDescriptor<A + B> operator+(const HidDescriptor<A>& a, const HidDescriptor<B>& b)
+{
+  HidDescriptor<A + B> joined = {};
+  for (size_t i = 0; i < A; i++)
+    joined.data[i] = a.data[i];
+  for (size_t i = 0; i < B; i++)
+    joined.data[A + i] = b.data[i];
+  return joined;
+}
+
+// the descriptor when the collection is enabled, nothing otherwise
+template <bool Enabled, size_t N>
+constexpr auto hidCollection(const HidDescriptor<N>& collection)
+{
+  if constexpr (Enabled)
+    return collection;
+  else
+    return HidDescriptor<0>{};
+}
+
+/**
+ * Walks the items like a host would and adds up the bits of the INPUT or
+ * OUTPUT reports with the given ID, so a report struct can be checked
+ * against the descriptor at compile time.
+ *
+ * @param mainTag 0x80 for INPUT, 0x90 for OUTPUT
+ */
+template <size_t N>
+constexpr uint32_t hidReportBits(const HidDescriptor<N>& descriptor, uint8_t reportId, uint8_t mainTag)
+{
+  uint32_t bits = 0;
+  uint32_t reportSize = 0;
+  uint32_t reportCount = 0;
+  uint32_t id = 0;
+
+  for (size_t i = 0; i < N;)
+  {
+    uint8_t prefix = descriptor.data[i];
+    uint8_t length = (prefix & 0x03) == 3 ? 4 : (prefix & 0x03);
+
+    uint32_t value = 0;
+    for (uint8_t b = 0; b < length && i + 1 + b < N; b++)
+      value |= (uint32_t)descriptor.data[i + 1 + b] << (8 * b);
+
+    // REPORT_ID, REPORT_SIZE and REPORT_COUNT are global items, they carry over to later collections
+    switch (prefix & 0xFC)
+    {
+      case 0x84: id = value; break;
+      case 0x74: reportSize = value; break;
+      case 0x94: reportCount = value; break;
+      default:
+        if ((prefix & 0xFC) == mainTag && id == reportId)
+          bits += reportSize * reportCount;
+        break;
+    }
+
+    i += 1 + length;
+  }
+  return bits;
+}
+
+#endif // ESP32_BLE_HID_DESCRIPTOR_H
@@ -0,0 +1,83 @@
+#include "adc_calibration.h"
+
+const uint32_t ADC_CALIBRATION_MAGIC = 0x41444331;
+
+uint16_t clampMillivolts(int32_t mV)
+{
+    return mV < 0 ? 0 : mV > UINT16_MAX ? UINT16_MAX : mV;
+}
+
+void adcCalibrationLinear(AdcCalibration &c, uint32_t mVPer1000Counts)
+{
+    c.magic = ADC_CALIBRATION_MAGIC;
+    c.benchPoints = 0;
+
+    for (uint8_t i = 0; i < ADC_CALIBRATION_POINTS; i++)
+    {
+        uint32_t raw = (uint32_t)i << ADC_CALIBRATION_SHIFT;
+        c.mV[i] = clampMillivolts((raw * mVPer1000Counts + 500) / 1000);
+    }
+}
+
+void adcCalibrationFromCurve(AdcCalibration &c, uint32_t (*toMillivolts)(uint32_t raw, void *arg), void *arg)
+{
+    c.magic = ADC_CALIBRATION_MAGIC;
+    c.benchPoints = 0;
+
+    for (uint8_t i = 0; i < ADC_CALIBRATION_POINTS; i++)
+    {
+        c.mV[i] = clampMillivolts(toMillivolts((uint32_t)i << ADC_CALIBRATION_SHIFT, arg));
+    }
+}
+
+bool adcCalibrationValid(const AdcCalibration &c)
+{
+    return c.magic == ADC_CALIBRATION_MAGIC;
+}
+
+uint16_t adcCalibrationApply(const AdcCalibration &c, uint16_t raw)
+{
+    uint8_t i = raw >> ADC_CALIBRATION_SHIFT;
+    if (i >= ADC_CALIBRATION_POINTS - 1)
+    {
+        return c.mV[ADC_CALIBRATION_POINTS - 1];
+    }
+
+    int32_t fraction = raw & ((1 << ADC_CALIBRATION_SHIFT) - 1);
+    int32_t step = (int32_t)c.mV[i + 1] - c.mV[i];
+
+    return clampMillivolts(c.mV[i] + ((step * fraction + (1 << (ADC_CALIBRATION_SHIFT - 1))) >> ADC_CALIBRATION_SHIFT));
+}
+
+void adcCalibrationAddBenchPoint(AdcCalibration &c, uint16_t raw, uint16_t actual_mV)
+{
+    uint16_t measured = adcCalibrationApply(c, raw);
+    if (measured == 0)
+    {
+        return;
+    }
+
+    if (c.benchPoints == 0)
+    {
+        // a single reference is best spent on the gain, it is the largest error
+        for (uint8_t i = 0; i < ADC_CALIBRATION_POINTS; i++)
+        {
+            c.mV[i] = clampMillivolts(((uint32_t)c.mV[i] * actual_mV + measured / 2) / measured);
+        }
+    }
+    else
+    {
+        // shift the segment holding the reading, the neighbouring segments tilt to meet it
+        uint8_t i = raw >> ADC_CALIBRATION_SHIFT;
+        if (i >= ADC_CALIBRATION_POINTS - 1)
+        {
+            i = ADC_CALIBRATION_POINTS - 2;
+        }
+
+        int32_t error = (int32_t)actual_mV - measured;
+        c.mV[i] = clampMillivolts(c.mV[i] + error);
+        c.mV[i + 1] = clampMillivolts(c.mV[i + 1] + error);
+    }
+
+    c.benchPoints++;
+}
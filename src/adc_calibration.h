@@ -0,0 +1,54 @@
+#ifndef ADC_CALIBRATION_h
+#define ADC_CALIBRATION_h
+
+#include <stdint.h>
+
+// one point every 256 counts across the 12 bit range, the last one sits at 4096
+const uint8_t ADC_CALIBRATION_POINTS = 17;
+const uint8_t ADC_CALIBRATION_SHIFT = 8;
+
+/*
+ * Piecewise linear map from raw ADC counts to millivolts, kept per device so
+ * the ADC's nonlinearity and the divider tolerance can be corrected. Plain
+ * data so it can be stored as a single NVS blob.
+ */
+struct AdcCalibration
+{
+    uint32_t magic;
+
+    // bench points folded in since the table was last reset
+    uint16_t benchPoints;
+
+    // millivolts at raw = i << ADC_CALIBRATION_SHIFT
+    uint16_t mV[ADC_CALIBRATION_POINTS];
+};
+
+/*
+ * Reset to a straight line through 0
+ * @param mVPer1000Counts The conversion factor, millivolts per 1000 counts
+ */
+void adcCalibrationLinear(AdcCalibration &c, uint32_t mVPer1000Counts);
+
+/*
+ * Reset to an arbitrary curve, e.g. the one from the eFuse characterization
+ * @param toMillivolts Converts raw counts to millivolts
+ */
+void adcCalibrationFromCurve(AdcCalibration &c, uint32_t (*toMillivolts)(uint32_t raw, void *arg), void *arg);
+
+bool adcCalibrationValid(const AdcCalibration &c);
+
+/*
+ * Convert raw counts to millivolts in integer math
+ */
+uint16_t adcCalibrationApply(const AdcCalibration &c, uint16_t raw);
+
+/*
+ * Fold in a reference measurement taken on the bench. The first one corrects
+ * the gain of the whole table, later ones move the two points around the
+ * reading so the table goes through the measurement.
+ * @param raw The reading while the reference voltage was applied
+ * @param actual_mV The reference voltage
+ */
+void adcCalibrationAddBenchPoint(AdcCalibration &c, uint16_t raw, uint16_t actual_mV);
+
+#endif
@@ -0,0 +1,49 @@
+#include <string.h>
+#include "adc_filter.h"
+
+void adcFilterBegin(AdcFilter &f)
+{
+    memset(&f, 0, sizeof(f));
+}
+
+uint16_t adcFilterAdd(AdcFilter &f, uint16_t sample)
+{
+    f.ring[f.next] = sample;
+    f.next = (f.next + 1) % ADC_FILTER_WINDOW;
+
+    if (f.count < ADC_FILTER_WINDOW)
+    {
+        f.count++;
+    }
+
+    // insertion sort a copy, the window is only a handful of samples
+    uint16_t sorted[ADC_FILTER_WINDOW];
+    for (uint8_t i = 0; i < f.count; i++)
+    {
+        uint16_t v = f.ring[i];
+        uint8_t j = i;
+        for (; j > 0 && sorted[j - 1] > v; j--)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = v;
+    }
+    uint16_t median = sorted[f.count / 2];
+
+    if (f.count == 1)
+    {
+        // start the average at the first reading instead of ramping up from 0
+        f.ema = (uint32_t)median << ADC_FILTER_EMA_SHIFT;
+    }
+    else
+    {
+        f.ema = f.ema - (f.ema >> ADC_FILTER_EMA_SHIFT) + median;
+    }
+
+    return adcFilterValue(f);
+}
+
+uint16_t adcFilterValue(const AdcFilter &f)
+{
+    return f.ema >> ADC_FILTER_EMA_SHIFT;
+}
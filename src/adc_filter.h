@@ -0,0 +1,40 @@
+#ifndef ADC_FILTER_h
+#define ADC_FILTER_h
+
+#include <stdint.h>
+
+// samples the median is taken over, odd so the median is a sample
+const uint8_t ADC_FILTER_WINDOW = 5;
+
+// the average moves 1/16 of the way to each new median
+const uint8_t ADC_FILTER_EMA_SHIFT = 4;
+
+/*
+ * Smooths raw ADC readings, a running median drops the spikes caused by
+ * radio bursts and an exponential moving average takes out the rest of the
+ * noise. Plain data and no Arduino calls so it can be fed from a timer.
+ */
+struct AdcFilter
+{
+    uint16_t ring[ADC_FILTER_WINDOW];
+    uint8_t next;
+    uint8_t count;
+
+    // average scaled up by ADC_FILTER_EMA_SHIFT bits
+    uint32_t ema;
+};
+
+void adcFilterBegin(AdcFilter &f);
+
+/*
+ * Add a raw reading
+ * @return The filtered value after the reading
+ */
+uint16_t adcFilterAdd(AdcFilter &f, uint16_t sample);
+
+/*
+ * @return The filtered value, 0 until the first reading
+ */
+uint16_t adcFilterValue(const AdcFilter &f);
+
+#endif
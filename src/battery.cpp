@@ -1,185 +1,567 @@
 /** Forked from https://github.com/pangodream/18650CL */
 
 #include <Arduino.h>
+#include <Preferences.h>
+#include <esp_adc_cal.h>
+#include <esp_timer.h>
+#include <time.h>
 #include "battery.h"
+#include "adc_calibration.h"
+#include "adc_filter.h"
+#include "battery_history.h"
+#include "soc_estimator.h"
 
-const double CONVERSION_FACTOR = 1.7;
-const double NUM_READS = 20;
+// millivolts at the battery per 1000 ADC counts, only used when the chip has no eFuse characterization
+const uint32_t CONVERSION_FACTOR = 1700;
+
+// the battery is read through a divider that halves it
+const uint32_t VOLTAGE_DIVIDER = 2;
+
+// reference used by the characterization when eFuse only holds two point values
+const uint32_t DEFAULT_VREF_MV = 1100;
+
+// the pin saturates below 4 V, so this covers every reading through the divider
+const uint16_t MAX_MILLIVOLTS = 4000 * VOLTAGE_DIVIDER;
+
+// nominal capacity of the 18650 cell
+const float BATTERY_CAPACITY_MAH = 2500;
+
+// cell plus protection circuit, used to add the sag under load back onto a reading
+const uint32_t INTERNAL_RESISTANCE_MOHM = 150;
+
+// average current drawn in each BatteryLoad
+const uint32_t LOAD_CURRENT_UA[BATTERY_LOAD_COUNT] = {
+    10,    // BATTERY_LOAD_SLEEP
+    90000, // BATTERY_LOAD_ADVERTISING
+    60000, // BATTERY_LOAD_CONNECTED
+};
+
+// power LED at full brightness
+const uint32_t LED_CURRENT_UA = 10000;
+
+// batches of history kept in NVS, the oldest is overwritten
+const uint8_t HISTORY_SLOTS = 8;
+
+const uint32_t BATTERY_HISTORY_MAGIC = 0x42484953;
+
+// how far the drain model may drift from the battery, in percent squared per hour
+const float MODEL_VARIANCE_PER_HOUR = 4;
+
+// variance of the percent looked up from the voltage with no load, in percent squared.
+// The sag correction gets worse with the load, so the variance grows with the current squared.
+const float MEASUREMENT_VARIANCE = 9;
+const float MEASUREMENT_VARIANCE_PER_MA2 = 0.01;
+
+struct DischargePoint
+{
+    uint8_t percent;
+    uint16_t mV;
+};
 
 /**
- * Maps each percent (index) to a voltage value
+ * Resting voltage of the cell at a few charge levels, the charge table is
+ * generated from these by linear interpolation
  */
-const double PERCENT_TO_VOLTS[] = {
-    .200,
-    .250,
-    .300,
-    .350,
-    .400,
-    .450,
-    .500,
-    .550,
-    .600,
-    .650,
-    3.700,
-    3.703,
-    3.706,
-    3.710,
-    3.713,
-    3.716,
-    3.719,
-    3.723,
-    3.726,
-    3.729,
-    3.732,
-    3.735,
-    3.739,
-    3.742,
-    3.745,
-    3.748,
-    3.752,
-    3.755,
-    3.758,
-    3.761,
-    3.765,
-    3.768,
-    3.771,
-    3.774,
-    3.777,
-    3.781,
-    3.784,
-    3.787,
-    3.790,
-    3.794,
-    3.797,
-    3.800,
-    3.805,
-    3.811,
-    3.816,
-    3.821,
-    3.826,
-    3.832,
-    3.837,
-    3.842,
-    3.847,
-    3.853,
-    3.858,
-    3.863,
-    3.868,
-    3.874,
-    3.879,
-    3.884,
-    3.889,
-    3.895,
-    3.900,
-    3.906,
-    3.911,
-    3.917,
-    3.922,
-    3.928,
-    3.933,
-    3.939,
-    3.944,
-    3.950,
-    3.956,
-    3.961,
-    3.967,
-    3.972,
-    3.978,
-    3.983,
-    3.989,
-    3.994,
-    4.000,
-    4.008,
-    4.015,
-    4.023,
-    4.031,
-    4.038,
-    4.046,
-    4.054,
-    4.062,
-    4.069,
-    4.077,
-    4.085,
-    4.092,
-    4.100,
-    4.111,
-    4.122,
-    4.133,
-    4.144,
-    4.156,
-    4.167,
-    4.178,
-    4.189,
-    4.200,
+constexpr DischargePoint DISCHARGE_CURVE[] = {
+    {0, 3200},
+    {10, 3700},
+    {41, 3800},
+    {60, 3900},
+    {78, 4000},
+    {91, 4100},
+    {100, 4200},
+};
+
+const uint8_t DISCHARGE_POINTS = sizeof(DISCHARGE_CURVE) / sizeof(DISCHARGE_CURVE[0]);
+
+// a power of two so the search always runs the same steps, entries above 100 % are padding
+const uint8_t CHARGE_TABLE_SIZE = 128;
+
+struct ChargeTable
+{
+    uint16_t mV[CHARGE_TABLE_SIZE];
 };
 
+constexpr ChargeTable buildChargeTable()
+{
+    ChargeTable table{};
+    uint8_t k = 0;
+
+    for (uint8_t percent = 0; percent <= 100; percent++)
+    {
+        while (DISCHARGE_CURVE[k + 1].percent < percent)
+        {
+            k++;
+        }
+
+        const DischargePoint &a = DISCHARGE_CURVE[k];
+        const DischargePoint &b = DISCHARGE_CURVE[k + 1];
+        uint32_t span = b.percent - a.percent;
+        table.mV[percent] = a.mV + ((uint32_t)(b.mV - a.mV) * (percent - a.percent) * 2 + span) / (2 * span);
+    }
+
+    for (uint8_t i = 101; i < CHARGE_TABLE_SIZE; i++)
+    {
+        table.mV[i] = UINT16_MAX;
+    }
+
+    return table;
+}
+
+/**
+ * Maps each percent (index) to a voltage in millivolts
+ */
+constexpr ChargeTable PERCENT_TO_MV = buildChargeTable();
+
+/**
+ * Charge level in tenths of a percent, interpolated between the two table
+ * entries around the voltage
+ */
+constexpr uint16_t getChargeTenths(uint16_t mV)
+{
+    if (mV <= PERCENT_TO_MV.mV[0])
+    {
+        return 0;
+    }
+    if (mV >= PERCENT_TO_MV.mV[100])
+    {
+        return 1000;
+    }
+
+    // find the last entry not above mV, the padding never matches so no bounds check
+    uint8_t idx = 0;
+    for (uint8_t step = CHARGE_TABLE_SIZE / 2; step > 0; step >>= 1)
+    {
+        idx += PERCENT_TO_MV.mV[idx + step] <= mV ? step : 0;
+    }
+
+    uint16_t low = PERCENT_TO_MV.mV[idx];
+    uint16_t span = PERCENT_TO_MV.mV[idx + 1] - low;
+    return idx * 10 + ((mV - low) * 20 + span) / (2 * span);
+}
+
+constexpr bool chargeTableIsMonotonic()
+{
+    if (DISCHARGE_CURVE[0].percent != 0 || DISCHARGE_CURVE[DISCHARGE_POINTS - 1].percent != 100)
+    {
+        return false;
+    }
+    for (uint8_t i = 1; i < DISCHARGE_POINTS; i++)
+    {
+        if (DISCHARGE_CURVE[i].percent <= DISCHARGE_CURVE[i - 1].percent)
+        {
+            return false;
+        }
+    }
+    for (uint8_t i = 1; i <= 100; i++)
+    {
+        // equal neighbours would make the interpolation divide by zero
+        if (PERCENT_TO_MV.mV[i] <= PERCENT_TO_MV.mV[i - 1])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// walk every voltage the ADC can report
+constexpr bool chargeLevelIsMonotonic()
+{
+    uint16_t previous = 0;
+    for (uint32_t mV = 0; mV <= MAX_MILLIVOLTS; mV++)
+    {
+        uint16_t tenths = getChargeTenths(mV);
+        if (tenths < previous || tenths > 1000)
+        {
+            return false;
+        }
+        previous = tenths;
+    }
+    for (uint8_t percent = 0; percent <= 100; percent++)
+    {
+        if (getChargeTenths(PERCENT_TO_MV.mV[percent]) != percent * 10)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(chargeTableIsMonotonic(), "DISCHARGE_CURVE must cover 0-100 % with rising voltages");
+static_assert(chargeLevelIsMonotonic(), "charge level must rise with the voltage");
+
+// background sampler, only used once useBatterySampler() is called
+esp_timer_handle_t samplerTimer = NULL;
+uint8_t samplerPin;
+unsigned long samplerPeriod_ms;
+AdcFilter samplerFilter;
+
+// reads by the sampler and by the loop kept apart, each has a single writer
+volatile uint32_t samplerReads = 0;
+uint32_t burstReads = 0;
+
+// filtered reading published by the sampler, a 16 bit store is atomic so the loop reads it unlocked
+volatile uint16_t sampledReading = 0;
+
+// per device raw to millivolt table, loaded from NVS on first use
+AdcCalibration calibration;
+
+// the estimate and the load behind it are kept through deep sleep with the history,
+// so waking up carries on from the estimate instead of a lookup of the loaded voltage
+RTC_DATA_ATTR SocEstimator estimator;
+
+// load on the battery since loadSince_ms, or since loadSinceWall_s across a deep sleep,
+// and the charge drawn before it
+RTC_DATA_ATTR BatteryLoad load;
+RTC_DATA_ATTR uint8_t loadLedBrightness;
+RTC_DATA_ATTR unsigned long loadSince_ms;
+RTC_DATA_ATTR time_t loadSinceWall_s;
+RTC_DATA_ATTR uint64_t drawn_uAms;
+
+// time the load model has run since the last estimate
+RTC_DATA_ATTR uint64_t sinceEstimate_ms;
+
+// history of the charge, kept through deep sleep and flushed to NVS a batch at a time
+RTC_DATA_ATTR uint32_t historyMagic;
+RTC_DATA_ATTR int32_t historyClockOffset_s;
+RTC_DATA_ATTR uint32_t historyBatches;
+RTC_DATA_ATTR uint8_t historyPending;
+RTC_DATA_ATTR BatterySample historyBatch[BATTERY_HISTORY_BATCH];
+RTC_DATA_ATTR BatteryTrend trend;
+
 int pinRead(uint8_t pin)
 {
     int totalValue = 0;
     int averageValue = 0;
-    for (int i = 0; i < NUM_READS; i++)
+    for (int i = 0; i < BATTERY_BURST_READS; i++)
     {
         totalValue += analogRead(pin);
     }
-    averageValue = totalValue / NUM_READS;
+    averageValue = totalValue / BATTERY_BURST_READS;
+    burstReads += BATTERY_BURST_READS;
     return averageValue;
 }
 
-double analogReadToVolts(uint16_t readValue)
+// converts with the ADC characterization burnt into eFuse at the factory
+uint32_t efuseToMillivolts(uint32_t raw, void *arg)
+{
+    return esp_adc_cal_raw_to_voltage(raw, (esp_adc_cal_characteristics_t *)arg) * VOLTAGE_DIVIDER;
+}
+
+void defaultCalibration()
+{
+    if (esp_adc_cal_check_efuse(ESP_ADC_CAL_VAL_EFUSE_TP) == ESP_OK || esp_adc_cal_check_efuse(ESP_ADC_CAL_VAL_EFUSE_VREF) == ESP_OK)
+    {
+        // analogRead() defaults to 12 bits at 11 dB
+        esp_adc_cal_characteristics_t characteristics;
+        esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, DEFAULT_VREF_MV, &characteristics);
+        adcCalibrationFromCurve(calibration, efuseToMillivolts, &characteristics);
+    }
+    else
+    {
+        adcCalibrationLinear(calibration, CONVERSION_FACTOR);
+    }
+}
+
+void loadCalibration()
 {
-    double volts;
-    volts = readValue * CONVERSION_FACTOR / 1000;
-    return volts;
+    Preferences prefs;
+    prefs.begin("battery", true);
+    size_t length = prefs.getBytes("cal", &calibration, sizeof(calibration));
+    prefs.end();
+
+    if (length != sizeof(calibration) || !adcCalibrationValid(calibration))
+    {
+        defaultCalibration();
+    }
+}
+
+void saveCalibration()
+{
+    Preferences prefs;
+    prefs.begin("battery");
+    prefs.putBytes("cal", &calibration, sizeof(calibration));
+    prefs.end();
+}
+
+uint16_t analogReadToMillivolts(uint16_t readValue)
+{
+    if (!adcCalibrationValid(calibration))
+    {
+        loadCalibration();
+    }
+
+    return adcCalibrationApply(calibration, readValue);
 }
 
 double getBatteryVolts(uint8_t pin)
 {
-    uint16_t readValue = pinRead(pin);
-    return analogReadToVolts(readValue);
+    return getBatteryMillivolts(pin) / 1000.0;
 }
 
-/**
- * Performs a binary search to find the index corresponding to a voltage.
- * The index of the array is the charge %
- */
-int getChargeLevel(double volts)
+uint16_t getBatteryMillivolts(uint8_t pin)
 {
-    int idx = 50;
-    int prev = 0;
-    int half = 0;
-    if (volts >= 4.2)
+    uint16_t readValue = samplerTimer != NULL && pin == samplerPin ? sampledReading : pinRead(pin);
+    return analogReadToMillivolts(readValue);
+}
+
+// runs in the esp_timer task, one short read per tick instead of a blocking burst
+void sampleBattery(void *)
+{
+    sampledReading = adcFilterAdd(samplerFilter, analogRead(samplerPin));
+    samplerReads++;
+}
+
+void useBatterySampler(uint8_t pin, unsigned long period_ms)
+{
+    if (samplerTimer != NULL)
     {
-        return 100;
+        return;
     }
-    if (volts <= 3.2)
+
+    samplerPin = pin;
+    samplerPeriod_ms = period_ms;
+    adcFilterBegin(samplerFilter);
+
+    // prime the filter with an averaged read so the first level is already right
+    sampledReading = adcFilterAdd(samplerFilter, pinRead(pin));
+
+    esp_timer_create_args_t args = {};
+    args.callback = sampleBattery;
+    args.name = "battery";
+
+    esp_timer_create(&args, &samplerTimer);
+    esp_timer_start_periodic(samplerTimer, period_ms * 1000);
+}
+
+void setBatterySamplerPeriod(unsigned long period_ms)
+{
+    if (samplerTimer == NULL || period_ms == samplerPeriod_ms)
     {
-        return 0;
+        return;
     }
-    while (true)
+
+    samplerPeriod_ms = period_ms;
+    esp_timer_stop(samplerTimer);
+    esp_timer_start_periodic(samplerTimer, period_ms * 1000);
+}
+
+uint32_t batteryAdcReads()
+{
+    return samplerReads + burstReads;
+}
+
+// seconds since the first boot, time() keeps counting through deep sleep but restarts on reset
+uint32_t historyClock()
+{
+    return time(NULL) + historyClockOffset_s;
+}
+
+void historyKey(char *key, uint32_t batch)
+{
+    sprintf(key, "h%u", batch % HISTORY_SLOTS);
+}
+
+// after a reset, start the estimate over and refit the trend from the batches in NVS
+void restoreHistory()
+{
+    historyMagic = BATTERY_HISTORY_MAGIC;
+
+    socEstimatorBegin(estimator);
+    load = BATTERY_LOAD_ADVERTISING;
+    loadLedBrightness = 0;
+    loadSince_ms = millis();
+    loadSinceWall_s = time(NULL);
+    drawn_uAms = 0;
+    sinceEstimate_ms = 0;
+
+    historyClockOffset_s = 0;
+    historyPending = 0;
+    batteryTrendBegin(trend);
+
+    Preferences prefs;
+    prefs.begin("battery", true);
+    historyBatches = prefs.getUInt("hbatches", 0);
+
+    uint32_t first = historyBatches > HISTORY_SLOTS ? historyBatches - HISTORY_SLOTS : 0;
+    for (uint32_t b = first; b < historyBatches; b++)
     {
-        half = abs(idx - prev) / 2;
-        prev = idx;
-        if (volts >= PERCENT_TO_VOLTS[idx])
-        {
-            idx = idx + half;
-        }
-        else
+        char key[8];
+        historyKey(key, b);
+        if (prefs.getBytes(key, historyBatch, sizeof(historyBatch)) != sizeof(historyBatch))
         {
-            idx = idx - half;
+            continue;
         }
-        if (prev == idx)
+
+        for (uint8_t i = 0; i < BATTERY_HISTORY_BATCH; i++)
         {
-            break;
+            batteryTrendAdd(trend, historyBatch[i]);
         }
     }
-    return idx;
+    prefs.end();
+
+    // carry on from the last stored sample, the time spent powered off is unknown
+    if (trend.weight > 0)
+    {
+        historyClockOffset_s = trend.origin_s - time(NULL);
+    }
+}
+
+void recordBatteryHistory(uint16_t mV, uint8_t percent)
+{
+    if (historyMagic != BATTERY_HISTORY_MAGIC)
+    {
+        restoreHistory();
+    }
+
+    BatterySample &sample = historyBatch[historyPending++];
+    sample.time_s = historyClock();
+    sample.mV = mV;
+    sample.load = load;
+    sample.percent = percent;
+
+    batteryTrendAdd(trend, sample);
+
+    if (historyPending < BATTERY_HISTORY_BATCH)
+    {
+        return;
+    }
+
+    // one write per batch keeps the flash wear down
+    char key[8];
+    historyKey(key, historyBatches);
+
+    Preferences prefs;
+    prefs.begin("battery");
+    prefs.putBytes(key, historyBatch, sizeof(historyBatch));
+    prefs.putUInt("hbatches", ++historyBatches);
+    prefs.end();
+
+    historyPending = 0;
+}
+
+uint32_t loadCurrentMicroamps()
+{
+    return LOAD_CURRENT_UA[load] + LED_CURRENT_UA * loadLedBrightness / 255;
+}
+
+void accumulateLoad(unsigned long now)
+{
+    if (historyMagic != BATTERY_HISTORY_MAGIC)
+    {
+        restoreHistory();
+    }
+
+    // millis() starts over after deep sleep, the wall clock kept counting. Within one
+    // boot the two agree to the second.
+    time_t wall_s = time(NULL);
+    uint64_t elapsed_ms = now - loadSince_ms;
+    uint64_t wallElapsed_ms = (uint64_t)max(wall_s - loadSinceWall_s, (time_t)0) * 1000;
+    if (now < loadSince_ms || wallElapsed_ms > elapsed_ms + 1000)
+    {
+        elapsed_ms = wallElapsed_ms;
+    }
+
+    drawn_uAms += loadCurrentMicroamps() * elapsed_ms;
+    sinceEstimate_ms += elapsed_ms;
+    loadSince_ms = now;
+    loadSinceWall_s = wall_s;
+}
+
+void setBatteryLoad(BatteryLoad newLoad, uint8_t ledBrightness)
+{
+    accumulateLoad(millis());
+
+    load = newLoad;
+    loadLedBrightness = ledBrightness;
 }
 
 int getBatteryChargeLevel(uint8_t pin)
 {
-    uint16_t readValue = pinRead(pin);
-    double volts = analogReadToVolts(readValue);
-    int chargeLevel = getChargeLevel(volts);
+    unsigned long now = millis();
+    accumulateLoad(now);
+
+    // uA ms to mAh
+    float drawn_mAh = drawn_uAms / 3.6e9f;
+    float hours = sinceEstimate_ms / 3.6e6f;
+    socEstimatorPredict(estimator, drawn_mAh, BATTERY_CAPACITY_MAH, MODEL_VARIANCE_PER_HOUR * hours);
+
+    drawn_uAms = 0;
+    sinceEstimate_ms = 0;
+
+    // undo the sag so the reading can be looked up on the open circuit curve
+    uint32_t current_mA = loadCurrentMicroamps() / 1000;
+    uint16_t mV = getBatteryMillivolts(pin);
+    uint32_t openCircuit_mV = mV + current_mA * INTERNAL_RESISTANCE_MOHM / 1000;
+    float measured = getChargeTenths(min(openCircuit_mV, (uint32_t)UINT16_MAX)) / 10.0f;
+
+    socEstimatorUpdate(estimator, measured, MEASUREMENT_VARIANCE + MEASUREMENT_VARIANCE_PER_MA2 * current_mA * current_mA);
+
+    uint8_t percent = socEstimatorPercent(estimator);
+    recordBatteryHistory(mV, percent);
+
+    return percent;
+}
+
+long getBatteryMinutesLeft()
+{
+    if (historyMagic != BATTERY_HISTORY_MAGIC)
+    {
+        restoreHistory();
+    }
+
+    float hours = batteryTrendHoursLeft(trend);
+    return hours < 0 ? -1 : (long)(hours * 60);
+}
+
+void printBatteryHistory(Print &out)
+{
+    out.printf("{\"minutes_left\":%ld,\"batches\":%u,\"samples\":[", getBatteryMinutesLeft(), historyBatches);
+    for (uint8_t i = 0; i < historyPending; i++)
+    {
+        const BatterySample &sample = historyBatch[i];
+        out.printf(i ? ",[%u,%u,%u,%u]" : "[%u,%u,%u,%u]", sample.time_s, sample.mV, sample.load, sample.percent);
+    }
+    out.print("]}\n");
+}
+
+void calibrateBattery(uint8_t pin, uint16_t actual_mV)
+{
+    if (!adcCalibrationValid(calibration))
+    {
+        loadCalibration();
+    }
 
-    return chargeLevel;
+    // average a fresh burst, the filtered value may still be settling
+    adcCalibrationAddBenchPoint(calibration, pinRead(pin), actual_mV);
+    saveCalibration();
+
+    // the estimate was built on the old readings
+    socEstimatorBegin(estimator);
+}
+
+void resetBatteryCalibration()
+{
+    Preferences prefs;
+    prefs.begin("battery");
+    prefs.remove("cal");
+    prefs.end();
+
+    defaultCalibration();
+    socEstimatorBegin(estimator);
+}
+
+void printBatteryCalibration(Print &out)
+{
+    if (!adcCalibrationValid(calibration))
+    {
+        loadCalibration();
+    }
+
+    out.printf("{\"bench_points\":%u,\"mV\":[", calibration.benchPoints);
+    for (uint8_t i = 0; i < ADC_CALIBRATION_POINTS; i++)
+    {
+        out.printf(i ? ",%u" : "%u", calibration.mV[i]);
+    }
+    out.print("]}\n");
 }
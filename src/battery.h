@@ -1,12 +1,89 @@
 #ifndef BATTERY_h
 #define BATTERY_h
 
+#include <stdint.h>
+
+class Print;
+
+// reads averaged by a blocking read of the battery
+const int BATTERY_BURST_READS = 20;
+
+// what the battery is powering, used to model the drain and the sag under load
+enum BatteryLoad : uint8_t
+{
+    BATTERY_LOAD_SLEEP,
+    BATTERY_LOAD_ADVERTISING,
+    BATTERY_LOAD_CONNECTED,
+    BATTERY_LOAD_COUNT
+};
+
 /*
- * Get the battery charge level (0-100)
+ * Get the battery charge level (0-100), estimated from the voltage and the
+ * charge drawn by the loads since the last call so it does not jump when the
+ * voltage sags
  * @return The calculated battery charge level
  */
 int getBatteryChargeLevel(uint8_t pin);
 double getBatteryVolts(uint8_t pin);
+
+/*
+ * Get the battery voltage in millivolts, averaged over a few reads
+ */
+uint16_t getBatteryMillivolts(uint8_t pin);
+
+/*
+ * Tell the charge estimator what is drawing from the battery from now on
+ * @param ledBrightness PWM duty of the power LED (0-255)
+ */
+void setBatteryLoad(BatteryLoad load, uint8_t ledBrightness);
+
+/*
+ * Sample the battery on a timer in the background. Once started, reads of
+ * this pin return the filtered value right away instead of blocking on the ADC.
+ */
+void useBatterySampler(uint8_t pin, unsigned long period_ms);
+
+/*
+ * Change how often the background sampler reads the pin, e.g. to read
+ * rarely while nothing needs a fresh level
+ */
+void setBatterySamplerPeriod(unsigned long period_ms);
+
+/*
+ * @return analogRead() calls made for the battery since boot, by the sampler and by blocking reads
+ */
+uint32_t batteryAdcReads();
+
+/*
+ * Predict how long the battery lasts from the charge history, which is
+ * sampled on every getBatteryChargeLevel() call
+ * @return Minutes left, -1 until the history shows a discharge
+ */
+long getBatteryMinutesLeft();
+
+/*
+ * Print the prediction and the samples not yet written to NVS as a JSON line
+ */
+void printBatteryHistory(Print &out);
+
+/*
+ * Correct the calibration with a reference measurement, e.g. from a
+ * multimeter across the battery, and store it in NVS. The first measurement
+ * fixes the gain, later ones taken at other charge levels fix the shape.
+ * @param actual_mV The measured battery voltage
+ */
+void calibrateBattery(uint8_t pin, uint16_t actual_mV);
+
+/*
+ * Drop the stored calibration and go back to the eFuse characterization
+ */
+void resetBatteryCalibration();
+
+/*
+ * Print the raw to millivolt table as a JSON line
+ */
+void printBatteryCalibration(Print &out);
+
 int getAnalogPin(uint8_t pin);
 int pinRead(uint8_t pin);
 double getConvFactor(uint8_t pin);
@@ -0,0 +1,57 @@
+#include "battery_history.h"
+
+// weight left on a sample after each newer one, about a day of awake samples
+const float TREND_DECAY = 0.99f;
+
+// samples needed before the slope means anything
+const float TREND_MIN_WEIGHT = 3;
+
+void batteryTrendBegin(BatteryTrend &trend)
+{
+    trend.origin_s = 0;
+    trend.weight = 0;
+    trend.t = 0;
+    trend.y = 0;
+    trend.tt = 0;
+    trend.ty = 0;
+}
+
+void batteryTrendAdd(BatteryTrend &trend, const BatterySample &sample)
+{
+    // move the origin to the new sample, in hours
+    float shift = trend.weight > 0 ? (int32_t)(sample.time_s - trend.origin_s) / 3600.0f : 0;
+    trend.tt += -2 * shift * trend.t + trend.weight * shift * shift;
+    trend.ty -= shift * trend.y;
+    trend.t -= trend.weight * shift;
+    trend.origin_s = sample.time_s;
+
+    trend.weight = trend.weight * TREND_DECAY + 1;
+    trend.t *= TREND_DECAY;
+    trend.y = trend.y * TREND_DECAY + sample.percent;
+    trend.tt *= TREND_DECAY;
+    trend.ty *= TREND_DECAY;
+}
+
+float batteryTrendHoursLeft(const BatteryTrend &trend)
+{
+    if (trend.weight < TREND_MIN_WEIGHT)
+    {
+        return -1;
+    }
+
+    float spread = trend.weight * trend.tt - trend.t * trend.t;
+    if (spread <= 0)
+    {
+        return -1;
+    }
+
+    // percent per hour, and the fitted charge at the newest sample
+    float slope = (trend.weight * trend.ty - trend.t * trend.y) / spread;
+    if (slope >= 0)
+    {
+        return -1;
+    }
+    float now = (trend.y - slope * trend.t) / trend.weight;
+
+    return now > 0 ? now / -slope : 0;
+}
@@ -0,0 +1,43 @@
+#ifndef BATTERY_HISTORY_h
+#define BATTERY_HISTORY_h
+
+#include <stdint.h>
+
+// samples kept in RTC memory before they are written to NVS as one batch
+const uint8_t BATTERY_HISTORY_BATCH = 16;
+
+struct BatterySample
+{
+    // seconds on the history clock, which keeps counting through deep sleep
+    uint32_t time_s;
+    uint16_t mV;
+    uint8_t load;
+    uint8_t percent;
+};
+
+/*
+ * Least squares line through the charge over time, updated in O(1) per
+ * sample. Older samples fade out so the slope follows the current usage.
+ * The sums are kept relative to the newest sample to keep floats precise.
+ */
+struct BatteryTrend
+{
+    uint32_t origin_s;
+    float weight;
+    float t;
+    float y;
+    float tt;
+    float ty;
+};
+
+void batteryTrendBegin(BatteryTrend &trend);
+
+void batteryTrendAdd(BatteryTrend &trend, const BatterySample &sample);
+
+/*
+ * Predict when the charge reaches 0
+ * @return Hours left after the newest sample, negative while there is no discharge to go on
+ */
+float batteryTrendHoursLeft(const BatteryTrend &trend);
+
+#endif
@@ -0,0 +1,51 @@
+#include "battery_publisher.h"
+
+void batteryPublisherBegin(BatteryPublisher &p, uint32_t interval_ms, uint32_t now_ms)
+{
+    p.published = 0;
+    p.hasPublished = false;
+    p.interval_ms = interval_ms;
+    p.since_ms = now_ms;
+    p.samples = 0;
+    p.notifies = 0;
+}
+
+bool batteryPublisherSample(BatteryPublisher &p, uint8_t percent, long minutesLeft, bool force)
+{
+    p.samples++;
+
+    if (percent <= BATTERY_PUBLISH_LOW_PERCENT)
+    {
+        p.interval_ms = BATTERY_PUBLISH_MIN_INTERVAL_MS;
+    }
+    else if (minutesLeft >= 0)
+    {
+        // sample about twice per hysteresis step at the predicted rate
+        uint64_t step_ms = (uint64_t)minutesLeft * 60 * 1000 * BATTERY_PUBLISH_HYSTERESIS / percent;
+        uint64_t interval_ms = step_ms / 2;
+
+        if (interval_ms < BATTERY_PUBLISH_MIN_INTERVAL_MS)
+        {
+            interval_ms = BATTERY_PUBLISH_MIN_INTERVAL_MS;
+        }
+        else if (interval_ms > BATTERY_PUBLISH_MAX_INTERVAL_MS)
+        {
+            interval_ms = BATTERY_PUBLISH_MAX_INTERVAL_MS;
+        }
+        p.interval_ms = interval_ms;
+    }
+
+    uint8_t change = percent > p.published ? percent - p.published : p.published - percent;
+    bool changed = change >= BATTERY_PUBLISH_HYSTERESIS || (change > 0 && percent <= BATTERY_PUBLISH_LOW_PERCENT);
+
+    if (!force && p.hasPublished && !changed)
+    {
+        return false;
+    }
+
+    p.published = percent;
+    p.hasPublished = true;
+    p.notifies++;
+
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef BATTERY_PUBLISHER_h
+#define BATTERY_PUBLISHER_h
+
+#include <stdint.h>
+
+// change in percent needed before a new level is notified
+const uint8_t BATTERY_PUBLISH_HYSTERESIS = 2;
+
+// at or below this level every change is notified and sampling is fastest
+const uint8_t BATTERY_PUBLISH_LOW_PERCENT = 10;
+
+const uint32_t BATTERY_PUBLISH_MIN_INTERVAL_MS = 60 * 1000UL;
+const uint32_t BATTERY_PUBLISH_MAX_INTERVAL_MS = 30 * 60 * 1000UL;
+
+/*
+ * Decides when the battery level is sampled and when a change is worth a
+ * notification. The interval is fitted to how fast the level falls, so a
+ * flat battery is sampled rarely and a falling or nearly empty one often.
+ */
+struct BatteryPublisher
+{
+    uint8_t published;
+    bool hasPublished;
+    uint32_t interval_ms;
+
+    // counters since begin
+    uint32_t since_ms;
+    uint32_t samples;
+    uint32_t notifies;
+};
+
+void batteryPublisherBegin(BatteryPublisher &p, uint32_t interval_ms, uint32_t now_ms);
+
+/*
+ * Feed a sampled level and refit the interval
+ * @param minutesLeft Predicted runtime, negative while unknown
+ * @param force Notify even without a change, e.g. for a new connection
+ * @return true if the level should be notified
+ */
+bool batteryPublisherSample(BatteryPublisher &p, uint8_t percent, long minutesLeft, bool force);
+
+#endif
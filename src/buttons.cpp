@@ -1,35 +1,65 @@
 #include <Arduino.h>
-#include <FunctionalInterrupt.h>
-#include <functional>
+#include <Preferences.h>
+#include <esp_timer.h>
+#include <atomic>
 #include "buttons.h"
-#include <stack>
-#include <unordered_map>
-#include <vector>
-
-using InterruptFn = std::function<void(void)>;
+#include "click_timing.h"
+#include "debounce.h"
+#include "edge_queue.h"
+#include "flight_recorder.h"
+#include "gestures.h"
+#include "gpio_input.h"
+#include "key_matrix.h"
 
 const unsigned long DEBOUNCE_THRESHOLD_MS = 100;
-const unsigned long MULTI_CLICK_THRESHOLD_MS = 300;
-const unsigned long PRESS_HOLD_THRESHOLD_MS = 1000;
-const unsigned long EVENT_TIMEOUT = 2000;
+const unsigned long DEBOUNCE_THRESHOLD_US = DEBOUNCE_THRESHOLD_MS * 1000;
+
+// ESP32 exposes GPIO 0-39, the pins above are virtual pins for matrix keys
+const uint8_t GPIO_PIN_COUNT = 40;
+const uint8_t MAX_BUTTON_PINS = 64;
+const uint8_t KEY_MATRIX_FIRST_PIN = GPIO_PIN_COUNT;
+const unsigned long KEY_MATRIX_SCAN_PERIOD_US = 1000;
+
+// one bit per pin, bit n set when pin n has a handler
+typedef uint64_t PinMask;
+
+const PinMask GPIO_PINS = ((PinMask)1 << GPIO_PIN_COUNT) - 1;
+
+const uint8_t MAX_COMBOS = 8;
+const uint8_t MAX_ADAPTIVE_PINS = 4;
+const uint8_t MAX_REPEAT_PINS = 4;
+
+// learned windows are only written back to NVS once they drift this far
+const uint16_t CLICK_WINDOW_SAVE_STEP_MS = 20;
+
+// most callbacks a single loop can resolve: two per edge, the window that closed
+// before it and the edge itself, plus a timer per pin and combo
+const uint32_t MAX_PENDING_CALLBACKS = 2 * EdgeQueue::CAPACITY + MAX_BUTTON_PINS + MAX_COMBOS;
+static_assert(MAX_PENDING_CALLBACKS <= UINT8_MAX, "pendingCallbackCount is a uint8_t");
 
 class Handler
 {
 public:
     uint8_t pin;
-    unsigned long debounceLock;
+    uint8_t profile;
+    GestureSlot gesture;
+
+    // time and level of the last accepted edge, and the time of the last
+    // bounce rejected after it. Written by the interrupt routine, and by the
+    // loop only while interrupts are masked.
+    uint32_t lastEdge_us;
+    uint32_t lastBounce_us;
+    uint8_t lastLevel;
+
+    // 1-based index into clickTimings, 0 when the multi-click window is fixed
+    uint8_t clickTiming;
+    bool released;
+    uint32_t lastRelease_us;
 
     void (*onClickFn)();
     void (*onMultiClick)(uint8_t clickCount);
     void (*onPressHoldFn)();
-
-    Handler(uint8_t pin)
-    {
-        this->pin = pin;
-        this->onClickFn = NULL;
-        this->onMultiClick = NULL;
-        this->onPressHoldFn = NULL;
-    }
+    void (*onRepeatFn)();
 
     void registerClickHandler(void (*cb)())
     {
@@ -39,201 +69,608 @@ public:
     void registeMultiClickHandler(void (*cb)(uint8_t clickCount))
     {
         this->onMultiClick = cb;
+        this->updateProfile();
     }
 
     void registerPressHoldHandler(void (*cb)())
     {
         this->onPressHoldFn = cb;
+        this->updateProfile();
     }
-};
 
-class PendingEvent
-{
-public:
-    unsigned long lastEvent_ms;
-    uint8_t clickCount = 0;
-    Handler *handler;
+    void registerRepeatHandler(void (*cb)(), const uint32_t *schedule)
+    {
+        this->onRepeatFn = cb;
+        this->gesture.repeatSchedule = schedule;
+        this->updateProfile();
+    }
 
-    PendingEvent(Handler *handler)
+private:
+    void updateProfile()
     {
-        this->lastEvent_ms = millis();
-        this->handler = handler;
+        if (this->onRepeatFn != NULL)
+        {
+            // a repeating button can't also be held or multi-clicked
+            this->profile = GESTURE_PROFILE_REPEAT;
+            return;
+        }
+
+        this->profile = (this->onMultiClick != NULL ? GESTURE_PROFILE_MULTI_CLICK : 0) |
+                        (this->onPressHoldFn != NULL ? GESTURE_PROFILE_PRESS_HOLD : 0);
     }
 };
 
-enum change_state
+/*
+ * A set of pins that must be held down together, precompiled to a mask
+ */
+class Combo
 {
-    rising,
-    falling
+public:
+    PinMask mask;
+    uint32_t hold_us;
+    void (*onComboHoldFn)();
+
+    // time the last pin of the combo went down, valid while armed
+    uint32_t since;
+    bool armed;
+    bool fired;
 };
 
-class ChangeInterrupt
+/*
+ * A resolved gesture whose callback runs once classification is done
+ */
+class PendingCallback
 {
 public:
-    uint8_t pin;
-    change_state state;
+    void (*fn)();
+    void (*countFn)(uint8_t count);
+    uint8_t count;
 
-    ChangeInterrupt(uint8_t pin, change_state state)
-    {
-        this->pin = pin;
-        this->state = state;
-    }
+    // time of the edge, or clock sample for timers, that resolved the gesture
+    uint32_t resolved_us;
 };
 
-std::unordered_map<uint8_t, Handler *> handlers;
-std::stack<ChangeInterrupt *> changeInterrupts;
-std::unordered_map<uint8_t, PendingEvent *> pendingEvents;
+const uint8_t LATENCY_BUCKETS = 16;
+
+/*
+ * Counters for how well the button pipeline keeps up with its input
+ */
+class ButtonStats
+{
+public:
+    uint32_t edges;
+    volatile uint32_t bounces;
+    uint32_t recovered;
+    uint32_t peakBatch;
+    uint32_t callbacks;
+    uint32_t droppedCallbacks;
+
+    // bucket n counts resolve to callback latencies below 2^n microseconds,
+    // the last bucket counts everything longer
+    uint32_t latency[LATENCY_BUCKETS];
+};
+
+// handler slots are indexed by pin and zero initialized, only the slots
+// flagged in activePins are in use
+Handler handlers[MAX_BUTTON_PINS];
+PinMask activePins = 0;
+EdgeQueue edges;
+
+// pins whose gesture is waiting on a timer, the only ones the loop has to visit
+PinMask timedPins = 0;
+
+// pins that bounced during their debounce window, the edge that ended the
+// bounce may have been one of the ones ignored
+volatile PinMask bouncedPins = 0;
+
+// pins currently held down, as classified from the edge queue
+PinMask pressedPins = 0;
+Combo combos[MAX_COMBOS];
+uint8_t comboCount = 0;
+
+// combos armed and not fired yet, bit n for combos[n]. Only these have a timer.
+uint8_t comboTimers = 0;
+
+// adaptive multi-click windows, kept across deep sleep. Pins claim slots in
+// registration order so each pin finds its own slot again after waking up.
+RTC_DATA_ATTR ClickTiming clickTimings[MAX_ADAPTIVE_PINS];
+uint8_t clickTimingCount = 0;
 
-void processChangeInterrupt(ChangeInterrupt *interrupt)
+// precomputed repeat schedules, see GestureSlot::repeatSchedule
+uint32_t repeatSchedules[MAX_REPEAT_PINS][GESTURE_REPEAT_STEPS];
+uint8_t repeatScheduleCount = 0;
+
+PendingCallback pendingCallbacks[MAX_PENDING_CALLBACKS];
+uint8_t pendingCallbackCount = 0;
+
+// longest time buttonEventLoop() has held interrupts masked, in CPU cycles
+uint32_t maxMaskedCycles = 0;
+
+ButtonStats stats;
+
+// scanner input backend, only used once useButtonScanner() is called
+esp_timer_handle_t scanTimer = NULL;
+unsigned long scanPeriod_us = 0;
+
+// the scanner dates an edge back to the first sample that confirmed it, so an
+// edge confirmed later can be older than the clock. Every edge dated before
+// the horizon has been queued, gesture timers don't run past it.
+std::atomic<uint32_t> scanHorizon_us(0);
+VerticalDebouncer scanDebouncer;
+KeyMatrix keyMatrix;
+
+inline uint8_t firstPin(PinMask mask)
 {
-    unsigned long now = millis();
-    uint8_t pin = interrupt->pin;
-    Handler *h = handlers[pin];
+    return __builtin_ctzll(mask);
+}
 
-    // if debounce lock was set from the latest interrupt, initialize it to now
-    if (h->debounceLock == true)
+void deferCallback(void (*fn)(), void (*countFn)(uint8_t count), uint8_t count, uint32_t time)
+{
+    if (pendingCallbackCount == MAX_PENDING_CALLBACKS)
     {
-        h->debounceLock = now;
+        stats.droppedCallbacks++;
+        return;
     }
 
-    // TODO: use pendingEvents.count(pin) instead to check if key exists
-    if (pendingEvents.count(pin) == 0)
+    PendingCallback &p = pendingCallbacks[pendingCallbackCount++];
+    p.fn = fn;
+    p.countFn = countFn;
+    p.count = count;
+    p.resolved_us = time;
+}
+
+void dispatchGesture(Handler &h, GestureAction action, uint32_t time)
+{
+    if (action != GESTURE_NONE)
     {
-        if (interrupt->state == falling)
-        {
-            // pin changed from a high -> low, track new pending event
-            PendingEvent *e = new PendingEvent(h);
+        flightRecord(FLIGHT_GESTURE, h.pin, action, h.gesture.clicks, time);
+    }
 
-            pendingEvents[pin] = e;
+    switch (action)
+    {
+    case GESTURE_CLICK:
+        if (h.onClickFn != NULL)
+        {
+            deferCallback(h.onClickFn, NULL, 0, time);
         }
+        break;
+    case GESTURE_MULTI_CLICK:
+        deferCallback(NULL, h.onMultiClick, h.gesture.clicks, time);
+        break;
+    case GESTURE_HOLD:
+        deferCallback(h.onPressHoldFn, NULL, 0, time);
+        break;
+    case GESTURE_REPEAT:
+        deferCallback(h.onRepeatFn, NULL, 0, time);
+        break;
+    default:
+        break;
     }
-    else
+}
+
+void runPendingCallbacks()
+{
+    for (uint8_t i = 0; i < pendingCallbackCount; i++)
     {
-        // a pending event already exists for this pin, update it
-        PendingEvent *p = pendingEvents[pin];
-        p->lastEvent_ms = now;
+        PendingCallback &p = pendingCallbacks[i];
+
+        uint32_t latency = micros() - p.resolved_us;
+        uint8_t bucket = latency ? 32 - __builtin_clz(latency) : 0;
+        stats.latency[min(bucket, (uint8_t)(LATENCY_BUCKETS - 1))]++;
+        stats.callbacks++;
 
-        if (interrupt->state == rising)
+        if (p.fn != NULL)
+        {
+            p.fn();
+        }
+        else
         {
-            // pin change is low -> high, track as another click
-            p->clickCount++;
+            p.countFn(p.count);
         }
     }
+
+    pendingCallbackCount = 0;
 }
 
-void clearPendingEvent(std::unordered_map<uint8_t, PendingEvent *>::iterator i, PendingEvent *e)
+// feed a pin's gesture and dispatch what it resolves
+void stepGesture(Handler &h, GestureInput input, uint32_t time)
 {
-    delete e;
-    pendingEvents.erase(i);
+    dispatchGesture(h, gestureStep(h.gesture, h.profile, input, time), time);
+
+    // idle and held gestures only move again on the next edge
+    PinMask bit = (PinMask)1 << h.pin;
+    bool timed = h.gesture.state != GESTURE_IDLE && h.gesture.state != GESTURE_HELD;
+    timedPins = timed ? timedPins | bit : timedPins & ~bit;
 }
 
-void cleanExpiredDebounceLocks()
+void processComboTimers(uint32_t now)
 {
-    unsigned long now = millis();
-    for (std::pair<const uint8_t, Handler *> pair : handlers)
+    for (uint8_t i = 0; i < comboCount; i++)
     {
-        unsigned long lock = pair.second->debounceLock;
-        if (lock && lock - now > DEBOUNCE_THRESHOLD_MS)
+        Combo &c = combos[i];
+        // signed so a combo armed by an edge newer than now reads as not elapsed
+        if (c.armed && !c.fired && (int32_t)(now - c.since) > (int32_t)c.hold_us)
         {
-            // clear the debounce lock
-            pair.second->debounceLock = false;
+            c.fired = true;
+            comboTimers &= ~(1 << i);
+            deferCallback(c.onComboHoldFn, NULL, 0, now);
         }
     }
 }
 
-void processPendingEvents()
+void armCombo(Combo &c, uint32_t now)
 {
-    for (auto i = pendingEvents.begin(); i != pendingEvents.end(); ++i)
+    for (uint8_t i = 0; i < comboCount; i++)
     {
-        PendingEvent *e = (*i).second;
+        Combo &other = combos[i];
+        if (!other.armed || &other == &c)
+        {
+            continue;
+        }
 
-        unsigned long now = millis();
-        unsigned long timeElapsed_ms = now - e->lastEvent_ms;
-        Handler *h = e->handler;
-        uint8_t pin = h->pin;
-        int pinState = digitalRead(pin);
+        if ((other.mask & c.mask) == c.mask)
+        {
+            // a larger combo is already held, it takes precedence
+            return;
+        }
 
-        if (h->onMultiClick == NULL && h->onPressHoldFn == NULL && pinState == HIGH)
+        if ((other.mask & c.mask) == other.mask)
         {
-            // trigger single-click event
-            h->onClickFn();
+            // this combo extends one that is held, swallow the smaller one
+            other.fired = true;
+            comboTimers &= ~(1 << i);
+        }
+    }
 
-            clearPendingEvent(i, e);
+    c.armed = true;
+    c.fired = false;
+    c.since = now;
+    comboTimers |= 1 << (&c - combos);
+
+    // the pins belong to the combo now, drop their single button gestures
+    for (PinMask pins = c.mask; pins; pins &= pins - 1)
+    {
+        gestureCancel(handlers[firstPin(pins)].gesture);
+    }
+    timedPins &= ~c.mask;
+}
+
+void updateCombos(uint32_t now)
+{
+    for (uint8_t i = 0; i < comboCount; i++)
+    {
+        Combo &c = combos[i];
+        bool held = (pressedPins & c.mask) == c.mask;
+
+        if (held && !c.armed)
+        {
+            armCombo(c, now);
         }
-        else if (h->onMultiClick != NULL && pinState == HIGH && timeElapsed_ms > MULTI_CLICK_THRESHOLD_MS)
+        else if (!held)
         {
-            if (e->clickCount > 1)
-            {
-                // trigger double-click event
-                h->onMultiClick(e->clickCount);
-            }
-            else if (h->onClickFn != NULL)
-            {
-                // trigger single-click event
-                h->onClickFn();
-            }
+            c.armed = false;
+            comboTimers &= ~(1 << i);
+        }
+    }
+}
+
+void clickWindowKey(char *key, uint8_t pin)
+{
+    snprintf(key, 8, "mcw%u", pin);
+}
+
+void saveClickWindow(ClickTiming &t)
+{
+    char key[8];
+    clickWindowKey(key, t.pin);
 
-            clearPendingEvent(i, e);
+    Preferences prefs;
+    prefs.begin("buttons");
+    prefs.putUShort(key, t.window_ms);
+    prefs.end();
+
+    t.saved_ms = t.window_ms;
+}
+
+void learnClickTiming(Handler &h, GestureInput input, uint32_t time)
+{
+    if (input == GESTURE_INPUT_RELEASE)
+    {
+        h.released = true;
+        h.lastRelease_us = time;
+        return;
+    }
+
+    if (!h.released)
+    {
+        return;
+    }
+    h.released = false;
+
+    // every release to press gap counts, including ones that already missed
+    // the window, so a window that is too short can still grow back
+    ClickTiming &t = clickTimings[h.clickTiming - 1];
+    if (clickTimingAddGap(t, (time - h.lastRelease_us) / 1000))
+    {
+        h.gesture.multiClickWindow_us = t.window_ms * 1000UL;
+
+        if (abs((int)t.window_ms - (int)t.saved_ms) >= CLICK_WINDOW_SAVE_STEP_MS)
+        {
+            saveClickWindow(t);
         }
-        else if (h->onPressHoldFn != NULL && pinState == LOW && e->clickCount < 1 && timeElapsed_ms > PRESS_HOLD_THRESHOLD_MS)
+    }
+}
+
+void processChangeInterrupt(const EdgeEvent &edge)
+{
+    Handler &h = handlers[edge.pin];
+    PinMask bit = (PinMask)1 << edge.pin;
+
+    flightRecord(FLIGHT_EDGE, edge.pin, edge.level, 0, edge.time);
+
+    // gestures are classified against the time the edge occurred rather than
+    // when the loop got to it, so first let any window that closed before
+    // this edge resolve as it would have in real time
+    processComboTimers(edge.time);
+    stepGesture(h, GESTURE_INPUT_TIMER, edge.time);
+
+    // high -> low is a press, low -> high is a release
+    GestureInput input = edge.level == LOW ? GESTURE_INPUT_PRESS : GESTURE_INPUT_RELEASE;
+    pressedPins = input == GESTURE_INPUT_PRESS ? pressedPins | bit : pressedPins & ~bit;
+
+    if (h.clickTiming)
+    {
+        learnClickTiming(h, input, edge.time);
+    }
+
+    stepGesture(h, input, edge.time);
+
+    if (comboCount)
+    {
+        updateCombos(edge.time);
+    }
+}
+
+// live level of a pin, debounced when the scanner reads it
+bool pinHeld(uint8_t pin)
+{
+    if (scanTimer != NULL)
+    {
+        return (scanDebouncer.state >> pin) & 1;
+    }
+
+    return pin < GPIO_PIN_COUNT && digitalRead(pin) == LOW;
+}
+
+void processPendingEvents(uint32_t now)
+{
+    processComboTimers(now);
+
+    for (PinMask pins = timedPins; pins; pins &= pins - 1)
+    {
+        Handler &h = handlers[firstPin(pins)];
+
+        // a repeat only goes out while the button is really still down, a
+        // release that never made it to the queue ends the repeat here
+        if (h.profile == GESTURE_PROFILE_REPEAT && gestureTimerDue(h.gesture, h.profile, now) && !pinHeld(h.pin))
         {
-            // trigger press and hold event
-            h->onPressHoldFn();
+            pressedPins &= ~((PinMask)1 << h.pin);
+            stepGesture(h, GESTURE_INPUT_RELEASE, now);
+            if (comboCount)
+            {
+                updateCombos(now);
+            }
+            continue;
+        }
 
-            clearPendingEvent(i, e);
+        // resolve gestures whose multi-click, hold or timeout window has elapsed
+        stepGesture(h, GESTURE_INPUT_TIMER, now);
+    }
+}
+
+// queue the level a pin settled on if the debounce window swallowed the edge
+// that got it there, e.g. the release of a tap shorter than the window
+uint8_t recoverSettledEdges(EdgeEvent *batch, uint8_t batchSize, uint32_t now)
+{
+    for (PinMask pins = bouncedPins; pins && batchSize < EdgeQueue::CAPACITY; pins &= pins - 1)
+    {
+        uint8_t pin = firstPin(pins);
+        Handler &h = handlers[pin];
+
+        if (now - h.lastEdge_us <= DEBOUNCE_THRESHOLD_US)
+        {
+            continue;
         }
-        else if (timeElapsed_ms > EVENT_TIMEOUT)
+        bouncedPins &= ~((PinMask)1 << pin);
+
+        uint8_t level = digitalRead(pin);
+        if (level != h.lastLevel)
         {
-            // the event has timed out and never completed for some reason
-            // gracefully clear it without triggering anything
-            clearPendingEvent(i, e);
+            // the contact last moved with the last bounce
+            h.lastEdge_us = h.lastBounce_us;
+            h.lastLevel = level;
+            batch[batchSize++] = {h.lastBounce_us, pin, level};
+            stats.recovered++;
         }
     }
+
+    return batchSize;
 }
 
 void buttonEventLoop()
 {
-    // critical code - handler must complete and be cleaned up without an interrupt
+    // nothing queued, no timer running and no bounce to check: most loops
+    // stop here. An edge that lands right after the check waits for the next
+    // loop, the same as one that lands after the snapshot.
+    if (edges.size() == 0 && !timedPins && !comboTimers && !bouncedPins)
+    {
+        return;
+    }
+
+    EdgeEvent batch[EdgeQueue::CAPACITY];
+    uint8_t batchSize = 0;
+
+    // critical code - snapshot the queued edges together with the clock so
+    // that no edge older than now can arrive after the batch is taken and
+    // be overtaken by a gesture timer. Keep this to the copy, and the read
+    // of pins that bounced, alone.
     noInterrupts();
+    uint32_t maskedAt = ESP.getCycleCount();
 
-    while (!changeInterrupts.empty())
+    uint32_t now = micros();
+    uint32_t timersUntil = now;
+    if (scanTimer != NULL)
     {
-        ChangeInterrupt *interrupt = changeInterrupts.top();
-        processChangeInterrupt(interrupt);
-        delete interrupt;
-        changeInterrupts.pop();
+        // read before the queue, the scanner queues edges before it moves the horizon
+        uint32_t horizon = scanHorizon_us.load(std::memory_order_acquire);
+        if ((int32_t)(horizon - now) < 0)
+        {
+            timersUntil = horizon;
+        }
     }
 
-    processPendingEvents();
-    cleanExpiredDebounceLocks();
+    while (batchSize < EdgeQueue::CAPACITY && edges.pop(batch[batchSize]))
+    {
+        batchSize++;
+    }
 
-    // re-enable interrupts
+    uint8_t queued = batchSize;
+    if (bouncedPins)
+    {
+        batchSize = recoverSettledEdges(batch, batchSize, now);
+    }
+
+    uint32_t masked = ESP.getCycleCount() - maskedAt;
     interrupts();
+
+    // recovered edges are dated to the last bounce, which can be older than
+    // edges queued since. Move each one back to its place in time.
+    for (uint8_t i = queued; i < batchSize; i++)
+    {
+        EdgeEvent recovered = batch[i];
+        uint8_t at = i;
+        for (; at > 0 && (int32_t)(batch[at - 1].time - recovered.time) > 0; at--)
+        {
+            batch[at] = batch[at - 1];
+        }
+        batch[at] = recovered;
+    }
+
+    if (masked > maxMaskedCycles)
+    {
+        maxMaskedCycles = masked;
+    }
+
+    stats.edges += batchSize;
+    if (batchSize > stats.peakBatch)
+    {
+        stats.peakBatch = batchSize;
+    }
+
+    // classify oldest first with interrupts enabled, resolved gestures are
+    // only queued here
+    for (uint8_t i = 0; i < batchSize; i++)
+    {
+        processChangeInterrupt(batch[i]);
+    }
+
+    processPendingEvents(timersUntil);
+
+    // callbacks may block on BLE or serial, run them outside of any lock
+    runPendingCallbacks();
+}
+
+// push a button change event, stamped with the time of the edge, to the queue
+void IRAM_ATTR onPinChange(void *arg)
+{
+    uint32_t now = micros();
+    uint8_t pin = (uint8_t)(uintptr_t)arg;
+    Handler &h = handlers[pin];
+
+    // ignore bounces until the debounce window after the last accepted edge
+    // has passed, the loop reads the pin again once the window is over
+    if (now - h.lastEdge_us > DEBOUNCE_THRESHOLD_US)
+    {
+        h.lastEdge_us = now;
+        h.lastLevel = digitalRead(pin);
+        bouncedPins = bouncedPins & ~((PinMask)1 << pin);
+        edges.push(pin, h.lastLevel, now);
+    }
+    else
+    {
+        h.lastBounce_us = now;
+        bouncedPins = bouncedPins | ((PinMask)1 << pin);
+        stats.bounces = stats.bounces + 1;
+    }
+}
+
+// sample and debounce every button pin at once, push the debounced changes to the queue
+void scanButtons(void *)
+{
+    // the first sample a change can be dated back to, on this tick or any later one
+    uint32_t horizon = micros() - (VerticalDebouncer::SAMPLES - 1) * scanPeriod_us;
+
+    // buttons pull their pin low while pressed
+    PinMask pressed = ~readInputPins() & GPIO_PINS;
+
+    if (keyMatrix.rows)
+    {
+        pressed |= (PinMask)keyMatrix.scan() << KEY_MATRIX_FIRST_PIN;
+    }
+
+    pressed &= activePins;
+    PinMask changed = scanDebouncer.update(pressed);
+
+    // date the edge back to the first of the samples that confirmed it
+    for (PinMask pins = changed; pins; pins &= pins - 1)
+    {
+        uint8_t pin = firstPin(pins);
+        edges.push(pin, (scanDebouncer.state >> pin) & 1 ? LOW : HIGH, horizon);
+    }
+
+    scanHorizon_us.store(horizon, std::memory_order_release);
 }
 
 void maybeInitializeHandler(uint8_t pin)
 {
+    PinMask bit = (PinMask)1 << pin;
+
     // check if the pin is already assigned to a handler
-    if (handlers.count(pin) == 0)
+    if (!(activePins & bit))
     {
-        // create a new handler for this pin
-        handlers[pin] = new Handler(pin);
+        handlers[pin].pin = pin;
+        handlers[pin].lastLevel = HIGH;
+        activePins |= bit;
 
-        // define an interrupt routine that will push a button change event to the stack
-        InterruptFn btn_change_fn{
-            [pin]()
-            {
-                Handler *h = handlers.at(pin);
-                if (!h->debounceLock)
-                {
-                    changeInterrupts.push(new ChangeInterrupt(pin, digitalRead(pin) == HIGH ? rising : falling));
+        // the scanner picks up new pins from activePins on its next tick
+        if (scanTimer == NULL && pin < GPIO_PIN_COUNT)
+        {
+            attachInterruptArg(digitalPinToInterrupt(pin), onPinChange, (void *)(uintptr_t)pin, CHANGE);
+        }
+    }
+}
 
-                    h->debounceLock = true;
-                }
-            }};
+void useButtonScanner(unsigned long period_us)
+{
+    if (scanTimer != NULL)
+    {
+        return;
+    }
 
-        attachInterrupt(digitalPinToInterrupt(pin), btn_change_fn, CHANGE);
+    // hand the pins over from their pin change interrupts to the scanner
+    for (PinMask pins = activePins; pins; pins &= pins - 1)
+    {
+        detachInterrupt(digitalPinToInterrupt(firstPin(pins)));
     }
+
+    esp_timer_create_args_t args = {};
+    args.callback = scanButtons;
+    args.name = "buttons";
+
+    scanPeriod_us = period_us;
+    scanHorizon_us = micros() - (VerticalDebouncer::SAMPLES - 1) * period_us;
+    esp_timer_create(&args, &scanTimer);
+    esp_timer_start_periodic(scanTimer, period_us);
 }
 
 void onClick(uint8_t pin, void (*cb)())
@@ -241,7 +678,7 @@ void onClick(uint8_t pin, void (*cb)())
     maybeInitializeHandler(pin);
 
     // assign click handler
-    handlers[pin]->registerClickHandler(cb);
+    handlers[pin].registerClickHandler(cb);
 }
 
 void onMultiClick(uint8_t pin, void (*cb)(uint8_t clickCount))
@@ -249,7 +686,7 @@ void onMultiClick(uint8_t pin, void (*cb)(uint8_t clickCount))
     maybeInitializeHandler(pin);
 
     // assign double click handler
-    handlers[pin]->registeMultiClickHandler(cb);
+    handlers[pin].registeMultiClickHandler(cb);
 }
 
 void onPressHold(uint8_t pin, void (*cb)())
@@ -257,5 +694,159 @@ void onPressHold(uint8_t pin, void (*cb)())
     maybeInitializeHandler(pin);
 
     // assign press and hold handler
-    handlers[pin]->registerPressHoldHandler(cb);
+    handlers[pin].registerPressHoldHandler(cb);
+}
+
+bool onRepeat(uint8_t pin, unsigned long initialDelay, RepeatCurve curve, void (*cb)())
+{
+    maybeInitializeHandler(pin);
+    Handler &h = handlers[pin];
+
+    uint32_t *schedule;
+    if (h.onRepeatFn != NULL)
+    {
+        // re-registering a pin reuses its schedule
+        schedule = (uint32_t *)h.gesture.repeatSchedule;
+    }
+    else if (repeatScheduleCount < MAX_REPEAT_PINS)
+    {
+        schedule = repeatSchedules[repeatScheduleCount++];
+    }
+    else
+    {
+        return false;
+    }
+
+    // walk the curve once here so the gesture timers are a table lookup
+    schedule[0] = initialDelay * 1000;
+    unsigned long interval = curve.start_ms;
+    for (uint8_t i = 1; i < GESTURE_REPEAT_STEPS; i++)
+    {
+        schedule[i] = max(interval, curve.min_ms) * 1000;
+        interval -= interval * curve.accel_percent / 100;
+    }
+
+    h.registerRepeatHandler(cb, schedule);
+
+    return true;
+}
+
+bool enableAdaptiveMultiClick(uint8_t pin, unsigned long min_ms, unsigned long max_ms)
+{
+    maybeInitializeHandler(pin);
+    Handler &h = handlers[pin];
+
+    if (h.clickTiming == 0)
+    {
+        if (clickTimingCount == MAX_ADAPTIVE_PINS)
+        {
+            return false;
+        }
+        h.clickTiming = ++clickTimingCount;
+    }
+
+    ClickTiming &t = clickTimings[h.clickTiming - 1];
+
+    if (!clickTimingValid(t, pin, min_ms, max_ms))
+    {
+        // cold boot, start from the window learned before power was lost,
+        // or from the longest window allowed
+        char key[8];
+        clickWindowKey(key, pin);
+
+        Preferences prefs;
+        prefs.begin("buttons", true);
+        unsigned long window_ms = prefs.getUShort(key, max_ms);
+        prefs.end();
+
+        window_ms = constrain(window_ms, min_ms, max_ms);
+        clickTimingBegin(t, pin, min_ms, max_ms, window_ms);
+    }
+
+    h.gesture.multiClickWindow_us = t.window_ms * 1000UL;
+
+    return true;
+}
+
+unsigned long multiClickWindowMillis(uint8_t pin)
+{
+    Handler &h = handlers[pin];
+    return h.clickTiming ? clickTimings[h.clickTiming - 1].window_ms : 0;
+}
+
+bool onComboHold(const uint8_t *pins, uint8_t count, unsigned long time, void (*cb)())
+{
+    if (comboCount == MAX_COMBOS)
+    {
+        return false;
+    }
+
+    Combo &c = combos[comboCount];
+    c.mask = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        maybeInitializeHandler(pins[i]);
+        c.mask |= (PinMask)1 << pins[i];
+    }
+    c.hold_us = time * 1000;
+    c.onComboHoldFn = cb;
+
+    comboCount++;
+
+    return true;
+}
+
+bool beginKeyMatrix(const uint8_t *rowPins, uint8_t rows, const uint8_t *colPins, uint8_t cols, bool diodes)
+{
+    if (rows > KEY_MATRIX_MAX_ROWS || cols > KEY_MATRIX_MAX_COLS || rows * cols > MAX_BUTTON_PINS - KEY_MATRIX_FIRST_PIN)
+    {
+        return false;
+    }
+
+    keyMatrix.begin(rowPins, rows, colPins, cols, diodes);
+
+    // matrix keys are only read by the scanner
+    useButtonScanner(KEY_MATRIX_SCAN_PERIOD_US);
+
+    return true;
+}
+
+uint8_t matrixKey(uint8_t row, uint8_t col)
+{
+    return KEY_MATRIX_FIRST_PIN + row * keyMatrix.cols + col;
+}
+
+unsigned long keyMatrixMaxScanMicros()
+{
+    return keyMatrix.maxScanTime_us;
+}
+
+unsigned long buttonMaxMaskedMicros()
+{
+    return maxMaskedCycles / getCpuFrequencyMhz();
+}
+
+unsigned long buttonEdgeOverflows()
+{
+    return edges.overflowCount();
+}
+
+unsigned long buttonEdgeCount()
+{
+    return stats.edges;
+}
+
+void printButtonStats(Print &out)
+{
+    out.printf("{\"uptime_ms\":%lu,\"edges\":%u,\"bounces\":%u,\"recovered\":%u,\"overflows\":%u,\"peak_queue\":%u,",
+               millis(), stats.edges, stats.bounces, stats.recovered, edges.overflowCount(), stats.peakBatch);
+    out.printf("\"callbacks\":%u,\"dropped_callbacks\":%u,\"max_masked_us\":%lu,\"min_free_heap\":%u,",
+               stats.callbacks, stats.droppedCallbacks, buttonMaxMaskedMicros(), ESP.getMinFreeHeap());
+
+    out.print("\"latency_log2_us\":[");
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        out.printf(i ? ",%u" : "%u", stats.latency[i]);
+    }
+    out.print("]}\n");
 }
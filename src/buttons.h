@@ -1,11 +1,115 @@
 #ifndef BUTTONS_h
 #define BUTTONS_h
 
+#include <stdint.h>
+
+class Print;
+
 void buttonEventLoop();
 void onClick(uint8_t pin, void (*cb)());
 void onMultiClick(uint8_t pin, void (*cb)(uint8_t clickCount));
 void onPressHold(uint8_t pin, void (*cb)());
 
-// void onComboHold(uint8_t *pins, unsigned long time, void (*cb)());
+/*
+ * How a held button speeds up: the first interval between repeats is
+ * start_ms and each following one is accel_percent shorter, down to min_ms
+ */
+struct RepeatCurve
+{
+    unsigned long start_ms;
+    unsigned long min_ms;
+    uint8_t accel_percent;
+};
+
+/*
+ * Trigger a callback repeatedly, at an accelerating rate, while a button is
+ * held. Releasing before the first repeat is a click. Replaces multi-click
+ * and press and hold on the pin. Repeats the loop is too busy to trigger on
+ * time are dropped rather than queued up.
+ * @param initialDelay Time the button must be held before the first repeat in milliseconds
+ * @return false if the maximum number of repeating pins is registered
+ */
+bool onRepeat(uint8_t pin, unsigned long initialDelay, RepeatCurve curve, void (*cb)());
+
+/*
+ * Fit the multi-click window of a pin to how fast the user double-clicks,
+ * so single clicks resolve sooner. The window is learned from the gaps
+ * between releases and presses, kept across deep sleep and saved to NVS.
+ * @param min_ms The shortest window allowed
+ * @param max_ms The longest window allowed, also the starting window
+ * @return false if the maximum number of adaptive pins is registered
+ */
+bool enableAdaptiveMultiClick(uint8_t pin, unsigned long min_ms, unsigned long max_ms);
+
+/*
+ * Get the current multi-click window of an adaptive pin
+ * @return The window in milliseconds, 0 if the pin uses the fixed window
+ */
+unsigned long multiClickWindowMillis(uint8_t pin);
+
+/*
+ * Trigger a callback when a set of buttons is held down together. While a
+ * combo is held its buttons don't trigger their own gestures, and a larger
+ * combo takes precedence over a smaller one it contains.
+ * @param time How long all the buttons must be held in milliseconds
+ * @return false if the maximum number of combos is registered
+ */
+bool onComboHold(const uint8_t *pins, uint8_t count, unsigned long time, void (*cb)());
+
+/*
+ * Sample every button pin from the GPIO input register at a fixed period
+ * instead of attaching a pin change interrupt per button. All pins are
+ * debounced together, a change must hold for 4 consecutive samples.
+ * @param period_us The sampling period in microseconds
+ */
+void useButtonScanner(unsigned long period_us);
+
+/*
+ * Read up to 24 keys wired as a row/column matrix. Matrix keys are read by
+ * the button scanner, which is started with a 1ms period if it isn't running.
+ * @param diodes True if every key has a diode, otherwise rows that could be
+ *               showing a ghost key are held at their last good state
+ * @return false if the matrix is too large
+ */
+bool beginKeyMatrix(const uint8_t *rowPins, uint8_t rows, const uint8_t *colPins, uint8_t cols, bool diodes = false);
+
+/*
+ * Get the pin number to register gestures on for a matrix key, e.g.
+ * onClick(matrixKey(0, 2), cb)
+ */
+uint8_t matrixKey(uint8_t row, uint8_t col);
+
+/*
+ * Get the longest time a full matrix scan has taken
+ * @return The scan time in microseconds
+ */
+unsigned long keyMatrixMaxScanMicros();
+
+/*
+ * Get the longest time buttonEventLoop() has held interrupts masked
+ * @return The masked time in microseconds
+ */
+unsigned long buttonMaxMaskedMicros();
+
+/*
+ * Get the number of button edges dropped because the edge queue was full
+ * @return The total number of dropped edges since boot
+ */
+unsigned long buttonEdgeOverflows();
+
+/*
+ * Get the number of button edges processed, a change means a button moved
+ * @return The total number of edges since boot
+ */
+unsigned long buttonEdgeCount();
+
+/*
+ * Write the button pipeline counters as a single line of JSON: edges
+ * processed, rejected as bounces and recovered once a bounce settled, queue
+ * overflows and peak depth, callbacks run and dropped, the longest
+ * interrupt-masked time and a log2 histogram of the time from a gesture
+ * resolving to its callback running
+ */
+void printButtonStats(Print &out);
 
 #endif
\ No newline at end of file
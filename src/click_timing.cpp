@@ -0,0 +1,97 @@
+#include <string.h>
+#include "click_timing.h"
+
+const uint32_t CLICK_TIMING_MAGIC = 0x434C4B54;
+
+// gaps observed before the window moves off its starting value
+const uint16_t MIN_SAMPLES = 8;
+
+// percent of observed gaps the window has to cover
+const uint8_t WINDOW_PERCENTILE = 95;
+
+// slack added on top of the percentile gap
+const uint16_t WINDOW_MARGIN_MS = 40;
+
+void clickTimingBegin(ClickTiming &t, uint8_t pin, uint16_t min_ms, uint16_t max_ms, uint16_t window_ms)
+{
+    t.magic = CLICK_TIMING_MAGIC;
+    t.pin = pin;
+    t.min_ms = min_ms;
+    t.max_ms = max_ms;
+    t.window_ms = window_ms;
+    t.saved_ms = window_ms;
+    t.samples = 0;
+    memset(t.bins, 0, sizeof(t.bins));
+}
+
+bool clickTimingValid(const ClickTiming &t, uint8_t pin, uint16_t min_ms, uint16_t max_ms)
+{
+    return t.magic == CLICK_TIMING_MAGIC && t.pin == pin && t.min_ms == min_ms && t.max_ms == max_ms;
+}
+
+bool clickTimingAddGap(ClickTiming &t, uint32_t gap_ms)
+{
+    // a gap longer than the largest allowed window is two separate clicks
+    if (gap_ms > t.max_ms)
+    {
+        return false;
+    }
+
+    // bins evenly cover 0 to max_ms
+    uint16_t width = (t.max_ms + CLICK_TIMING_BINS - 1) / CLICK_TIMING_BINS;
+    uint8_t bin = gap_ms / width;
+    if (bin >= CLICK_TIMING_BINS)
+    {
+        bin = CLICK_TIMING_BINS - 1;
+    }
+
+    if (t.bins[bin] == UINT8_MAX)
+    {
+        // halve every bin so old gaps fade and the window can follow the user
+        t.samples = 0;
+        for (uint8_t i = 0; i < CLICK_TIMING_BINS; i++)
+        {
+            t.bins[i] >>= 1;
+            t.samples += t.bins[i];
+        }
+    }
+
+    t.bins[bin]++;
+    t.samples++;
+
+    if (t.samples < MIN_SAMPLES)
+    {
+        return false;
+    }
+
+    // walk up to the bin that holds the percentile gap
+    uint32_t target = ((uint32_t)t.samples * WINDOW_PERCENTILE + 99) / 100;
+    uint32_t seen = 0;
+    uint8_t i = 0;
+    for (; i < CLICK_TIMING_BINS - 1; i++)
+    {
+        seen += t.bins[i];
+        if (seen >= target)
+        {
+            break;
+        }
+    }
+
+    uint32_t window = (uint32_t)(i + 1) * width + WINDOW_MARGIN_MS;
+    if (window < t.min_ms)
+    {
+        window = t.min_ms;
+    }
+    else if (window > t.max_ms)
+    {
+        window = t.max_ms;
+    }
+
+    if (window == t.window_ms)
+    {
+        return false;
+    }
+
+    t.window_ms = window;
+    return true;
+}
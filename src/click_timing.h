@@ -0,0 +1,47 @@
+#ifndef CLICK_TIMING_h
+#define CLICK_TIMING_h
+
+#include <stdint.h>
+
+const uint8_t CLICK_TIMING_BINS = 16;
+
+/*
+ * Histogram of the gaps between a release and the next press on one pin,
+ * used to fit the multi-click window to how fast the user actually clicks.
+ * Plain data so it can be kept in RTC memory across deep sleep.
+ */
+struct ClickTiming
+{
+    uint32_t magic;
+    uint8_t pin;
+    uint16_t min_ms;
+    uint16_t max_ms;
+
+    // current multi-click window
+    uint16_t window_ms;
+
+    // window last written to persistent storage
+    uint16_t saved_ms;
+
+    uint16_t samples;
+    uint8_t bins[CLICK_TIMING_BINS];
+};
+
+/*
+ * Reset the histogram, the window starts at the given value until enough
+ * gaps are observed
+ */
+void clickTimingBegin(ClickTiming &t, uint8_t pin, uint16_t min_ms, uint16_t max_ms, uint16_t window_ms);
+
+/*
+ * Check that the timing was set up by clickTimingBegin() for this pin and bounds
+ */
+bool clickTimingValid(const ClickTiming &t, uint8_t pin, uint16_t min_ms, uint16_t max_ms);
+
+/*
+ * Record a release to press gap and refit the window
+ * @return true if the window changed
+ */
+bool clickTimingAddGap(ClickTiming &t, uint32_t gap_ms);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef DEBOUNCE_h
+#define DEBOUNCE_h
+
+#include <stdint.h>
+
+/*
+ * Integrating debouncer for up to 64 inputs at once. Every bit position has
+ * its own 2-bit counter sliced across cnt0/cnt1, so one sample costs a
+ * handful of word operations no matter how many inputs are in use.
+ */
+class VerticalDebouncer
+{
+public:
+    // consecutive samples an input must disagree with its state to flip
+    static const uint8_t SAMPLES = 4;
+
+    // debounced inputs, bit n set when input n is active
+    uint64_t state = 0;
+
+    /*
+     * Integrate one sample of all inputs
+     * @return The inputs whose debounced state flipped on this sample
+     */
+    uint64_t update(uint64_t sample)
+    {
+        uint64_t delta = sample ^ state;
+
+        // count up where the sample disagrees, reset where it agrees
+        cnt1 = (cnt1 ^ cnt0) & delta;
+        cnt0 = ~cnt0 & delta;
+
+        // a counter that wrapped back to zero has seen SAMPLES disagreements
+        uint64_t changed = delta & ~(cnt0 | cnt1);
+        state ^= changed;
+
+        return changed;
+    }
+
+private:
+    uint64_t cnt0 = 0;
+    uint64_t cnt1 = 0;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include <esp_attr.h>
+#include "edge_queue.h"
+
+static_assert((EdgeQueue::CAPACITY & (EdgeQueue::CAPACITY - 1)) == 0, "EdgeQueue capacity must be a power of two");
+
+EdgeQueue::EdgeQueue() : head(0), tail(0), overflows(0)
+{
+}
+
+bool IRAM_ATTR EdgeQueue::push(uint8_t pin, uint8_t level, uint32_t time)
+{
+    uint32_t h = head.load(std::memory_order_relaxed);
+
+    if (h - tail.load(std::memory_order_acquire) >= CAPACITY)
+    {
+        // consumer has fallen behind, drop the newest edge and count it
+        overflows = overflows + 1;
+        return false;
+    }
+
+    EdgeEvent &e = events[h & (CAPACITY - 1)];
+    e.time = time;
+    e.pin = pin;
+    e.level = level;
+
+    // publish the slot only after it has been fully written
+    head.store(h + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool EdgeQueue::pop(EdgeEvent &event)
+{
+    uint32_t t = tail.load(std::memory_order_relaxed);
+
+    if (t == head.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    event = events[t & (CAPACITY - 1)];
+
+    // hand the slot back to the producer
+    tail.store(t + 1, std::memory_order_release);
+
+    return true;
+}
+
+uint32_t EdgeQueue::size() const
+{
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+uint32_t EdgeQueue::overflowCount() const
+{
+    return overflows;
+}
@@ -0,0 +1,52 @@
+#ifndef EDGE_QUEUE_h
+#define EDGE_QUEUE_h
+
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * A single pin change as captured by the button interrupt routine
+ */
+struct EdgeEvent
+{
+    uint32_t time; // microseconds, captured in the interrupt routine
+    uint8_t pin;
+    uint8_t level;
+};
+
+/*
+ * Fixed capacity, single-producer/single-consumer ring buffer of edge events.
+ * The pin change interrupt is the only producer and buttonEventLoop() is the
+ * only consumer, so neither side has to allocate or mask interrupts.
+ */
+class EdgeQueue
+{
+public:
+    // must be a power of two so the free running indexes can be masked
+    static const uint32_t CAPACITY = 64;
+
+    EdgeQueue();
+
+    /*
+     * Append an edge from the interrupt routine
+     * @return false if the queue is full and the edge was dropped
+     */
+    bool push(uint8_t pin, uint8_t level, uint32_t time);
+
+    /*
+     * Remove the oldest edge from the queue
+     * @return false if the queue is empty
+     */
+    bool pop(EdgeEvent &event);
+
+    uint32_t size() const;
+    uint32_t overflowCount() const;
+
+private:
+    EdgeEvent events[CAPACITY];
+    std::atomic<uint32_t> head; // next slot to write, owned by the producer
+    std::atomic<uint32_t> tail; // next slot to read, owned by the consumer
+    volatile uint32_t overflows;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include <Arduino.h>
+#include "flight_recorder.h"
+
+const uint32_t FLIGHT_RECORDER_MAGIC = 0x464C5431;
+
+// must be a power of two so the free running index can be masked
+const uint16_t FLIGHT_RECORDER_SIZE = 128;
+
+// entries formatted per write to the serial port, 512 characters
+const uint16_t FLIGHT_DUMP_CHUNK = 32;
+
+RTC_DATA_ATTR uint32_t flightMagic;
+RTC_DATA_ATTR uint32_t flightNext;
+RTC_DATA_ATTR FlightRecord flightRecords[FLIGHT_RECORDER_SIZE];
+
+// time of the last entry, entries before a boot have no time to refer to
+uint32_t flightLast_us = 0;
+
+void flightRecorderBegin(uint8_t wakeupCause)
+{
+    if (flightMagic != FLIGHT_RECORDER_MAGIC)
+    {
+        // cold boot, RTC memory holds garbage
+        flightMagic = FLIGHT_RECORDER_MAGIC;
+        flightNext = 0;
+    }
+
+    flightLast_us = micros();
+    flightRecord(FLIGHT_BOOT, 0, wakeupCause, 0, flightLast_us);
+}
+
+void flightRecord(FlightRecordKind kind, uint8_t pin, uint8_t detail, uint8_t extra, uint32_t time_us)
+{
+    FlightRecord &r = flightRecords[flightNext++ & (FLIGHT_RECORDER_SIZE - 1)];
+    r.delta_us = time_us - flightLast_us;
+    r.kind = kind;
+    r.pin = pin;
+    r.detail = detail;
+    r.extra = extra;
+
+    flightLast_us = time_us;
+}
+
+void flightRecorderDump(Print &out)
+{
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
+    uint32_t count = min(flightNext, (uint32_t)FLIGHT_RECORDER_SIZE);
+    uint32_t first = flightNext - count;
+
+    // the line goes out a chunk of entries at a time rather than a byte at a
+    // time, without a buffer for the whole ring on the stack
+    char chunk[FLIGHT_DUMP_CHUNK * sizeof(FlightRecord) * 2];
+    size_t length = 0;
+
+    out.printf("FLIGHT %u ", count);
+    for (uint32_t i = first; i != flightNext; i++)
+    {
+        const uint8_t *bytes = (const uint8_t *)&flightRecords[i & (FLIGHT_RECORDER_SIZE - 1)];
+        for (uint8_t b = 0; b < sizeof(FlightRecord); b++)
+        {
+            chunk[length++] = HEX_DIGITS[bytes[b] >> 4];
+            chunk[length++] = HEX_DIGITS[bytes[b] & 0x0F];
+        }
+
+        if (length == sizeof(chunk))
+        {
+            out.write((const uint8_t *)chunk, length);
+            length = 0;
+        }
+    }
+    out.write((const uint8_t *)chunk, length);
+    out.print("\n");
+}
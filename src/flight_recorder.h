@@ -0,0 +1,44 @@
+#ifndef FLIGHT_RECORDER_h
+#define FLIGHT_RECORDER_h
+
+#include <stdint.h>
+
+class Print;
+
+enum FlightRecordKind : uint8_t
+{
+    FLIGHT_BOOT,    // detail: wakeup cause
+    FLIGHT_EDGE,    // detail: pin level after the edge
+    FLIGHT_GESTURE, // detail: GestureAction, extra: click or repeat count
+    FLIGHT_SEND     // detail: 1 if the report was queued, extra: media key bit or signed volume steps
+};
+
+/*
+ * One entry of the flight recorder. Times are stored as the microseconds
+ * since the previous entry so a dump can be replayed as an input trace.
+ */
+struct FlightRecord
+{
+    int32_t delta_us;
+    uint8_t kind;
+    uint8_t pin;
+    uint8_t detail;
+    uint8_t extra;
+};
+
+/*
+ * Start a new boot in the recorder, kept in RTC memory so the entries
+ * leading up to a deep sleep are still there after waking up
+ */
+void flightRecorderBegin(uint8_t wakeupCause);
+
+void flightRecord(FlightRecordKind kind, uint8_t pin, uint8_t detail, uint8_t extra, uint32_t time_us);
+
+/*
+ * Write the recorder oldest entry first as "FLIGHT <count> <hex>" on one
+ * line, every entry is 16 hex digits: delta_us (little endian), kind, pin,
+ * detail, extra
+ */
+void flightRecorderDump(Print &out);
+
+#endif
@@ -0,0 +1,186 @@
+#include "gestures.h"
+
+const uint32_t MULTI_CLICK_THRESHOLD_MS = 300;
+const uint32_t PRESS_HOLD_THRESHOLD_MS = 1000;
+const uint32_t EVENT_TIMEOUT = 2000;
+
+// slot times are edge timestamps in microseconds
+const uint32_t MULTI_CLICK_THRESHOLD_US = MULTI_CLICK_THRESHOLD_MS * 1000;
+const uint32_t PRESS_HOLD_THRESHOLD_US = PRESS_HOLD_THRESHOLD_MS * 1000;
+const uint32_t EVENT_TIMEOUT_US = EVENT_TIMEOUT * 1000;
+
+// the timer comes from the slot's repeat schedule
+const uint32_t SCHEDULED = UINT32_MAX;
+
+/*
+ * Side effect of a transition on the slot
+ */
+enum RuleAction : uint8_t
+{
+    ACT_NONE,
+    ACT_START,   // begin a new gesture
+    ACT_COUNT,   // count a completed click
+    ACT_CLICK,   // count a completed click and resolve it immediately
+    ACT_RESOLVE, // resolve the counted clicks as a click or multi-click
+    ACT_HOLD,    // resolve a press and hold
+    ACT_REPEAT   // resolve the next repeat of a held button
+};
+
+struct GestureRule
+{
+    GestureState next;
+    RuleAction action;
+};
+
+#define RULE(next, action) {GESTURE_##next, ACT_##action}
+
+/*
+ * Transition table indexed by [profile][state][input]
+ *
+ * A pin without a multi-click handler resolves a click on release, otherwise
+ * it waits in GESTURE_RELEASED for another press. A pin with a press and hold
+ * handler resolves the hold once the press outlasts the state's timer. A pin
+ * with a repeat handler keeps repeating for as long as it is held.
+ */
+static constexpr GestureRule GESTURE_RULES[GESTURE_PROFILE_COUNT][GESTURE_STATE_COUNT][GESTURE_INPUT_COUNT] = {
+    // click only
+    {
+        /* IDLE      */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(IDLE, NONE)},
+        /* PRESSED   */ {RULE(PRESSED, NONE), RULE(IDLE, CLICK), RULE(IDLE, NONE)},
+        /* RELEASED  */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(IDLE, NONE)},
+        /* HELD      */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(HELD, NONE)},
+        /* REPEATING */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(IDLE, NONE)},
+    },
+    // multi-click
+    {
+        /* IDLE      */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(IDLE, NONE)},
+        /* PRESSED   */ {RULE(PRESSED, NONE), RULE(RELEASED, COUNT), RULE(IDLE, NONE)},
+        /* RELEASED  */ {RULE(PRESSED, NONE), RULE(RELEASED, NONE), RULE(IDLE, RESOLVE)},
+        /* HELD      */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(HELD, NONE)},
+        /* REPEATING */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(IDLE, NONE)},
+    },
+    // press and hold
+    {
+        /* IDLE      */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(IDLE, NONE)},
+        /* PRESSED   */ {RULE(PRESSED, NONE), RULE(IDLE, CLICK), RULE(HELD, HOLD)},
+        /* RELEASED  */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(IDLE, NONE)},
+        /* HELD      */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(HELD, NONE)},
+        /* REPEATING */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(IDLE, NONE)},
+    },
+    // multi-click and press and hold
+    {
+        /* IDLE      */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(IDLE, NONE)},
+        /* PRESSED   */ {RULE(PRESSED, NONE), RULE(RELEASED, COUNT), RULE(HELD, HOLD)},
+        /* RELEASED  */ {RULE(PRESSED, NONE), RULE(RELEASED, NONE), RULE(IDLE, RESOLVE)},
+        /* HELD      */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(HELD, NONE)},
+        /* REPEATING */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(IDLE, NONE)},
+    },
+    // repeat
+    {
+        /* IDLE      */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(IDLE, NONE)},
+        /* PRESSED   */ {RULE(PRESSED, NONE), RULE(IDLE, CLICK), RULE(REPEATING, REPEAT)},
+        /* RELEASED  */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(IDLE, NONE)},
+        /* HELD      */ {RULE(PRESSED, START), RULE(IDLE, NONE), RULE(HELD, NONE)},
+        /* REPEATING */ {RULE(REPEATING, NONE), RULE(IDLE, NONE), RULE(REPEATING, REPEAT)},
+    },
+};
+
+#undef RULE
+
+/*
+ * Time a slot may stay in a state before a timer input fires, indexed by
+ * [profile][state]. Zero means the state has no timer.
+ */
+static constexpr uint32_t GESTURE_TIMERS[GESTURE_PROFILE_COUNT][GESTURE_STATE_COUNT] = {
+    // IDLE, PRESSED, RELEASED, HELD, REPEATING
+    {0, EVENT_TIMEOUT_US, 0, 0, 0},
+    {0, EVENT_TIMEOUT_US, MULTI_CLICK_THRESHOLD_US, 0, 0},
+    {0, PRESS_HOLD_THRESHOLD_US, 0, 0, 0},
+    {0, PRESS_HOLD_THRESHOLD_US, MULTI_CLICK_THRESHOLD_US, 0, 0},
+    {0, SCHEDULED, 0, 0, SCHEDULED},
+};
+
+uint32_t gestureTimer(const GestureSlot &slot, uint8_t profile)
+{
+    uint32_t timer = GESTURE_TIMERS[profile][slot.state];
+
+    if (timer == SCHEDULED)
+    {
+        // pressed waits out schedule[0], each repeat moves one step along
+        uint8_t step = slot.clicks < GESTURE_REPEAT_STEPS ? slot.clicks : GESTURE_REPEAT_STEPS - 1;
+        return slot.repeatSchedule[step];
+    }
+
+    if (slot.state == GESTURE_RELEASED && slot.multiClickWindow_us)
+    {
+        return slot.multiClickWindow_us;
+    }
+
+    return timer;
+}
+
+bool gestureTimerDue(const GestureSlot &slot, uint8_t profile, uint32_t now)
+{
+    // signed so an edge drained after now was sampled reads as not elapsed
+    uint32_t timer = gestureTimer(slot, profile);
+    return timer != 0 && (int32_t)(now - slot.since) > (int32_t)timer;
+}
+
+GestureAction gestureStep(GestureSlot &slot, uint8_t profile, GestureInput input, uint32_t now)
+{
+    // signed so an edge drained after now was sampled reads as not elapsed
+    int32_t elapsed = (int32_t)(now - slot.since);
+    uint32_t timer = 0;
+
+    if (input == GESTURE_INPUT_TIMER)
+    {
+        timer = gestureTimer(slot, profile);
+        if (timer == 0 || elapsed <= (int32_t)timer)
+        {
+            return GESTURE_NONE;
+        }
+    }
+
+    const GestureRule &rule = GESTURE_RULES[profile][slot.state][input];
+    uint32_t previous = slot.since;
+    slot.state = rule.next;
+    slot.since = now;
+
+    switch (rule.action)
+    {
+    case ACT_START:
+        slot.clicks = 0;
+        return GESTURE_NONE;
+    case ACT_COUNT:
+        slot.clicks++;
+        return GESTURE_NONE;
+    case ACT_CLICK:
+        slot.clicks++;
+        return GESTURE_CLICK;
+    case ACT_RESOLVE:
+        return slot.clicks > 1 ? GESTURE_MULTI_CLICK : GESTURE_CLICK;
+    case ACT_HOLD:
+        // a hold after an earlier click in the same gesture is ambiguous, drop it
+        return slot.clicks == 0 ? GESTURE_HOLD : GESTURE_NONE;
+    case ACT_REPEAT:
+        // keep to the schedule instead of drifting with loop latency, unless
+        // a whole interval was missed, repeats the loop was too busy for are dropped
+        if (elapsed < (int32_t)(2 * timer))
+        {
+            slot.since = previous + timer;
+        }
+        if (slot.clicks < UINT8_MAX)
+        {
+            slot.clicks++;
+        }
+        return GESTURE_REPEAT;
+    default:
+        return GESTURE_NONE;
+    }
+}
+
+void gestureCancel(GestureSlot &slot)
+{
+    // a held slot ignores everything but the next press
+    slot.state = GESTURE_HELD;
+}
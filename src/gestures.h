@@ -0,0 +1,83 @@
+#ifndef GESTURES_h
+#define GESTURES_h
+
+#include <stdint.h>
+
+enum GestureState : uint8_t
+{
+    GESTURE_IDLE,
+    GESTURE_PRESSED,
+    GESTURE_RELEASED, // released, waiting to see if another click follows
+    GESTURE_HELD,
+    GESTURE_REPEATING,
+    GESTURE_STATE_COUNT
+};
+
+enum GestureInput : uint8_t
+{
+    GESTURE_INPUT_PRESS,
+    GESTURE_INPUT_RELEASE,
+    GESTURE_INPUT_TIMER,
+    GESTURE_INPUT_COUNT
+};
+
+/*
+ * Gesture resolved by a state transition, to be dispatched to a handler
+ */
+enum GestureAction : uint8_t
+{
+    GESTURE_NONE,
+    GESTURE_CLICK,
+    GESTURE_MULTI_CLICK,
+    GESTURE_HOLD,
+    GESTURE_REPEAT
+};
+
+/*
+ * Handlers registered on a pin select which transition table is used.
+ * Multi-click and press and hold combine, repeat takes over the pin.
+ */
+const uint8_t GESTURE_PROFILE_MULTI_CLICK = 0x01;
+const uint8_t GESTURE_PROFILE_PRESS_HOLD = 0x02;
+const uint8_t GESTURE_PROFILE_REPEAT = 0x04;
+const uint8_t GESTURE_PROFILE_COUNT = 5;
+
+// entries in a repeat schedule
+const uint8_t GESTURE_REPEAT_STEPS = 16;
+
+/*
+ * Per-pin gesture state, small enough to be stored inline in a pin table
+ */
+struct GestureSlot
+{
+    uint32_t since;   // time of the last transition in microseconds
+    uint8_t state;    // GestureState
+    uint8_t clicks;   // completed clicks, or repeats, in the current gesture
+
+    // overrides the multi-click window when non-zero, in microseconds
+    uint32_t multiClickWindow_us;
+
+    // repeat profile only, GESTURE_REPEAT_STEPS timers in microseconds: the
+    // delay before the first repeat, then the interval before each following
+    // repeat with the last one reused once the schedule runs out
+    const uint32_t *repeatSchedule;
+};
+
+/*
+ * Feed an input into a pin's gesture state machine
+ * @param now Time of the input in microseconds, the edge time for presses and releases
+ * @return The gesture resolved by this input, if any
+ */
+GestureAction gestureStep(GestureSlot &slot, uint8_t profile, GestureInput input, uint32_t now);
+
+/*
+ * Check whether a timer input at now would move the slot on, without moving it
+ */
+bool gestureTimerDue(const GestureSlot &slot, uint8_t profile, uint32_t now);
+
+/*
+ * Abandon the gesture in progress, nothing resolves until the next press
+ */
+void gestureCancel(GestureSlot &slot);
+
+#endif
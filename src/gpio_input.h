@@ -0,0 +1,50 @@
+#ifndef GPIO_INPUT_h
+#define GPIO_INPUT_h
+
+#include <stdint.h>
+#include <soc/gpio_reg.h>
+
+/*
+ * Direct access to the GPIO registers for code that reads or drives many
+ * pins on every tick. Pins are passed as masks, bit n is GPIO n.
+ */
+
+/*
+ * Levels of GPIO 0-39 in one read of the input registers
+ */
+inline uint64_t readInputPins()
+{
+    return REG_READ(GPIO_IN_REG) | ((uint64_t)(REG_READ(GPIO_IN1_REG) & 0xFF) << 32);
+}
+
+/*
+ * Pull output pins low, open-drain pins sink their line
+ */
+inline void writeOutputPinsLow(uint64_t pins)
+{
+    if ((uint32_t)pins)
+    {
+        REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t)pins);
+    }
+    if (pins >> 32)
+    {
+        REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t)(pins >> 32));
+    }
+}
+
+/*
+ * Drive output pins high, open-drain pins let go of their line
+ */
+inline void writeOutputPinsHigh(uint64_t pins)
+{
+    if ((uint32_t)pins)
+    {
+        REG_WRITE(GPIO_OUT_W1TS_REG, (uint32_t)pins);
+    }
+    if (pins >> 32)
+    {
+        REG_WRITE(GPIO_OUT1_W1TS_REG, (uint32_t)(pins >> 32));
+    }
+}
+
+#endif
@@ -0,0 +1,106 @@
+#include <Arduino.h>
+#include "gpio_input.h"
+#include "key_matrix.h"
+
+// time for a driven row to settle before its columns are read
+const unsigned long KEY_MATRIX_SETTLE_US = 5;
+
+void KeyMatrix::begin(const uint8_t *rowPins, uint8_t rows, const uint8_t *colPins, uint8_t cols, bool diodes)
+{
+    this->diodes = diodes;
+
+    for (uint8_t r = 0; r < rows; r++)
+    {
+        // set up once, a released open-drain row floats so it can't pull
+        // down a column, and scans only touch the output registers
+        this->rowBits[r] = (uint64_t)1 << rowPins[r];
+        digitalWrite(rowPins[r], HIGH);
+        pinMode(rowPins[r], OUTPUT_OPEN_DRAIN);
+    }
+
+    for (uint8_t c = 0; c < cols; c++)
+    {
+        this->colPins[c] = colPins[c];
+        pinMode(colPins[c], INPUT_PULLUP);
+    }
+
+    // set last, a running scanner only looks at the matrix once rows is set
+    this->cols = cols;
+    this->rows = rows;
+}
+
+uint8_t findGhostRows(const uint8_t *rowCols, uint8_t rows)
+{
+    uint8_t ghosts = 0;
+
+    for (uint8_t a = 0; a < rows; a++)
+    {
+        uint8_t cols = rowCols[a];
+
+        // a single pressed column can't be part of a rectangle
+        if ((cols & (cols - 1)) == 0)
+        {
+            continue;
+        }
+
+        for (uint8_t b = a + 1; b < rows; b++)
+        {
+            uint8_t shared = cols & rowCols[b];
+            if (shared & (shared - 1))
+            {
+                ghosts |= (1 << a) | (1 << b);
+            }
+        }
+    }
+
+    return ghosts;
+}
+
+uint32_t KeyMatrix::scan()
+{
+    uint32_t start = micros();
+    uint8_t rowCols[KEY_MATRIX_MAX_ROWS];
+
+    for (uint8_t r = 0; r < rows; r++)
+    {
+        writeOutputPinsLow(rowBits[r]);
+        delayMicroseconds(KEY_MATRIX_SETTLE_US);
+
+        // read every column in one go, a pressed key pulls its column low
+        uint64_t levels = readInputPins();
+
+        writeOutputPinsHigh(rowBits[r]);
+
+        uint8_t pressed = 0;
+        for (uint8_t c = 0; c < cols; c++)
+        {
+            if (!((levels >> colPins[c]) & 1))
+            {
+                pressed |= 1 << c;
+            }
+        }
+        rowCols[r] = pressed;
+    }
+
+    uint8_t ghosts = diodes ? 0 : findGhostRows(rowCols, rows);
+    uint32_t rowMask = ((uint32_t)1 << cols) - 1;
+
+    for (uint8_t r = 0; r < rows; r++)
+    {
+        if (ghosts & (1 << r))
+        {
+            continue;
+        }
+
+        uint8_t shift = r * cols;
+        keys = (keys & ~(rowMask << shift)) | ((uint32_t)rowCols[r] << shift);
+    }
+
+    uint32_t elapsed = micros() - start;
+    if (elapsed > maxScanTime_us)
+    {
+        maxScanTime_us = elapsed;
+    }
+
+    return keys;
+}
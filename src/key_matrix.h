@@ -0,0 +1,55 @@
+#ifndef KEY_MATRIX_h
+#define KEY_MATRIX_h
+
+#include <stdint.h>
+
+const uint8_t KEY_MATRIX_MAX_ROWS = 8;
+const uint8_t KEY_MATRIX_MAX_COLS = 8;
+
+/*
+ * Row/column key matrix driver. Rows are open-drain outputs driven low one
+ * at a time through the GPIO set/clear registers, and the columns, pulled
+ * up, are read back from the input registers in a single read per row.
+ * Key n is bit n of a scan, numbered row * cols + col.
+ */
+class KeyMatrix
+{
+public:
+    uint8_t rows = 0;
+    uint8_t cols = 0;
+
+    // longest full scan seen so far
+    unsigned long maxScanTime_us = 0;
+
+    /*
+     * Configure the row and column pins
+     * @param diodes True if every key has a diode, which rules out ghosting
+     *               so rectangles of pressed keys are trusted
+     */
+    void begin(const uint8_t *rowPins, uint8_t rows, const uint8_t *colPins, uint8_t cols, bool diodes);
+
+    /*
+     * Scan the whole matrix
+     * @return The pressed keys, rows that can't be told apart from a ghost
+     *         keep the keys they had on the previous scan
+     */
+    uint32_t scan();
+
+private:
+    // one bit per row pin, for the output registers
+    uint64_t rowBits[KEY_MATRIX_MAX_ROWS];
+    uint8_t colPins[KEY_MATRIX_MAX_COLS];
+    bool diodes = false;
+    uint32_t keys = 0;
+};
+
+/*
+ * Find rows whose pressed columns can't be trusted. Without diodes, three
+ * keys on the corners of a rectangle make the fourth corner read as pressed,
+ * so any two rows sharing two or more pressed columns are ambiguous.
+ * @param rowCols The pressed columns of each row
+ * @return A mask of the ambiguous rows
+ */
+uint8_t findGhostRows(const uint8_t *rowCols, uint8_t rows);
+
+#endif
@@ -1,6 +1,8 @@
 #include <Arduino.h>
 #include "buttons.h"
 #include "battery.h"
+#include "battery_publisher.h"
+#include "flight_recorder.h"
 
 #include <BleKeyboard.h>
 
@@ -27,9 +29,52 @@ uint8_t VOL_UP = 18;
 uint8_t VOL_DOWN = 19;
 uint8_t VBAT_SENSE = 35;
 
+// hold play/pause and vol- together to go to sleep
+uint8_t SLEEP_COMBO[] = {PLAY_PAUSE, VOL_DOWN};
+const unsigned long SLEEP_COMBO_HOLD_MS = 1000;
+
+// bounds for the play/pause multi-click window learned from the user's clicks
+const unsigned long MULTI_CLICK_MIN_WINDOW_MS = 150;
+const unsigned long MULTI_CLICK_MAX_WINDOW_MS = 300;
+
+// holding a volume button repeats it, speeding up from 150ms to 40ms between
+// steps. Steps queued faster than the link drains them are merged into one
+// relative volume report.
+const unsigned long VOLUME_REPEAT_DELAY_MS = 400;
+const RepeatCurve VOLUME_REPEAT_CURVE = {150, 40, 20};
+
+// the battery is sampled in the background, a median of 5 samples is
+// averaged over roughly 16 samples. The level is only needed once per
+// publisher interval, so the sampler is slowed to take that many samples
+// per interval instead of one every 100ms.
+const unsigned long BATTERY_SAMPLES_PER_UPDATE = 16;
+
+// minutes of battery left as a little endian int32, -1 while unknown
+const char *BATTERY_RUNTIME_UUID = "6e0b4a3e-5f37-4c1e-9d8a-2f7c1b0e9a51";
+
+// ask for a 15ms interval while buttons are in use and drop to 120-150ms with
+// 10 skipped events after a minute idle, both within Apple's accessory limits.
+// Units are 1.25ms for intervals and 10ms for the supervision timeout.
+const ConnParams ACTIVE_CONN_PARAMS = {12, 12, 0, 300};
+const ConnParams IDLE_CONN_PARAMS = {96, 120, 10, 600};
+const unsigned long CONN_IDLE_AFTER_MS = 60 * 1000;
+
+// the power LED blinks on and off while advertising, half its full brightness on average
+const uint8_t ADVERTISING_LED_DUTY = 128;
+
 unsigned long lastEvent;
 boolean isConnected = false;
 unsigned long lastBatteryLevelUpdate = 0;
+BatteryPublisher batteryPublisher;
+
+// longest single pass through loop(), the time button processing can be held up
+uint32_t maxLoop_us = 0;
+
+unsigned long lastButtonEdgeCount = 0;
+
+// serial commands are collected a character at a time so the loop never blocks on them
+char serialCommand[32];
+uint8_t serialCommandLength = 0;
 
 RTC_DATA_ATTR int clickCount = 0;
 RTC_DATA_ATTR int dblClickCount = 0;
@@ -39,7 +84,9 @@ RTC_DATA_ATTR int pressHoldCount = 0;
 const unsigned long AUTO_SLEEP_INACTIVITY_TIMEOUT = 8 * 60 * 60 * 1000;
 const bool ENABLE_DEEP_SLEEP = true;
 
-// update battery level every 5 mins
+// update battery level every 5 mins until the publisher has seen the discharge rate,
+// also the fixed schedule the saved reads and notifications are counted against:
+// a notification and a blocking burst of reads every time
 const unsigned long BATTERY_UPDATE_INTERVAL_MS = 5 * 60 * 1000;
 
 void ledAnimateFadeOff()
@@ -73,6 +120,8 @@ void goToSleep()
 
   if (ENABLE_DEEP_SLEEP)
   {
+    // the time asleep is charged at the sleep current on the next wake
+    setBatteryLoad(BATTERY_LOAD_SLEEP, 0);
     esp_deep_sleep_start();
   }
   else
@@ -110,15 +159,39 @@ esp_sleep_wakeup_cause_t getWakeupReason()
   return wakeup_reason;
 }
 
-void onPlayPauseClick()
+// send a media key and keep the outcome in the flight recorder
+void sendMediaKey(uint8_t pin, const MediaKeyReport key)
 {
-  DEBUG2("Play/Pause clicked %d times!\n", ++clickCount);
+  size_t sent = 0;
 
   if (bleKeyboard.isConnected())
   {
-    bleKeyboard.write(KEY_MEDIA_PLAY_PAUSE);
+    sent = bleKeyboard.write(key);
   }
 
+  flightRecord(FLIGHT_SEND, pin, sent > 0, __builtin_ctz(key[0] | key[1] << 8), micros());
+}
+
+// step the volume, steps queued while the link is busy go out together in one report.
+// Without the volume report a step goes out as the volume media key instead.
+void sendVolumeStep(uint8_t pin, int8_t steps)
+{
+  bool sent = false;
+
+  if (bleKeyboard.isConnected())
+  {
+    sent = bleKeyboard.stepVolume(steps) || bleKeyboard.write(steps > 0 ? KEY_MEDIA_VOLUME_UP : KEY_MEDIA_VOLUME_DOWN) > 0;
+  }
+
+  flightRecord(FLIGHT_SEND, pin, sent, (uint8_t)steps, micros());
+}
+
+void onPlayPauseClick()
+{
+  DEBUG2("Play/Pause clicked %d times!\n", ++clickCount);
+
+  sendMediaKey(PLAY_PAUSE, KEY_MEDIA_PLAY_PAUSE);
+
   lastEvent = millis();
 }
 
@@ -128,19 +201,13 @@ void onPlayPauseOnMultiClick(uint8_t clickCount)
   {
     DEBUG2("Play/Pause double-clicked %d times!\n", ++dblClickCount);
 
-    if (bleKeyboard.isConnected())
-    {
-      bleKeyboard.write(KEY_MEDIA_NEXT_TRACK);
-    }
+    sendMediaKey(PLAY_PAUSE, KEY_MEDIA_NEXT_TRACK);
   }
   else if (clickCount == 3)
   {
     DEBUG2("Play/Pause triple-clicked %d times!\n", ++dblClickCount);
 
-    if (bleKeyboard.isConnected())
-    {
-      bleKeyboard.write(KEY_MEDIA_PREVIOUS_TRACK);
-    }
+    sendMediaKey(PLAY_PAUSE, KEY_MEDIA_PREVIOUS_TRACK);
   }
   else
   {
@@ -153,21 +220,13 @@ void onPlayPauseOnMultiClick(uint8_t clickCount)
 void onPlayPausePressHold()
 {
   DEBUG2("Play/Pause press and hold %d times!\n", ++pressHoldCount);
-
-  if (digitalRead(VOL_DOWN) == LOW)
-  {
-    goToSleep();
-  }
 }
 
 void onVolUpClick()
 {
   DEBUG("Vol +\n");
 
-  if (bleKeyboard.isConnected())
-  {
-    bleKeyboard.write(KEY_MEDIA_VOLUME_UP);
-  }
+  sendVolumeStep(VOL_UP, 1);
 
   lastEvent = millis();
 }
@@ -176,10 +235,7 @@ void onVolDownClick()
 {
   DEBUG("Vol -\n");
 
-  if (bleKeyboard.isConnected())
-  {
-    bleKeyboard.write(KEY_MEDIA_VOLUME_DOWN);
-  }
+  sendVolumeStep(VOL_DOWN, -1);
 
   lastEvent = millis();
 }
@@ -194,7 +250,10 @@ void setup()
   pinMode(VOL_DOWN, INPUT_PULLUP);
 
   // check the wakeup reason for ESP32
-  if (getWakeupReason() == 2)
+  esp_sleep_wakeup_cause_t wakeupReason = getWakeupReason();
+  flightRecorderBegin(wakeupReason);
+
+  if (wakeupReason == 2)
   {
     // wakeup from deep sleep was caused by RTC_CNTL play/pause button
     // require a presshold for 3 seconds to ensure wakeup is not accidental
@@ -227,14 +286,24 @@ void setup()
     }
   }
 
+  batteryPublisherBegin(batteryPublisher, BATTERY_UPDATE_INTERVAL_MS, millis());
+  useBatterySampler(VBAT_SENSE, batteryPublisher.interval_ms / BATTERY_SAMPLES_PER_UPDATE);
+
   DEBUG("Starting BLE!\n");
+  bleKeyboard.addBatteryCharacteristic(BATTERY_RUNTIME_UUID);
+  bleKeyboard.setConnectionPolicy(ACTIVE_CONN_PARAMS, IDLE_CONN_PARAMS, CONN_IDLE_AFTER_MS);
   bleKeyboard.begin();
+  setBatteryLoad(BATTERY_LOAD_ADVERTISING, ADVERTISING_LED_DUTY);
 
   onClick(PLAY_PAUSE, onPlayPauseClick);
   onMultiClick(PLAY_PAUSE, onPlayPauseOnMultiClick);
+  enableAdaptiveMultiClick(PLAY_PAUSE, MULTI_CLICK_MIN_WINDOW_MS, MULTI_CLICK_MAX_WINDOW_MS);
   onPressHold(PLAY_PAUSE, onPlayPausePressHold);
   onClick(VOL_UP, onVolUpClick);
+  onRepeat(VOL_UP, VOLUME_REPEAT_DELAY_MS, VOLUME_REPEAT_CURVE, onVolUpClick);
   onClick(VOL_DOWN, onVolDownClick);
+  onRepeat(VOL_DOWN, VOLUME_REPEAT_DELAY_MS, VOLUME_REPEAT_CURVE, onVolDownClick);
+  onComboHold(SLEEP_COMBO, sizeof(SLEEP_COMBO), SLEEP_COMBO_HOLD_MS, goToSleep);
 
   // allow button press to wake up the controller
   esp_sleep_enable_ext0_wakeup(GPIO_NUM_15, 0);
@@ -249,6 +318,7 @@ void discoverableLoop(unsigned long now)
   if (isConnected)
   {
     isConnected = false;
+    setBatteryLoad(BATTERY_LOAD_ADVERTISING, ADVERTISING_LED_DUTY);
   }
 
   if (now % 200 < 100)
@@ -261,19 +331,52 @@ void discoverableLoop(unsigned long now)
   }
 }
 
+// publish the charge level and the predicted runtime next to it, only notifies once the level moved
+void publishBatteryLevel(bool force)
+{
+  uint8_t level = getBatteryChargeLevel(VBAT_SENSE);
+  int32_t minutesLeft = getBatteryMinutesLeft();
+
+  if (batteryPublisherSample(batteryPublisher, level, minutesLeft, force))
+  {
+    bleKeyboard.setBatteryLevel(level);
+    bleKeyboard.setBatteryCharacteristic((const uint8_t *)&minutesLeft, sizeof(minutesLeft));
+  }
+
+  setBatterySamplerPeriod(batteryPublisher.interval_ms / BATTERY_SAMPLES_PER_UPDATE);
+}
+
 void updateBatteryLevelLoop(unsigned long now)
 {
-  if (now - lastBatteryLevelUpdate > BATTERY_UPDATE_INTERVAL_MS)
+  if (now - lastBatteryLevelUpdate > batteryPublisher.interval_ms)
   {
-    bleKeyboard.setBatteryLevel(getBatteryChargeLevel(VBAT_SENSE));
+    publishBatteryLevel(false);
     lastBatteryLevelUpdate = now;
   }
 }
 
+// ADC reads, level estimates and notifications per hour avoided compared to the fixed
+// BATTERY_UPDATE_INTERVAL_MS schedule
+void printBatteryPublisher(Print &out)
+{
+  unsigned long elapsed = millis() - batteryPublisher.since_ms;
+  float hours = elapsed / 3.6e6f;
+  float scheduled = (float)elapsed / BATTERY_UPDATE_INTERVAL_MS;
+  uint32_t reads = batteryAdcReads();
+
+  out.printf("{\"interval_ms\":%u,\"adc_reads\":%u,\"estimates\":%u,\"notifies\":%u,"
+             "\"adc_reads_saved_per_hour\":%.1f,\"estimates_saved_per_hour\":%.1f,\"notifies_saved_per_hour\":%.1f}\n",
+             batteryPublisher.interval_ms, reads, batteryPublisher.samples, batteryPublisher.notifies,
+             hours > 0 ? (scheduled * BATTERY_BURST_READS - reads) / hours : 0,
+             hours > 0 ? (scheduled - batteryPublisher.samples) / hours : 0,
+             hours > 0 ? (scheduled - batteryPublisher.notifies) / hours : 0);
+}
+
 void onConnect()
 {
   analogWrite(PWR_LED, 255);
-  bleKeyboard.setBatteryLevel(getBatteryChargeLevel(VBAT_SENSE));
+  setBatteryLoad(BATTERY_LOAD_CONNECTED, 255);
+  publishBatteryLevel(true);
 }
 
 void connectedLoop(unsigned long now)
@@ -287,8 +390,87 @@ void connectedLoop(unsigned long now)
   updateBatteryLevelLoop(now);
 }
 
+void printReportStats(Print &out)
+{
+  ReportStats reports = bleKeyboard.getReportStats();
+  out.printf("{\"max_loop_us\":%u,\"reports_sent\":%u,\"report_retries\":%u,\"reports_dropped\":%u,\"reports_pending\":%u,",
+             maxLoop_us, reports.sent, reports.retries, reports.dropped, bleKeyboard.pendingReports());
+  out.printf("\"volume_steps\":%u,\"volume_reports\":%u", reports.volumeSteps, reports.volumeReports);
+
+  ConnParams granted;
+  if (bleKeyboard.getConnParams(&granted))
+  {
+    out.printf(",\"conn_interval\":%u,\"conn_latency\":%u,\"conn_timeout\":%u", granted.minInterval, granted.latency, granted.timeout);
+  }
+  out.print("}\n");
+}
+
+void runSerialCommand(const char *command)
+{
+  if (strcmp(command, "stats") == 0)
+  {
+    printButtonStats(Serial);
+    printReportStats(Serial);
+  }
+  else if (strcmp(command, "dump") == 0)
+  {
+    flightRecorderDump(Serial);
+  }
+  else if (strcmp(command, "battery") == 0)
+  {
+    printBatteryHistory(Serial);
+    printBatteryPublisher(Serial);
+  }
+  else if (strcmp(command, "cal") == 0)
+  {
+    printBatteryCalibration(Serial);
+  }
+  else if (strcmp(command, "cal reset") == 0)
+  {
+    resetBatteryCalibration();
+    printBatteryCalibration(Serial);
+  }
+  else if (strncmp(command, "cal ", 4) == 0)
+  {
+    // "cal <mV>" with the battery voltage read off a multimeter
+    int actual_mV = atoi(command + 4);
+    if (actual_mV > 0)
+    {
+      calibrateBattery(VBAT_SENSE, actual_mV);
+    }
+    printBatteryCalibration(Serial);
+  }
+  else
+  {
+    DEBUG2("Unknown command: %s\n", command);
+  }
+}
+
+void serialCommandLoop()
+{
+  while (Serial.available())
+  {
+    char c = Serial.read();
+
+    if (c == '\n' || c == '\r')
+    {
+      if (serialCommandLength > 0)
+      {
+        serialCommand[serialCommandLength] = '\0';
+        runSerialCommand(serialCommand);
+        serialCommandLength = 0;
+      }
+    }
+    else if (serialCommandLength < sizeof(serialCommand) - 1)
+    {
+      serialCommand[serialCommandLength++] = c;
+    }
+  }
+}
+
 void loop()
 {
+  uint32_t start_us = micros();
   unsigned long now = millis();
   if (now - lastEvent > AUTO_SLEEP_INACTIVITY_TIMEOUT)
   {
@@ -298,4 +480,15 @@ void loop()
   bleKeyboard.isConnected() ? connectedLoop(now) : discoverableLoop(now);
 
   buttonEventLoop();
+
+  // get the link onto the short interval while the button is still down
+  if (buttonEdgeCount() != lastButtonEdgeCount)
+  {
+    lastButtonEdgeCount = buttonEdgeCount();
+    bleKeyboard.markActive();
+  }
+
+  serialCommandLoop();
+
+  maxLoop_us = max(maxLoop_us, (uint32_t)(micros() - start_us));
 }
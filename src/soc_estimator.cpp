@@ -0,0 +1,46 @@
+#include "soc_estimator.h"
+
+void socEstimatorBegin(SocEstimator &e)
+{
+    e.percent = 0;
+    e.variance = -1;
+}
+
+void socEstimatorPredict(SocEstimator &e, float drawn_mAh, float capacity_mAh, float uncertainty)
+{
+    if (e.variance < 0)
+    {
+        return;
+    }
+
+    e.percent -= drawn_mAh * 100 / capacity_mAh;
+    e.variance += uncertainty;
+}
+
+void socEstimatorUpdate(SocEstimator &e, float measured, float noise)
+{
+    if (e.variance < 0)
+    {
+        // nothing to fuse with yet, start from the measurement
+        e.percent = measured;
+        e.variance = noise;
+        return;
+    }
+
+    float gain = e.variance / (e.variance + noise);
+    e.percent += gain * (measured - e.percent);
+    e.variance *= 1 - gain;
+}
+
+uint8_t socEstimatorPercent(const SocEstimator &e)
+{
+    if (e.percent <= 0)
+    {
+        return 0;
+    }
+    if (e.percent >= 100)
+    {
+        return 100;
+    }
+    return (uint8_t)(e.percent + 0.5f);
+}
@@ -0,0 +1,41 @@
+#ifndef SOC_ESTIMATOR_h
+#define SOC_ESTIMATOR_h
+
+#include <stdint.h>
+
+/*
+ * One state Kalman filter for the battery state of charge in percent. The
+ * prediction step counts the charge drawn by the known loads, the update step
+ * pulls the estimate towards the percent looked up from the open circuit
+ * voltage, trusting it less the more load was on the battery.
+ */
+struct SocEstimator
+{
+    float percent;
+
+    // variance of percent, negative until the first measurement
+    float variance;
+};
+
+void socEstimatorBegin(SocEstimator &e);
+
+/*
+ * Move the estimate by the charge drawn since the last step
+ * @param drawn_mAh Charge drawn from the battery
+ * @param capacity_mAh Capacity of the full battery
+ * @param uncertainty Variance added to the estimate for this step
+ */
+void socEstimatorPredict(SocEstimator &e, float drawn_mAh, float capacity_mAh, float uncertainty);
+
+/*
+ * Fold in a percent looked up from the voltage
+ * @param noise Variance of the measurement
+ */
+void socEstimatorUpdate(SocEstimator &e, float measured, float noise);
+
+/*
+ * @return The estimate rounded to 0-100
+ */
+uint8_t socEstimatorPercent(const SocEstimator &e);
+
+#endif
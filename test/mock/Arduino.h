@@ -0,0 +1,77 @@
+#ifndef MOCK_ARDUINO_h
+#define MOCK_ARDUINO_h
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "HardwareSerial.h"
+#include "Print.h"
+
+/*
+ * Arduino core for the native environment, backed by the simulated HAL in
+ * mock_hal.cpp. Tests drive it through mock_hal.h.
+ */
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define PULLUP 0x04
+#define INPUT_PULLUP 0x05
+#define OUTPUT_OPEN_DRAIN 0x12
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+
+#define digitalPinToInterrupt(pin) (pin)
+
+// nothing runs concurrently on the host, interrupt handlers are called from mockSetPin()
+#define interrupts()
+#define noInterrupts()
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+using std::max;
+using std::min;
+
+typedef bool boolean;
+
+// the values wrap at 32 bits like the target's, but unsigned long is 64 bits
+// on the host: keep time differences in uint32_t to get the target's math
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+uint32_t getCpuFrequencyMhz();
+
+class EspClass
+{
+public:
+    uint32_t getCycleCount();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+};
+
+extern EspClass ESP;
+
+#endif
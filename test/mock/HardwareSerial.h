@@ -0,0 +1,22 @@
+#ifndef MOCK_HARDWARE_SERIAL_h
+#define MOCK_HARDWARE_SERIAL_h
+
+#include "Print.h"
+
+/*
+ * UART 0, tests type into it with mockSerialInput() and read what was
+ * printed with mockSerialOutput()
+ */
+class HardwareSerial : public Print
+{
+public:
+    void begin(unsigned long) {}
+    int available();
+    int read();
+    size_t write(uint8_t c) override;
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
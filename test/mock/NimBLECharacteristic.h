@@ -0,0 +1,6 @@
+#ifndef MOCK_NIMBLE_CHARACTERISTIC_h
+#define MOCK_NIMBLE_CHARACTERISTIC_h
+
+#include "NimBLEDevice.h"
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef MOCK_NIMBLE_DEVICE_h
+#define MOCK_NIMBLE_DEVICE_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+// the library's headers bring in the Arduino core and esp_timer
+#include "Arduino.h"
+#include "esp_timer.h"
+
+/*
+ * The part of NimBLE-Arduino BleKeyboard uses, backed by a simulated link in
+ * mock_ble.cpp: one central connects with mockBleConnect(), notifications
+ * take stack buffers that the link frees a few per connection event, and a
+ * notification with no buffer left fails with BLE_HS_ENOMEM.
+ */
+
+#define BLE_HS_ENOMEM 6
+
+namespace NIMBLE_PROPERTY
+{
+    enum
+    {
+        READ = 0x0002,
+        WRITE_NR = 0x0004,
+        WRITE = 0x0008,
+        NOTIFY = 0x0010,
+        INDICATE = 0x0020,
+    };
+}
+
+struct ble_gap_conn_desc
+{
+    uint16_t conn_handle;
+    uint16_t conn_itvl;
+    uint16_t conn_latency;
+    uint16_t supervision_timeout;
+};
+
+class NimBLEUUID
+{
+public:
+    NimBLEUUID(const char *uuid = "") : value(uuid) {}
+
+    std::string value;
+};
+
+class NimBLECharacteristic;
+
+class NimBLECharacteristicCallbacks
+{
+public:
+    typedef enum
+    {
+        SUCCESS_INDICATE,
+        SUCCESS_NOTIFY,
+        ERROR_INDICATE_DISABLED,
+        ERROR_NOTIFY_DISABLED,
+        ERROR_GATT,
+        ERROR_NO_CLIENT,
+        ERROR_INDICATE_TIMEOUT,
+        ERROR_INDICATE_FAILURE
+    } Status;
+
+    virtual ~NimBLECharacteristicCallbacks() {}
+    virtual void onWrite(NimBLECharacteristic *) {}
+    virtual void onStatus(NimBLECharacteristic *, Status, int) {}
+};
+
+class NimBLECharacteristic
+{
+public:
+    NimBLECharacteristic(const char *uuid, uint8_t reportId) : uuid(uuid), reportId(reportId) {}
+
+    void setCallbacks(NimBLECharacteristicCallbacks *callbacks) { this->callbacks = callbacks; }
+    void setValue(const uint8_t *data, size_t length) { value.assign((const char *)data, length); }
+    void setValue(const std::string &s) { value = s; }
+    std::string getValue() { return value; }
+    void notify();
+
+    std::string uuid;
+    uint8_t reportId;
+    std::string value;
+    NimBLECharacteristicCallbacks *callbacks = nullptr;
+};
+
+class NimBLEService
+{
+public:
+    explicit NimBLEService(const char *uuid) : uuid(uuid) {}
+
+    NimBLECharacteristic *createCharacteristic(const char *uuid, uint32_t properties);
+    NimBLEUUID getUUID() { return uuid; }
+
+    NimBLEUUID uuid;
+};
+
+class NimBLEAdvertising
+{
+public:
+    void setAppearance(uint16_t) {}
+    void addServiceUUID(const NimBLEUUID &) {}
+    void setScanResponse(bool) {}
+    bool start();
+};
+
+class NimBLEConnInfo
+{
+public:
+    uint16_t getConnInterval() { return interval; }
+    uint16_t getConnLatency() { return latency; }
+    uint16_t getConnTimeout() { return timeout; }
+
+    uint16_t interval;
+    uint16_t latency;
+    uint16_t timeout;
+};
+
+class NimBLEServer;
+
+class NimBLEServerCallbacks
+{
+public:
+    virtual ~NimBLEServerCallbacks() {}
+    virtual void onConnect(NimBLEServer *) {}
+    virtual void onConnect(NimBLEServer *, ble_gap_conn_desc *) {}
+    virtual void onDisconnect(NimBLEServer *) {}
+};
+
+class NimBLEServer
+{
+public:
+    void setCallbacks(NimBLEServerCallbacks *callbacks, bool = true) { this->callbacks = callbacks; }
+    NimBLEAdvertising *getAdvertising() { return &advertising; }
+    NimBLEConnInfo getPeerInfo(size_t index);
+    void updateConnParams(uint16_t connHandle, uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout);
+
+    NimBLEServerCallbacks *callbacks = nullptr;
+    NimBLEAdvertising advertising;
+};
+
+class NimBLEHIDDevice
+{
+public:
+    explicit NimBLEHIDDevice(NimBLEServer *server);
+
+    NimBLECharacteristic *inputReport(uint8_t reportId);
+    NimBLECharacteristic *outputReport(uint8_t reportId);
+    NimBLECharacteristic *manufacturer() { return &manufacturerName; }
+    void pnp(uint8_t, uint16_t, uint16_t, uint16_t) {}
+    void hidInfo(uint8_t, uint8_t) {}
+    void reportMap(uint8_t *map, uint16_t size);
+    void startServices() {}
+    NimBLEService *batteryService() { return &battery; }
+    NimBLEService *hidService() { return &hid; }
+    void setBatteryLevel(uint8_t level);
+
+    NimBLECharacteristic manufacturerName{"2a29", 0};
+    NimBLEService battery{"180f"};
+    NimBLEService hid{"1812"};
+};
+
+class NimBLEDevice
+{
+public:
+    static void init(const std::string &deviceName);
+    static NimBLEServer *createServer();
+    static void setSecurityAuth(bool, bool, bool) {}
+};
+
+#endif
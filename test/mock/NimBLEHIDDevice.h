@@ -0,0 +1,6 @@
+#ifndef MOCK_NIMBLE_HIDDEVICE_h
+#define MOCK_NIMBLE_HIDDEVICE_h
+
+#include "NimBLEDevice.h"
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef MOCK_NIMBLE_SERVER_h
+#define MOCK_NIMBLE_SERVER_h
+
+#include "NimBLEDevice.h"
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef MOCK_NIMBLE_UTILS_h
+#define MOCK_NIMBLE_UTILS_h
+
+#include "NimBLEDevice.h"
+
+#endif
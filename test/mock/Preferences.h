@@ -0,0 +1,31 @@
+#ifndef MOCK_PREFERENCES_h
+#define MOCK_PREFERENCES_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * NVS namespace kept in memory, every put counts as a flash write
+ */
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false, const char *partition = NULL);
+    void end();
+
+    bool remove(const char *key);
+
+    size_t putUShort(const char *key, uint16_t value);
+    size_t putUInt(const char *key, uint32_t value);
+    size_t putBytes(const char *key, const void *value, size_t length);
+
+    uint16_t getUShort(const char *key, uint16_t defaultValue = 0);
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+    size_t getBytes(const char *key, void *buffer, size_t length);
+
+private:
+    const char *name = NULL;
+    bool readOnly = false;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef MOCK_PRINT_h
+#define MOCK_PRINT_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The part of the Arduino Print class the sources use
+ */
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+
+    size_t print(const char *s);
+    size_t printf(const char *format, ...);
+
+    int getWriteError() { return writeError; }
+    void clearWriteError() { writeError = 0; }
+
+protected:
+    void setWriteError(int error = 1) { writeError = error; }
+
+private:
+    int writeError = 0;
+};
+
+#endif
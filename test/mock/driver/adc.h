@@ -0,0 +1,7 @@
+#ifndef MOCK_DRIVER_ADC_h
+#define MOCK_DRIVER_ADC_h
+
+// the ADC types live with esp_adc_cal on the host
+#include "../esp_adc_cal.h"
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef MOCK_ESP_ADC_CAL_h
+#define MOCK_ESP_ADC_CAL_h
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum
+{
+    ADC_UNIT_1 = 1,
+    ADC_UNIT_2 = 2,
+} adc_unit_t;
+
+typedef enum
+{
+    ADC_ATTEN_DB_0,
+    ADC_ATTEN_DB_2_5,
+    ADC_ATTEN_DB_6,
+    ADC_ATTEN_DB_11,
+} adc_atten_t;
+
+typedef enum
+{
+    ADC_WIDTH_BIT_9,
+    ADC_WIDTH_BIT_10,
+    ADC_WIDTH_BIT_11,
+    ADC_WIDTH_BIT_12,
+} adc_bits_width_t;
+
+typedef enum
+{
+    ESP_ADC_CAL_VAL_EFUSE_VREF,
+    ESP_ADC_CAL_VAL_EFUSE_TP,
+    ESP_ADC_CAL_VAL_DEFAULT_VREF,
+} esp_adc_cal_value_t;
+
+typedef struct
+{
+    adc_unit_t adc_num;
+    adc_atten_t atten;
+    adc_bits_width_t bit_width;
+    uint32_t coeff_a;
+    uint32_t coeff_b;
+    uint32_t vref;
+} esp_adc_cal_characteristics_t;
+
+// the eFuse values are whatever mockSetAdcEfuse() installed
+esp_err_t esp_adc_cal_check_efuse(esp_adc_cal_value_t value_type);
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t adc_num, adc_atten_t atten, adc_bits_width_t bit_width, uint32_t default_vref, esp_adc_cal_characteristics_t *chars);
+uint32_t esp_adc_cal_raw_to_voltage(uint32_t adc_reading, const esp_adc_cal_characteristics_t *chars);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef MOCK_ESP_ATTR_h
+#define MOCK_ESP_ATTR_h
+
+// placement attributes, every variable lives in ordinary memory on the host
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+
+#endif
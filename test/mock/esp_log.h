@@ -0,0 +1,13 @@
+#ifndef MOCK_ESP_LOG_h
+#define MOCK_ESP_LOG_h
+
+// logging is compiled out on the host, the arguments are still checked
+#define ESP_LOG_MOCK(tag, format, ...) do { if (0) printf(format, ##__VA_ARGS__); } while (0)
+#define ESP_LOGE(tag, format, ...) ESP_LOG_MOCK(tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_MOCK(tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_MOCK(tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_MOCK(tag, format, ##__VA_ARGS__)
+
+#include <stdio.h>
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef MOCK_ESP_SLEEP_h
+#define MOCK_ESP_SLEEP_h
+
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_SLEEP_WAKEUP_UNDEFINED,
+    ESP_SLEEP_WAKEUP_ALL,
+    ESP_SLEEP_WAKEUP_EXT0,
+    ESP_SLEEP_WAKEUP_EXT1,
+    ESP_SLEEP_WAKEUP_TIMER,
+    ESP_SLEEP_WAKEUP_TOUCHPAD,
+    ESP_SLEEP_WAKEUP_ULP,
+} esp_sleep_wakeup_cause_t;
+
+typedef enum
+{
+    GPIO_NUM_0 = 0,
+    GPIO_NUM_13 = 13,
+    GPIO_NUM_15 = 15,
+    GPIO_NUM_18 = 18,
+    GPIO_NUM_19 = 19,
+} gpio_num_t;
+
+// going to sleep returns on the host, mockSleeps() counts the times it was asked for
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t pin, int level);
+void esp_deep_sleep_start();
+esp_err_t esp_light_sleep_start();
+
+#endif
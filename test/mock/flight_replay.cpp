@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+#include "flight_replay.h"
+#include "mock_hal.h"
+
+int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool decodeFlightDump(const std::string &line, std::vector<FlightRecord> &records)
+{
+    size_t at = line.find("FLIGHT ");
+    if (at == std::string::npos)
+    {
+        return false;
+    }
+
+    char *end;
+    unsigned long count = strtoul(line.c_str() + at + 7, &end, 10);
+    if (*end != ' ')
+    {
+        return false;
+    }
+
+    const char *hex = end + 1;
+    records.clear();
+    for (unsigned long i = 0; i < count; i++)
+    {
+        uint8_t bytes[sizeof(FlightRecord)];
+        for (size_t b = 0; b < sizeof(FlightRecord); b++)
+        {
+            int high = hexDigit(*hex++);
+            int low = high < 0 ? -1 : hexDigit(*hex++);
+            if (low < 0)
+            {
+                return false;
+            }
+            bytes[b] = high << 4 | low;
+        }
+
+        FlightRecord r;
+        memcpy(&r, bytes, sizeof(r));
+        records.push_back(r);
+    }
+    return true;
+}
+
+void printFlightRecords(const std::vector<FlightRecord> &records, Print &out)
+{
+    static const char *const KINDS[] = {"boot", "edge", "gesture", "send"};
+
+    // entries before the first boot in the ring have nothing to refer to
+    int64_t time_us = 0;
+    for (const FlightRecord &r : records)
+    {
+        time_us = r.kind == FLIGHT_BOOT ? 0 : time_us + r.delta_us;
+        out.printf("%10lld %-7s pin=%u detail=%u extra=%u\n", (long long)time_us,
+                   r.kind <= FLIGHT_SEND ? KINDS[r.kind] : "?", r.pin, r.detail, r.extra);
+    }
+}
+
+// move the clock to an offset from the boot, unless the loop has already
+// busy waited past it
+void advanceTo(uint32_t boot_us, uint64_t offset_us)
+{
+    int32_t ahead_us = boot_us + (uint32_t)offset_us - (uint32_t)micros();
+    if (ahead_us > 0)
+    {
+        mockAdvance(ahead_us);
+    }
+}
+
+uint32_t replayFlightEdges(const std::vector<FlightRecord> &records, uint32_t boot_us, void (*loop)(), uint32_t loopPeriod_us,
+                           uint32_t settle_us)
+{
+    size_t first = 0;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        if (records[i].kind == FLIGHT_BOOT)
+        {
+            first = i + 1;
+        }
+    }
+
+    uint64_t offset_us = 0;
+    // the loop picks up from where the boot has got to
+    uint64_t elapsed_us = (uint32_t)(micros() - boot_us);
+    uint32_t edges = 0;
+
+    for (size_t i = first; i < records.size(); i++)
+    {
+        offset_us += records[i].delta_us;
+        if (records[i].kind != FLIGHT_EDGE)
+        {
+            continue;
+        }
+
+        // the loop runs on its period up to the edge, the edge fires in between
+        for (; elapsed_us + loopPeriod_us <= offset_us; elapsed_us += loopPeriod_us)
+        {
+            advanceTo(boot_us, elapsed_us + loopPeriod_us);
+            loop();
+        }
+        advanceTo(boot_us, offset_us);
+        mockSetPin(records[i].pin, records[i].detail);
+        edges++;
+    }
+
+    for (uint64_t end_us = offset_us + settle_us; elapsed_us < end_us; elapsed_us += loopPeriod_us)
+    {
+        advanceTo(boot_us, elapsed_us + loopPeriod_us);
+        loop();
+    }
+    return edges;
+}
@@ -0,0 +1,40 @@
+#ifndef FLIGHT_REPLAY_h
+#define FLIGHT_REPLAY_h
+
+#include <string>
+#include <vector>
+#include "flight_recorder.h"
+
+class Print;
+
+/*
+ * Host side of the flight recorder: turns the "FLIGHT <count> <hex>" line of
+ * a dump back into records, lists them and replays their edges as an input
+ * trace. A dump captured from a device replays with
+ * FLIGHT_DUMP="FLIGHT ..." on the environment of test_flight_recorder.
+ */
+
+/*
+ * Decode one dump line, leading text before "FLIGHT" such as a log prefix
+ * is skipped
+ * @return false if the line isn't a complete dump
+ */
+bool decodeFlightDump(const std::string &line, std::vector<FlightRecord> &records);
+
+/*
+ * Write one record per line with its time since the boot it belongs to
+ */
+void printFlightRecords(const std::vector<FlightRecord> &records, Print &out);
+
+/*
+ * Replay the edges of the last boot in the records on the simulated pins,
+ * at their recorded offsets from a new boot, running the loop every loop
+ * period until the last edge has settled for settle_us. An edge the clock
+ * is already past fires right away.
+ * @param boot_us micros() when the boot the edges are replayed into started
+ * @return The number of edges replayed
+ */
+uint32_t replayFlightEdges(const std::vector<FlightRecord> &records, uint32_t boot_us, void (*loop)(), uint32_t loopPeriod_us,
+                           uint32_t settle_us);
+
+#endif
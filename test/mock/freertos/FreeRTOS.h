@@ -0,0 +1,25 @@
+#ifndef MOCK_FREERTOS_h
+#define MOCK_FREERTOS_h
+
+#include <stdint.h>
+
+/*
+ * FreeRTOS on the simulated clock: a tick is a millisecond, tasks run one at
+ * a time in mock_rtos.cpp and only switch when they block
+ */
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+#endif
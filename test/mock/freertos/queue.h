@@ -0,0 +1,15 @@
+#ifndef MOCK_FREERTOS_QUEUE_h
+#define MOCK_FREERTOS_QUEUE_h
+
+#include "FreeRTOS.h"
+
+// a full or empty queue blocks a task until there is room or an item, or the wait is over
+typedef struct QueueDefinition *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+
+#endif
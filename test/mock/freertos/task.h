@@ -0,0 +1,15 @@
+#ifndef MOCK_FREERTOS_TASK_h
+#define MOCK_FREERTOS_TASK_h
+
+#include "FreeRTOS.h"
+
+// the code under test runs as the lowest priority task, any other task that
+// can run does so as soon as it is woken
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg, UBaseType_t priority, TaskHandle_t *handle);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+
+#endif
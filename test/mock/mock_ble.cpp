@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <NimBLEDevice.h>
+#include <esp_timer.h>
+#include "mock_hal.h"
+
+// a NimBLE build with the default number of buffers, and a central that
+// takes four notifications per connection event
+const uint8_t DEFAULT_LINK_BUFFERS = 12;
+const uint8_t DEFAULT_PACKETS_PER_EVENT = 4;
+
+NimBLEServer *bleServer;
+NimBLEHIDDevice *bleHid;
+bool bleConnected;
+uint16_t bleConnHandle;
+NimBLEConnInfo bleConn;
+
+uint8_t linkBuffers = DEFAULT_LINK_BUFFERS;
+uint8_t packetsPerEvent = DEFAULT_PACKETS_PER_EVENT;
+uint8_t buffersInUse;
+uint64_t nextConnEvent_us;
+uint32_t failingNotifies;
+
+std::vector<MockNotification> notifications;
+std::vector<MockConnParamsRequest> connParamsRequests;
+std::vector<uint8_t> reportMapBytes;
+uint8_t bleBatteryLevel;
+
+uint64_t connIntervalMicros()
+{
+    return bleConn.interval * 1250;
+}
+
+// free the buffers of every connection event since the last look
+void drainLink()
+{
+    uint64_t now = esp_timer_get_time();
+    if (nextConnEvent_us > now + connIntervalMicros())
+    {
+        // the clock went back
+        nextConnEvent_us = now;
+    }
+    if (now < nextConnEvent_us)
+    {
+        return;
+    }
+
+    uint64_t events = (now - nextConnEvent_us) / connIntervalMicros() + 1;
+    buffersInUse -= std::min<uint64_t>(buffersInUse, events * packetsPerEvent);
+    nextConnEvent_us += events * connIntervalMicros();
+}
+
+void mockBleReset()
+{
+    linkBuffers = DEFAULT_LINK_BUFFERS;
+    packetsPerEvent = DEFAULT_PACKETS_PER_EVENT;
+    buffersInUse = 0;
+    nextConnEvent_us = 0;
+    failingNotifies = 0;
+    notifications.clear();
+    connParamsRequests.clear();
+}
+
+void mockBleConnect(uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    bleConnected = true;
+    bleConnHandle++;
+    bleConn = {interval, latency, timeout};
+    buffersInUse = 0;
+    nextConnEvent_us = esp_timer_get_time() + connIntervalMicros();
+
+    if (bleServer != NULL && bleServer->callbacks != NULL)
+    {
+        ble_gap_conn_desc desc = {bleConnHandle, interval, latency, timeout};
+        bleServer->callbacks->onConnect(bleServer);
+        bleServer->callbacks->onConnect(bleServer, &desc);
+    }
+}
+
+void mockBleDisconnect()
+{
+    bleConnected = false;
+
+    if (bleServer != NULL && bleServer->callbacks != NULL)
+    {
+        bleServer->callbacks->onDisconnect(bleServer);
+    }
+}
+
+void mockBleSetLink(uint8_t buffers, uint8_t perEvent)
+{
+    linkBuffers = buffers;
+    packetsPerEvent = perEvent;
+}
+
+void mockBleFailNotifies(uint32_t count)
+{
+    failingNotifies = count;
+}
+
+const std::vector<MockNotification> &mockBleNotifications()
+{
+    return notifications;
+}
+
+void mockBleClearNotifications()
+{
+    notifications.clear();
+}
+
+const std::vector<MockConnParamsRequest> &mockBleConnParamsRequests()
+{
+    return connParamsRequests;
+}
+
+uint16_t mockBleConnInterval()
+{
+    return bleConn.interval;
+}
+
+uint8_t mockBleBatteryLevel()
+{
+    return bleBatteryLevel;
+}
+
+const std::vector<uint8_t> &mockBleReportMap()
+{
+    return reportMapBytes;
+}
+
+// ---------------------------------------------------------------- NimBLE
+
+void NimBLECharacteristic::notify()
+{
+    if (!bleConnected)
+    {
+        if (callbacks != nullptr)
+        {
+            callbacks->onStatus(this, NimBLECharacteristicCallbacks::ERROR_NO_CLIENT, 0);
+        }
+        return;
+    }
+
+    drainLink();
+    if (failingNotifies > 0 || buffersInUse >= linkBuffers)
+    {
+        failingNotifies -= failingNotifies > 0;
+        if (callbacks != nullptr)
+        {
+            callbacks->onStatus(this, NimBLECharacteristicCallbacks::ERROR_GATT, BLE_HS_ENOMEM);
+        }
+        return;
+    }
+
+    buffersInUse++;
+    notifications.push_back({(uint64_t)esp_timer_get_time(), reportId, uuid, std::vector<uint8_t>(value.begin(), value.end())});
+    if (callbacks != nullptr)
+    {
+        callbacks->onStatus(this, NimBLECharacteristicCallbacks::SUCCESS_NOTIFY, 0);
+    }
+}
+
+NimBLECharacteristic *NimBLEService::createCharacteristic(const char *uuid, uint32_t)
+{
+    return new NimBLECharacteristic(uuid, 0);
+}
+
+bool NimBLEAdvertising::start()
+{
+    return true;
+}
+
+NimBLEConnInfo NimBLEServer::getPeerInfo(size_t)
+{
+    return bleConn;
+}
+
+void NimBLEServer::updateConnParams(uint16_t connHandle, uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout)
+{
+    connParamsRequests.push_back({(uint64_t)esp_timer_get_time(), connHandle, minInterval, maxInterval, latency, timeout});
+
+    // the central grants the shortest interval asked for, from the next event on
+    drainLink();
+    bleConn = {minInterval, latency, timeout};
+}
+
+NimBLEHIDDevice::NimBLEHIDDevice(NimBLEServer *)
+{
+    bleHid = this;
+}
+
+NimBLECharacteristic *NimBLEHIDDevice::inputReport(uint8_t reportId)
+{
+    return new NimBLECharacteristic("2a4d", reportId);
+}
+
+NimBLECharacteristic *NimBLEHIDDevice::outputReport(uint8_t reportId)
+{
+    return new NimBLECharacteristic("2a4d", reportId);
+}
+
+void NimBLEHIDDevice::reportMap(uint8_t *map, uint16_t size)
+{
+    reportMapBytes.assign(map, map + size);
+}
+
+void NimBLEHIDDevice::setBatteryLevel(uint8_t level)
+{
+    bleBatteryLevel = level;
+}
+
+void NimBLEDevice::init(const std::string &)
+{
+}
+
+NimBLEServer *NimBLEDevice::createServer()
+{
+    if (bleServer == NULL)
+    {
+        bleServer = new NimBLEServer();
+    }
+    return bleServer;
+}
@@ -0,0 +1,596 @@
+#include <stdarg.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_adc_cal.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <soc/gpio_reg.h>
+#include "mock_hal.h"
+
+const uint8_t GPIO_COUNT = 40;
+
+// wall clock behind time() at power on
+const time_t MOCK_EPOCH_S = 1700000000;
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    uint64_t period_us;
+    uint64_t due_us;
+    bool active;
+};
+
+struct Interrupt
+{
+    void (*handler)(void *);
+    void *arg;
+    int mode;
+};
+
+uint64_t now_us;
+time_t bootWall_s;
+
+// levels driven from outside, every pin floats high until a test pulls it down
+uint64_t externalLevels;
+uint64_t outputEnabled;
+uint64_t outputLevels;
+uint64_t (*inputHook)(uint64_t levels, uint64_t drivenLow);
+Interrupt interrupts[GPIO_COUNT];
+
+std::vector<esp_timer *> timers;
+
+uint16_t (*waveforms[GPIO_COUNT])(uint32_t now_us);
+uint16_t analogValues[GPIO_COUNT];
+uint32_t analogReads;
+
+uint32_t (*efuseCurve)(uint32_t raw);
+
+std::map<std::string, std::vector<uint8_t>> nvs;
+uint32_t nvsWrites;
+
+std::string serialInput;
+std::string serialOutput;
+
+uint32_t sleeps;
+esp_sleep_wakeup_cause_t wakeupCause;
+
+EspClass ESP;
+HardwareSerial Serial;
+
+// the simulated RTOS and BLE link, in mock_rtos.cpp and mock_ble.cpp
+void mockRunTasks();
+uint64_t mockNextTaskWake();
+void mockResetTasks();
+void mockBleReset();
+
+void mockReset(uint64_t start_us)
+{
+    now_us = start_us;
+    bootWall_s = MOCK_EPOCH_S;
+
+    externalLevels = ~(uint64_t)0;
+    outputEnabled = 0;
+    outputLevels = 0;
+    inputHook = NULL;
+    memset(interrupts, 0, sizeof(interrupts));
+
+    // handles may still be held by the code under test, so the timers are only stopped
+    for (esp_timer *t : timers)
+    {
+        t->active = false;
+    }
+
+    memset(waveforms, 0, sizeof(waveforms));
+    memset(analogValues, 0, sizeof(analogValues));
+    analogReads = 0;
+
+    efuseCurve = NULL;
+
+    nvs.clear();
+    nvsWrites = 0;
+
+    serialInput.clear();
+    serialOutput.clear();
+
+    sleeps = 0;
+    wakeupCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+
+    mockResetTasks();
+    mockBleReset();
+}
+
+void mockAdvance(uint32_t us)
+{
+    uint64_t target = now_us + us;
+
+    for (;;)
+    {
+        // tasks woken by the last timer run before the next one fires
+        mockRunTasks();
+
+        esp_timer *next = NULL;
+        for (esp_timer *t : timers)
+        {
+            if (t->active && t->due_us <= target && (next == NULL || t->due_us < next->due_us))
+            {
+                next = t;
+            }
+        }
+
+        uint64_t wake_us = mockNextTaskWake();
+        if (wake_us <= target && (next == NULL || wake_us < next->due_us))
+        {
+            now_us = wake_us;
+            continue;
+        }
+
+        if (next == NULL)
+        {
+            break;
+        }
+
+        now_us = next->due_us;
+        if (next->period_us)
+        {
+            next->due_us += next->period_us;
+        }
+        else
+        {
+            next->active = false;
+        }
+        next->callback(next->arg);
+    }
+
+    now_us = target;
+    mockRunTasks();
+}
+
+void mockAdvanceMillis(uint32_t ms)
+{
+    mockAdvance(ms * 1000);
+}
+
+void mockDeepSleep(uint32_t seconds)
+{
+    bootWall_s += now_us / 1000000 + seconds;
+    now_us = 0;
+
+    for (esp_timer *t : timers)
+    {
+        t->active = false;
+    }
+    memset(interrupts, 0, sizeof(interrupts));
+    mockResetTasks();
+}
+
+uint64_t drivenLow()
+{
+    return outputEnabled & ~outputLevels;
+}
+
+// levels of GPIO 0-39 as the input registers see them
+uint64_t readLevels()
+{
+    // a pin driven low reads low, one driven high or let go reads what is outside
+    uint64_t levels = (externalLevels & ~drivenLow()) & (((uint64_t)1 << GPIO_COUNT) - 1);
+
+    return inputHook != NULL ? inputHook(levels, drivenLow()) : levels;
+}
+
+void mockSetPin(uint8_t pin, uint8_t level)
+{
+    int before = digitalRead(pin);
+
+    uint64_t bit = (uint64_t)1 << pin;
+    externalLevels = level ? externalLevels | bit : externalLevels & ~bit;
+
+    int after = digitalRead(pin);
+    Interrupt &i = interrupts[pin];
+    if (before == after || i.handler == NULL)
+    {
+        return;
+    }
+
+    if (i.mode == CHANGE || (i.mode == FALLING && after == LOW) || (i.mode == RISING && after == HIGH))
+    {
+        i.handler(i.arg);
+    }
+}
+
+void mockSetInputHook(uint64_t (*hook)(uint64_t levels, uint64_t drivenLow))
+{
+    inputHook = hook;
+}
+
+void mockSetAnalog(uint8_t pin, uint16_t (*waveform)(uint32_t now_us))
+{
+    waveforms[pin] = waveform;
+}
+
+void mockSetAnalogValue(uint8_t pin, uint16_t raw)
+{
+    waveforms[pin] = NULL;
+    analogValues[pin] = raw;
+}
+
+uint32_t mockAnalogReads()
+{
+    return analogReads;
+}
+
+void mockSetAdcEfuse(uint32_t (*rawToMillivolts)(uint32_t raw))
+{
+    efuseCurve = rawToMillivolts;
+}
+
+uint32_t mockNvsWrites()
+{
+    return nvsWrites;
+}
+
+void mockSerialInput(const char *text)
+{
+    serialInput += text;
+}
+
+std::string mockSerialOutput()
+{
+    std::string output;
+    output.swap(serialOutput);
+    return output;
+}
+
+uint32_t mockSleeps()
+{
+    return sleeps;
+}
+
+void mockSetWakeupCause(int cause)
+{
+    wakeupCause = (esp_sleep_wakeup_cause_t)cause;
+}
+
+// ---------------------------------------------------------------- Arduino
+
+// millis() counts the 64-bit esp_timer down, so it wraps 1000 times later than micros()
+unsigned long millis()
+{
+    return (uint32_t)(now_us / 1000);
+}
+
+unsigned long micros()
+{
+    return (uint32_t)now_us;
+}
+
+void delay(uint32_t ms)
+{
+    // a busy wait, nothing else gets to run
+    now_us += (uint64_t)ms * 1000;
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    now_us += us;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    uint64_t bit = (uint64_t)1 << pin;
+    // OUTPUT and OUTPUT_OPEN_DRAIN share the output bit, none of the input modes have it
+    outputEnabled = mode & 0x02 ? outputEnabled | bit : outputEnabled & ~bit;
+}
+
+void digitalWrite(uint8_t pin, uint8_t level)
+{
+    uint64_t bit = (uint64_t)1 << pin;
+    outputLevels = level ? outputLevels | bit : outputLevels & ~bit;
+}
+
+int digitalRead(uint8_t pin)
+{
+    return (readLevels() >> pin) & 1;
+}
+
+uint16_t analogRead(uint8_t pin)
+{
+    analogReads++;
+    return waveforms[pin] != NULL ? waveforms[pin](now_us) : analogValues[pin];
+}
+
+void analogWrite(uint8_t pin, int value)
+{
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode)
+{
+    interrupts[pin] = {handler, arg, mode};
+}
+
+void detachInterrupt(uint8_t pin)
+{
+    interrupts[pin] = {};
+}
+
+uint32_t getCpuFrequencyMhz()
+{
+    return 240;
+}
+
+uint32_t EspClass::getCycleCount()
+{
+    return now_us * getCpuFrequencyMhz();
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    return 200000;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+    return 200000;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--)
+    {
+        n += write(*buffer++);
+    }
+    return n;
+}
+
+size_t Print::print(const char *s)
+{
+    return write((const uint8_t *)s, strlen(s));
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    return length > 0 ? write((const uint8_t *)buffer, min((size_t)length, sizeof(buffer) - 1)) : 0;
+}
+
+// the wall clock keeps counting through mockDeepSleep() like the RTC timer does
+time_t time(time_t *t) noexcept
+{
+    time_t now = bootWall_s + now_us / 1000000;
+    if (t != NULL)
+    {
+        *t = now;
+    }
+    return now;
+}
+
+int HardwareSerial::available()
+{
+    return serialInput.size();
+}
+
+int HardwareSerial::read()
+{
+    if (serialInput.empty())
+    {
+        return -1;
+    }
+
+    int c = (uint8_t)serialInput[0];
+    serialInput.erase(0, 1);
+    return c;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    serialOutput += (char)c;
+    return 1;
+}
+
+// ---------------------------------------------------------------- esp_sleep
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause()
+{
+    return wakeupCause;
+}
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t pin, int level)
+{
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start()
+{
+    sleeps++;
+}
+
+esp_err_t esp_light_sleep_start()
+{
+    sleeps++;
+    return ESP_OK;
+}
+
+// ---------------------------------------------------------------- registers
+
+uint32_t mockRegRead(uint32_t reg)
+{
+    switch (reg)
+    {
+    case GPIO_IN_REG:
+        return readLevels();
+    case GPIO_IN1_REG:
+        return readLevels() >> 32;
+    default:
+        return 0;
+    }
+}
+
+void mockRegWrite(uint32_t reg, uint32_t value)
+{
+    switch (reg)
+    {
+    case GPIO_OUT_W1TS_REG:
+        outputLevels |= value;
+        break;
+    case GPIO_OUT_W1TC_REG:
+        outputLevels &= ~(uint64_t)value;
+        break;
+    case GPIO_OUT1_W1TS_REG:
+        outputLevels |= (uint64_t)value << 32;
+        break;
+    case GPIO_OUT1_W1TC_REG:
+        outputLevels &= ~((uint64_t)value << 32);
+        break;
+    }
+}
+
+// ---------------------------------------------------------------- esp_timer
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    esp_timer *t = new esp_timer{args->callback, args->arg, 0, 0, false};
+    timers.push_back(t);
+    *handle = t;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    timer->period_us = 0;
+    timer->due_us = now_us + timeout_us;
+    timer->active = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    timer->period_us = period_us;
+    timer->due_us = now_us + period_us;
+    timer->active = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    timer->active = false;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time()
+{
+    return now_us;
+}
+
+// ---------------------------------------------------------------- esp_adc_cal
+
+esp_err_t esp_adc_cal_check_efuse(esp_adc_cal_value_t value_type)
+{
+    return efuseCurve != NULL && value_type != ESP_ADC_CAL_VAL_DEFAULT_VREF ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t adc_num, adc_atten_t atten, adc_bits_width_t bit_width, uint32_t default_vref, esp_adc_cal_characteristics_t *chars)
+{
+    *chars = {adc_num, atten, bit_width, 0, 0, default_vref};
+    return efuseCurve != NULL ? ESP_ADC_CAL_VAL_EFUSE_TP : ESP_ADC_CAL_VAL_DEFAULT_VREF;
+}
+
+uint32_t esp_adc_cal_raw_to_voltage(uint32_t adc_reading, const esp_adc_cal_characteristics_t *chars)
+{
+    // the default reference on a chip without eFuse values, roughly the 11 dB range
+    return efuseCurve != NULL ? efuseCurve(adc_reading) : adc_reading * chars->vref * 32 / 10 / 4095;
+}
+
+// ---------------------------------------------------------------- Preferences
+
+std::string nvsKey(const char *name, const char *key)
+{
+    return std::string(name) + "/" + key;
+}
+
+bool Preferences::begin(const char *name, bool readOnly, const char *partition)
+{
+    this->name = name;
+    this->readOnly = readOnly;
+    return true;
+}
+
+void Preferences::end()
+{
+    name = NULL;
+}
+
+bool Preferences::remove(const char *key)
+{
+    if (name == NULL || readOnly)
+    {
+        return false;
+    }
+    nvsWrites++;
+    return nvs.erase(nvsKey(name, key)) > 0;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length)
+{
+    if (name == NULL || readOnly)
+    {
+        return 0;
+    }
+    nvsWrites++;
+    nvs[nvsKey(name, key)].assign((const uint8_t *)value, (const uint8_t *)value + length);
+    return length;
+}
+
+size_t Preferences::putUShort(const char *key, uint16_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t length)
+{
+    if (name == NULL)
+    {
+        return 0;
+    }
+
+    auto entry = nvs.find(nvsKey(name, key));
+    if (entry == nvs.end() || entry->second.size() > length)
+    {
+        return 0;
+    }
+
+    memcpy(buffer, entry->second.data(), entry->second.size());
+    return entry->second.size();
+}
+
+uint16_t Preferences::getUShort(const char *key, uint16_t defaultValue)
+{
+    uint16_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t defaultValue)
+{
+    uint32_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
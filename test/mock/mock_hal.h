@@ -0,0 +1,152 @@
+#ifndef MOCK_HAL_h
+#define MOCK_HAL_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Print.h"
+
+/*
+ * Control side of the simulated HAL behind the native environment. Time only
+ * moves when a test moves it: esp_timer callbacks fire from mockAdvance() at
+ * their due times, and a pin change fires the pin's interrupt right away.
+ */
+
+// the clock starts here so code that subtracts a period from micros() at boot doesn't go below 0
+const uint32_t MOCK_START_US = 1000000;
+
+// micros() wraps to 0 a second after a clock started here, 71 minutes after boot on the target
+const uint64_t MOCK_WRAP_START_US = 0x100000000ULL - 1000000;
+
+/*
+ * Put the clock, pins, timers, analog inputs, eFuse, NVS, serial port and
+ * the BLE link's recordings back to power on. Tasks and a BLE connection
+ * live on, the code under test holds their handles.
+ * @param start_us Where the clock starts, micros() and millis() are truncated to 32 bits like the target's
+ */
+void mockReset(uint64_t start_us = MOCK_START_US);
+
+/*
+ * Move the clock forward, firing every timer that falls due on the way in
+ * order of its due time
+ */
+void mockAdvance(uint32_t us);
+void mockAdvanceMillis(uint32_t ms);
+
+/*
+ * Sleep for a while and wake up again: micros() restarts at 0 while the
+ * wall clock behind time() keeps counting, timers and interrupts are gone.
+ * Variables keep their values, the host has no way to tell RTC memory apart.
+ */
+void mockDeepSleep(uint32_t seconds);
+
+/*
+ * Level the outside world puts on a pin, pins float high until set. Fires
+ * the pin's interrupt if its level changes.
+ */
+void mockSetPin(uint8_t pin, uint8_t level);
+
+/*
+ * Rewrite the levels every GPIO read sees, e.g. to wire up a key matrix
+ * @param hook Gets the levels of GPIO 0-39 and the pins driven low, returns the levels to read
+ */
+void mockSetInputHook(uint64_t (*hook)(uint64_t levels, uint64_t drivenLow));
+
+/*
+ * Feed a pin's analogRead() from a waveform of the time, or a fixed value
+ */
+void mockSetAnalog(uint8_t pin, uint16_t (*waveform)(uint32_t now_us));
+void mockSetAnalogValue(uint8_t pin, uint16_t raw);
+
+/*
+ * @return analogRead() calls since the last reset
+ */
+uint32_t mockAnalogReads();
+
+/*
+ * Burn an ADC characterization into the simulated eFuse, nullptr for a chip without one
+ */
+void mockSetAdcEfuse(uint32_t (*rawToMillivolts)(uint32_t raw));
+
+/*
+ * @return NVS writes since the last reset
+ */
+uint32_t mockNvsWrites();
+
+/*
+ * Text for Serial to read, and everything printed to it since the last call
+ */
+void mockSerialInput(const char *text);
+std::string mockSerialOutput();
+
+/*
+ * @return esp_deep_sleep_start() and esp_light_sleep_start() calls since the last reset
+ */
+uint32_t mockSleeps();
+
+/*
+ * What esp_sleep_get_wakeup_cause() reports, as an esp_sleep_wakeup_cause_t
+ */
+void mockSetWakeupCause(int cause);
+
+/*
+ * The central's side of the BLE link. Connecting and disconnecting call the
+ * server callbacks. Each notification takes one of the stack's buffers, and
+ * every connection event frees a few: with none left notify() fails with
+ * BLE_HS_ENOMEM. The central grants the shortest interval it is asked for.
+ * @param interval Connection interval in 1.25 ms units
+ */
+void mockBleConnect(uint16_t interval = 24, uint16_t latency = 0, uint16_t timeout = 400);
+void mockBleDisconnect();
+void mockBleSetLink(uint8_t buffers, uint8_t packetsPerEvent);
+uint16_t mockBleConnInterval();
+
+/*
+ * Fail the next notifications as if the stack had no buffers
+ */
+void mockBleFailNotifies(uint32_t count);
+
+struct MockNotification
+{
+    uint64_t time_us;
+    uint8_t reportId; // 0 for a characteristic outside the HID service
+    std::string uuid;
+    std::vector<uint8_t> data;
+};
+
+struct MockConnParamsRequest
+{
+    uint64_t time_us;
+    uint16_t connHandle;
+    uint16_t minInterval;
+    uint16_t maxInterval;
+    uint16_t latency;
+    uint16_t timeout;
+};
+
+const std::vector<MockNotification> &mockBleNotifications();
+void mockBleClearNotifications();
+const std::vector<MockConnParamsRequest> &mockBleConnParamsRequests();
+uint8_t mockBleBatteryLevel();
+
+/*
+ * The HID report descriptor the library handed to the stack in begin()
+ */
+const std::vector<uint8_t> &mockBleReportMap();
+
+/*
+ * Print that keeps everything written to it
+ */
+class MockPrint : public Print
+{
+public:
+    std::string text;
+
+    size_t write(uint8_t c) override
+    {
+        text += (char)c;
+        return 1;
+    }
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include <string.h>
+#include <ucontext.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "mock_hal.h"
+
+/*
+ * Tasks are coroutines on the simulated clock. The code under test is the
+ * loop task, every other task has a higher priority: it runs as soon as
+ * something wakes it and goes until it blocks again, the way it would
+ * preempt the loop on the target.
+ */
+
+const size_t TASK_STACK_BYTES = 256 * 1024;
+const uint64_t NEVER = UINT64_MAX;
+
+extern uint64_t now_us;
+
+struct QueueDefinition
+{
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    std::deque<std::vector<uint8_t>> items;
+};
+
+struct tskTaskControlBlock
+{
+    TaskFunction_t function;
+    void *arg;
+    ucontext_t context;
+    uint8_t *stack;
+
+    // blocked until this time, or until the queue has an item or room for one
+    uint64_t wake_us;
+    QueueDefinition *queue;
+    bool waitingForRoom;
+};
+
+std::vector<tskTaskControlBlock *> tasks;
+tskTaskControlBlock *runningTask;
+ucontext_t loopContext;
+
+void taskEntry()
+{
+    runningTask->function(runningTask->arg);
+
+    // a task function that returns is deleted
+    runningTask->wake_us = NEVER;
+    runningTask->queue = NULL;
+    swapcontext(&runningTask->context, &loopContext);
+}
+
+bool taskReady(const tskTaskControlBlock *t)
+{
+    if (t->wake_us <= now_us)
+    {
+        return true;
+    }
+    if (t->queue == NULL)
+    {
+        return false;
+    }
+    return t->waitingForRoom ? t->queue->items.size() < t->queue->length : !t->queue->items.empty();
+}
+
+// block the running task and go back to the loop until it is woken
+void taskBlock(uint64_t wake_us, QueueDefinition *queue, bool waitingForRoom)
+{
+    tskTaskControlBlock *t = runningTask;
+    t->wake_us = wake_us;
+    t->queue = queue;
+    t->waitingForRoom = waitingForRoom;
+    swapcontext(&t->context, &loopContext);
+}
+
+uint64_t ticksToDeadline(TickType_t ticks)
+{
+    return ticks == portMAX_DELAY ? NEVER : now_us + (uint64_t)ticks * 1000 * portTICK_PERIOD_MS;
+}
+
+void mockRunTasks()
+{
+    // tasks can't preempt each other, only the loop
+    if (runningTask != NULL)
+    {
+        return;
+    }
+
+    for (bool ran = true; ran;)
+    {
+        ran = false;
+        for (size_t i = 0; i < tasks.size(); i++)
+        {
+            tskTaskControlBlock *t = tasks[i];
+            if (!taskReady(t))
+            {
+                continue;
+            }
+
+            t->wake_us = NEVER;
+            t->queue = NULL;
+            runningTask = t;
+            swapcontext(&loopContext, &t->context);
+            runningTask = NULL;
+            ran = true;
+        }
+    }
+}
+
+uint64_t mockNextTaskWake()
+{
+    uint64_t next = NEVER;
+    for (tskTaskControlBlock *t : tasks)
+    {
+        next = std::min(next, t->wake_us);
+    }
+    return next;
+}
+
+void mockResetTasks()
+{
+    // the clock may have gone back, a task that was sleeping wakes on the next run
+    for (tskTaskControlBlock *t : tasks)
+    {
+        if (t->wake_us != NEVER)
+        {
+            t->wake_us = now_us;
+        }
+    }
+}
+
+// ---------------------------------------------------------------- tasks
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+    tskTaskControlBlock *t = new tskTaskControlBlock();
+    t->function = function;
+    t->arg = arg;
+    t->stack = new uint8_t[TASK_STACK_BYTES];
+    t->wake_us = now_us;
+
+    getcontext(&t->context);
+    t->context.uc_stack.ss_sp = t->stack;
+    t->context.uc_stack.ss_size = TASK_STACK_BYTES;
+    t->context.uc_link = NULL;
+    makecontext(&t->context, taskEntry, 0);
+
+    tasks.push_back(t);
+    if (handle != NULL)
+    {
+        *handle = t;
+    }
+
+    mockRunTasks();
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (runningTask == NULL)
+    {
+        // the loop task: a busy wait, like delay()
+        now_us += (uint64_t)ticks * 1000 * portTICK_PERIOD_MS;
+        return;
+    }
+
+    taskBlock(ticksToDeadline(ticks), NULL, false);
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return now_us / 1000 / portTICK_PERIOD_MS;
+}
+
+// ---------------------------------------------------------------- queues
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    QueueDefinition *q = new QueueDefinition();
+    q->length = length;
+    q->itemSize = itemSize;
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    uint64_t deadline = ticksToDeadline(wait);
+
+    // only a task can wait, the loop never blocks on a queue in the sources
+    while (queue->items.size() >= queue->length)
+    {
+        if (runningTask == NULL || wait == 0 || now_us >= deadline)
+        {
+            return pdFALSE;
+        }
+        taskBlock(deadline, queue, true);
+    }
+
+    const uint8_t *bytes = (const uint8_t *)item;
+    queue->items.emplace_back(bytes, bytes + queue->itemSize);
+
+    mockRunTasks();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t wait)
+{
+    uint64_t deadline = ticksToDeadline(wait);
+
+    while (queue->items.empty())
+    {
+        if (runningTask == NULL || wait == 0 || now_us >= deadline)
+        {
+            return pdFALSE;
+        }
+        taskBlock(deadline, queue, false);
+    }
+
+    memcpy(buffer, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+
+    mockRunTasks();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    return queue->length - queue->items.size();
+}
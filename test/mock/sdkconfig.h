@@ -0,0 +1,7 @@
+#ifndef MOCK_SDKCONFIG_h
+#define MOCK_SDKCONFIG_h
+
+// BleKeyboard builds against the simulated NimBLE stack in mock_ble.cpp
+#define CONFIG_BT_ENABLED 1
+
+#endif
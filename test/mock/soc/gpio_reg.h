@@ -0,0 +1,14 @@
+#ifndef MOCK_GPIO_REG_h
+#define MOCK_GPIO_REG_h
+
+#include "soc/soc.h"
+
+// the ESP32 register addresses, only used as keys by the simulation
+#define GPIO_OUT_W1TS_REG 0x3FF44008
+#define GPIO_OUT_W1TC_REG 0x3FF4400C
+#define GPIO_OUT1_W1TS_REG 0x3FF44014
+#define GPIO_OUT1_W1TC_REG 0x3FF44018
+#define GPIO_IN_REG 0x3FF4403C
+#define GPIO_IN1_REG 0x3FF44040
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef MOCK_SOC_h
+#define MOCK_SOC_h
+
+#include <stdint.h>
+
+// register access goes to the simulated GPIO block
+uint32_t mockRegRead(uint32_t reg);
+void mockRegWrite(uint32_t reg, uint32_t value);
+
+#define REG_READ(reg) mockRegRead(reg)
+#define REG_WRITE(reg, value) mockRegWrite((reg), (value))
+
+#endif
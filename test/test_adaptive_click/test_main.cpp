@@ -0,0 +1,204 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include <unity.h>
+#include "buttons.h"
+#include "click_timing.h"
+#include "mock_hal.h"
+#include "traces.h"
+
+/*
+ * Adaptive multi-click windows learned from click traces replayed through
+ * the whole pipeline, with the play/pause bounds of 150-300 ms. The window
+ * is kept in RTC memory across deep sleep and in NVS across a power cycle.
+ * Only four pins can adapt and the slots live for the whole program, so the
+ * later tests carry on with the pin the first one trained.
+ */
+
+const unsigned long MIN_WINDOW_MS = 150;
+const unsigned long MAX_WINDOW_MS = 300;
+
+const uint8_t FAST_PIN = 4;
+const uint8_t SLOW_PIN = 5;
+
+// the adaptive slots and the interrupt routine, normally only touched by buttons.cpp
+extern ClickTiming clickTimings[];
+void onPinChange(void *arg);
+
+static uint32_t singles;
+static uint32_t doubles;
+static unsigned long single_ms;
+
+void countSingle()
+{
+    singles++;
+    single_ms = millis();
+}
+
+void countMulti(uint8_t count)
+{
+    if (count == 2)
+    {
+        doubles++;
+    }
+}
+
+void registerPin(uint8_t pin)
+{
+    onClick(pin, countSingle);
+    onMultiClick(pin, countMulti);
+    TEST_ASSERT_TRUE(enableAdaptiveMultiClick(pin, MIN_WINDOW_MS, MAX_WINDOW_MS));
+}
+
+// run the loop every millisecond until a time on the clock
+void runUntil(unsigned long ms)
+{
+    while (millis() < ms)
+    {
+        mockAdvanceMillis(1);
+        buttonEventLoop();
+    }
+}
+
+void replay(uint8_t pin, const TracedClick *trace, uint8_t count)
+{
+    unsigned long start = millis();
+    for (uint8_t i = 0; i < count; i++)
+    {
+        runUntil(start + trace[i].press_ms);
+        mockSetPin(pin, LOW);
+        runUntil(start + trace[i].release_ms);
+        mockSetPin(pin, HIGH);
+    }
+    runUntil(millis() + 1000);
+}
+
+uint16_t savedWindow(uint8_t pin)
+{
+    char key[8];
+    snprintf(key, sizeof(key), "mcw%u", pin);
+
+    Preferences prefs;
+    prefs.begin("buttons", true);
+    uint16_t window = prefs.getUShort(key, 0);
+    prefs.end();
+    return window;
+}
+
+// a single click resolves on the first loop past the window after its release
+unsigned long singleClickDelay(uint8_t pin)
+{
+    mockSetPin(pin, LOW);
+    runUntil(millis() + 80);
+    mockSetPin(pin, HIGH);
+    unsigned long released = millis();
+    runUntil(released + 1000);
+    return single_ms - released;
+}
+
+/*
+ * Sleep and boot again. The host keeps all of RAM, not just RTC memory, so
+ * the button table still has the pin and registering it again won't attach
+ * its interrupt. Attach it the way a fresh boot does.
+ */
+void sleepAndWake(uint8_t pin, uint32_t seconds)
+{
+    mockDeepSleep(seconds);
+    attachInterruptArg(digitalPinToInterrupt(pin), onPinChange, (void *)(uintptr_t)pin, CHANGE);
+    runUntil(millis() + 200);
+}
+
+void setUp()
+{
+    singles = 0;
+    doubles = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_fast_trace_shrinks_the_window_and_keeps_every_double()
+{
+    registerPin(FAST_PIN);
+    replay(FAST_PIN, FAST_TRACE, sizeof(FAST_TRACE) / sizeof(FAST_TRACE[0]));
+
+    TEST_ASSERT_EQUAL_UINT32(FAST_TRACE_DOUBLES, doubles);
+    TEST_ASSERT_EQUAL_UINT32(FAST_TRACE_SINGLES, singles);
+
+    // the slowest gap is 140 ms, in the 133-152 ms bin, plus the 40 ms margin
+    TEST_ASSERT_EQUAL_UINT32(192, multiClickWindowMillis(FAST_PIN));
+    TEST_ASSERT_EQUAL_UINT32(192 + 1, singleClickDelay(FAST_PIN));
+}
+
+void test_slow_trace_keeps_the_longest_window()
+{
+    uint32_t writes = mockNvsWrites();
+
+    registerPin(SLOW_PIN);
+    replay(SLOW_PIN, SLOW_TRACE, sizeof(SLOW_TRACE) / sizeof(SLOW_TRACE[0]));
+
+    TEST_ASSERT_EQUAL_UINT32(SLOW_TRACE_DOUBLES, doubles);
+    TEST_ASSERT_EQUAL_UINT32(SLOW_TRACE_SINGLES, singles);
+    TEST_ASSERT_EQUAL_UINT32(MAX_WINDOW_MS, multiClickWindowMillis(SLOW_PIN));
+
+    // a window that never moved is never written
+    TEST_ASSERT_EQUAL_UINT32(writes, mockNvsWrites());
+}
+
+void test_learned_window_is_saved_to_nvs()
+{
+    // written once it drifted 20 ms from the last saved value, not on every click
+    TEST_ASSERT_UINT_WITHIN(19, multiClickWindowMillis(FAST_PIN), savedWindow(FAST_PIN));
+    TEST_ASSERT_LESS_OR_EQUAL(3, mockNvsWrites());
+}
+
+void test_window_survives_deep_sleep()
+{
+    uint32_t writes = mockNvsWrites();
+    sleepAndWake(FAST_PIN, 600);
+
+    // setup() registers the pin again on waking, RTC memory still has the histogram
+    registerPin(FAST_PIN);
+    TEST_ASSERT_EQUAL_UINT32(192, multiClickWindowMillis(FAST_PIN));
+    TEST_ASSERT_EQUAL_UINT32(192 + 1, singleClickDelay(FAST_PIN));
+    TEST_ASSERT_EQUAL_UINT32(writes, mockNvsWrites());
+}
+
+void test_window_is_restored_from_nvs_after_a_power_cycle()
+{
+    uint16_t saved = savedWindow(FAST_PIN);
+
+    // power lost: RTC memory is gone, NVS is not
+    memset(&clickTimings[0], 0, sizeof(ClickTiming));
+    sleepAndWake(FAST_PIN, 0);
+
+    registerPin(FAST_PIN);
+    TEST_ASSERT_EQUAL_UINT32(saved, multiClickWindowMillis(FAST_PIN));
+    TEST_ASSERT_EQUAL_UINT32(saved + 1, singleClickDelay(FAST_PIN));
+}
+
+void test_saved_window_outside_the_bounds_is_clamped()
+{
+    Preferences prefs;
+    prefs.begin("buttons");
+    prefs.putUShort("mcw4", 40);
+    prefs.end();
+
+    memset(&clickTimings[0], 0, sizeof(ClickTiming));
+    registerPin(FAST_PIN);
+    TEST_ASSERT_EQUAL_UINT32(MIN_WINDOW_MS, multiClickWindowMillis(FAST_PIN));
+}
+
+int main()
+{
+    mockReset();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_fast_trace_shrinks_the_window_and_keeps_every_double);
+    RUN_TEST(test_slow_trace_keeps_the_longest_window);
+    RUN_TEST(test_learned_window_is_saved_to_nvs);
+    RUN_TEST(test_window_survives_deep_sleep);
+    RUN_TEST(test_window_is_restored_from_nvs_after_a_power_cycle);
+    RUN_TEST(test_saved_window_outside_the_bounds_is_clamped);
+    return UNITY_END();
+}
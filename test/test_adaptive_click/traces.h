@@ -0,0 +1,59 @@
+#ifndef TRACES_h
+#define TRACES_h
+
+#include <stdint.h>
+
+/*
+ * Click traces of the play/pause button, press and release times in
+ * milliseconds from the start of the trace. Double clicks are separated by
+ * pauses well past the largest window and finish with a few single clicks.
+ */
+
+struct TracedClick
+{
+    uint32_t press_ms;
+    uint32_t release_ms;
+};
+
+// quick double clicks, 90-140 ms between the release and the next press
+const TracedClick FAST_TRACE[] = {
+    {0, 85}, {180, 255},
+    {1800, 1890}, {2000, 2080},
+    {3600, 3675}, {3795, 3880},
+    {5400, 5495}, {5600, 5670},
+    {7200, 7280}, {7410, 7500},
+    {9000, 9090}, {9190, 9265},
+    {10800, 10870}, {10985, 11060},
+    {12600, 12680}, {12805, 12890},
+    {14400, 14475}, {14565, 14650},
+    {16200, 16290}, {16430, 16500},
+    {18000, 18070}, {18180, 18260},
+    {19800, 19885}, {19990, 20075},
+    // singles
+    {21600, 21680},
+    {23400, 23490},
+    {25200, 25275},
+};
+const uint8_t FAST_TRACE_DOUBLES = 12;
+const uint8_t FAST_TRACE_SINGLES = 3;
+
+// relaxed double clicks, 220-280 ms between the release and the next press
+const TracedClick SLOW_TRACE[] = {
+    {0, 110}, {350, 450},
+    {1800, 1920}, {2160, 2270},
+    {3600, 3700}, {3960, 4075},
+    {5400, 5530}, {5780, 5880},
+    {7200, 7310}, {7540, 7650},
+    {9000, 9120}, {9370, 9480},
+    {10800, 10905}, {11150, 11260},
+    {12600, 12720}, {12950, 13060},
+    {14400, 14500}, {14730, 14845},
+    {16200, 16315}, {16560, 16665},
+    // singles
+    {18000, 18110},
+    {19800, 19920},
+};
+const uint8_t SLOW_TRACE_DOUBLES = 10;
+const uint8_t SLOW_TRACE_SINGLES = 2;
+
+#endif
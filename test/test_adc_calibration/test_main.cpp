@@ -0,0 +1,101 @@
+#include <unity.h>
+#include "adc_calibration.h"
+
+static AdcCalibration table;
+
+// a bowed ADC: reads 5 % high in the middle of the range
+uint32_t bowedCurve(uint32_t raw, void *arg)
+{
+    float x = raw / 4096.0f;
+    return raw * 0.8f * (1 + 0.2f * x * (1 - x)) + *(uint32_t *)arg;
+}
+
+void setUp()
+{
+    adcCalibrationLinear(table, 1000);
+}
+
+void tearDown()
+{
+}
+
+void test_linear_table_is_valid()
+{
+    TEST_ASSERT_TRUE(adcCalibrationValid(table));
+
+    AdcCalibration blank = {};
+    TEST_ASSERT_FALSE(adcCalibrationValid(blank));
+}
+
+void test_linear_table_scales_raw_counts()
+{
+    adcCalibrationLinear(table, 1700);
+
+    TEST_ASSERT_EQUAL_UINT16(0, adcCalibrationApply(table, 0));
+    TEST_ASSERT_EQUAL_UINT16(1700, adcCalibrationApply(table, 1000));
+    TEST_ASSERT_UINT_WITHIN(1, 4095 * 1.7f, adcCalibrationApply(table, 4095));
+}
+
+void test_interpolates_between_points()
+{
+    table.mV[2] = 500;
+    table.mV[3] = 900;
+
+    // raw 512 and 768 are the points, 640 is halfway
+    TEST_ASSERT_EQUAL_UINT16(500, adcCalibrationApply(table, 512));
+    TEST_ASSERT_EQUAL_UINT16(700, adcCalibrationApply(table, 640));
+    TEST_ASSERT_EQUAL_UINT16(900, adcCalibrationApply(table, 768));
+}
+
+void test_table_from_a_curve_tracks_it()
+{
+    uint32_t offset = 60;
+    adcCalibrationFromCurve(table, bowedCurve, &offset);
+
+    for (uint32_t raw = 0; raw < 4096; raw += 97)
+    {
+        TEST_ASSERT_UINT_WITHIN(3, bowedCurve(raw, &offset), adcCalibrationApply(table, raw));
+    }
+}
+
+void test_first_bench_point_corrects_the_gain()
+{
+    // the divider is 4 % off
+    adcCalibrationAddBenchPoint(table, 2000, 2080);
+
+    TEST_ASSERT_EQUAL_UINT16(1, table.benchPoints);
+    TEST_ASSERT_UINT_WITHIN(1, 2080, adcCalibrationApply(table, 2000));
+    TEST_ASSERT_UINT_WITHIN(1, 1040, adcCalibrationApply(table, 1000));
+}
+
+void test_later_bench_points_only_move_their_segment()
+{
+    adcCalibrationAddBenchPoint(table, 2000, 2000);
+    adcCalibrationAddBenchPoint(table, 3000, 3050);
+
+    TEST_ASSERT_EQUAL_UINT16(2, table.benchPoints);
+    TEST_ASSERT_UINT_WITHIN(1, 3050, adcCalibrationApply(table, 3000));
+    TEST_ASSERT_UINT_WITHIN(1, 2000, adcCalibrationApply(table, 2000));
+    TEST_ASSERT_UINT_WITHIN(1, 1000, adcCalibrationApply(table, 1000));
+}
+
+void test_bench_point_at_zero_is_ignored()
+{
+    adcCalibrationAddBenchPoint(table, 0, 100);
+
+    TEST_ASSERT_EQUAL_UINT16(0, table.benchPoints);
+    TEST_ASSERT_EQUAL_UINT16(1000, adcCalibrationApply(table, 1000));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_linear_table_is_valid);
+    RUN_TEST(test_linear_table_scales_raw_counts);
+    RUN_TEST(test_interpolates_between_points);
+    RUN_TEST(test_table_from_a_curve_tracks_it);
+    RUN_TEST(test_first_bench_point_corrects_the_gain);
+    RUN_TEST(test_later_bench_points_only_move_their_segment);
+    RUN_TEST(test_bench_point_at_zero_is_ignored);
+    return UNITY_END();
+}
@@ -0,0 +1,89 @@
+#include <unity.h>
+#include "adc_filter.h"
+
+static AdcFilter filter;
+
+void setUp()
+{
+    adcFilterBegin(filter);
+}
+
+void tearDown()
+{
+}
+
+void test_reads_0_before_the_first_sample()
+{
+    TEST_ASSERT_EQUAL_UINT16(0, adcFilterValue(filter));
+}
+
+void test_starts_at_the_first_sample()
+{
+    TEST_ASSERT_EQUAL_UINT16(2000, adcFilterAdd(filter, 2000));
+    TEST_ASSERT_EQUAL_UINT16(2000, adcFilterValue(filter));
+}
+
+void test_spikes_are_dropped_by_the_median()
+{
+    for (uint8_t i = 0; i < 10; i++)
+    {
+        adcFilterAdd(filter, 2000);
+    }
+
+    // radio bursts pull single readings far off, two in a window of five are outvoted
+    TEST_ASSERT_EQUAL_UINT16(2000, adcFilterAdd(filter, 4095));
+    TEST_ASSERT_EQUAL_UINT16(2000, adcFilterAdd(filter, 0));
+    TEST_ASSERT_EQUAL_UINT16(2000, adcFilterAdd(filter, 2000));
+}
+
+void test_average_follows_a_step()
+{
+    adcFilterAdd(filter, 2000);
+
+    uint16_t value = 0;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        value = adcFilterAdd(filter, 2160);
+    }
+    // the median only flips once most of the window has moved
+    TEST_ASSERT_LESS_THAN(2160, value);
+    TEST_ASSERT_GREATER_THAN(2000, value);
+
+    for (uint8_t i = 0; i < 100; i++)
+    {
+        value = adcFilterAdd(filter, 2160);
+    }
+    TEST_ASSERT_UINT_WITHIN(1, 2160, value);
+}
+
+void test_noise_is_smoothed()
+{
+    // +-40 counts around 1800
+    const int16_t noise[] = {40, -25, 10, -40, 30, -5, 20, -35};
+
+    uint16_t lowest = UINT16_MAX;
+    uint16_t highest = 0;
+    for (uint16_t i = 0; i < 200; i++)
+    {
+        uint16_t value = adcFilterAdd(filter, 1800 + noise[i % 8]);
+        if (i >= 50)
+        {
+            lowest = value < lowest ? value : lowest;
+            highest = value > highest ? value : highest;
+        }
+    }
+
+    TEST_ASSERT_LESS_OR_EQUAL_UINT(12, highest - lowest);
+    TEST_ASSERT_UINT_WITHIN(15, 1800, lowest);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reads_0_before_the_first_sample);
+    RUN_TEST(test_starts_at_the_first_sample);
+    RUN_TEST(test_spikes_are_dropped_by_the_median);
+    RUN_TEST(test_average_follows_a_step);
+    RUN_TEST(test_noise_is_smoothed);
+    return UNITY_END();
+}
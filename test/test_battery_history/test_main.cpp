@@ -0,0 +1,85 @@
+#include <unity.h>
+#include "battery_history.h"
+
+// seconds on the history clock
+const uint32_t START_S = 1700000000;
+
+static BatteryTrend trend;
+
+void setUp()
+{
+    batteryTrendBegin(trend);
+}
+
+void tearDown()
+{
+}
+
+void addSample(uint32_t time_s, uint8_t percent)
+{
+    BatterySample sample = {time_s, 3800, 0, percent};
+    batteryTrendAdd(trend, sample);
+}
+
+void test_no_prediction_from_too_few_samples()
+{
+    addSample(START_S, 90);
+    addSample(START_S + 3600, 85);
+
+    TEST_ASSERT_LESS_THAN(0, batteryTrendHoursLeft(trend));
+}
+
+void test_steady_discharge_is_extrapolated()
+{
+    // 5 % an hour from 90 %
+    for (uint8_t h = 0; h <= 10; h++)
+    {
+        addSample(START_S + h * 3600, 90 - 5 * h);
+    }
+
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 8, batteryTrendHoursLeft(trend));
+}
+
+void test_uneven_sample_spacing()
+{
+    // awake samples a few minutes apart, then a night of deep sleep
+    addSample(START_S, 80);
+    addSample(START_S + 600, 79);
+    addSample(START_S + 1200, 78);
+    addSample(START_S + 1200 + 6 * 3600, 42);
+    addSample(START_S + 1800 + 6 * 3600, 41);
+
+    // 6 % an hour through all of it
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, 41 / 6.0f, batteryTrendHoursLeft(trend));
+}
+
+void test_charging_has_no_prediction()
+{
+    for (uint8_t h = 0; h < 5; h++)
+    {
+        addSample(START_S + h * 3600, 40 + 10 * h);
+    }
+
+    TEST_ASSERT_LESS_THAN(0, batteryTrendHoursLeft(trend));
+}
+
+void test_samples_at_the_same_time_have_no_slope()
+{
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        addSample(START_S, 70);
+    }
+
+    TEST_ASSERT_LESS_THAN(0, batteryTrendHoursLeft(trend));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_no_prediction_from_too_few_samples);
+    RUN_TEST(test_steady_discharge_is_extrapolated);
+    RUN_TEST(test_uneven_sample_spacing);
+    RUN_TEST(test_charging_has_no_prediction);
+    RUN_TEST(test_samples_at_the_same_time_have_no_slope);
+    return UNITY_END();
+}
@@ -0,0 +1,229 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "buttons.h"
+#include "edge_queue.h"
+#include "mock_hal.h"
+
+/*
+ * Bounce storms replayed through the pin change interrupt and
+ * buttonEventLoop(). Each profile clicks its pins CLICKS times at random
+ * points of the loop period, the contacts chatter at irregular intervals
+ * of 50-300 us for a while after every edge. The loop runs every
+ * millisecond, or every 50 ms to stand in for a loop held up by BLE.
+ * Prints one "BENCH {json}" line per profile: clicks dropped, edges queued
+ * and lost to a full queue, the deepest the queue got between loops, and
+ * edge to callback latency measured from the first transition of the
+ * release.
+ */
+
+extern EdgeQueue edges;
+
+const uint32_t PRESS_US = 120000;
+const uint32_t CLICK_PERIOD_US = 400000;
+const uint16_t CLICKS = 200;
+
+struct StormProfile
+{
+    const char *name;
+    uint8_t firstPin;
+    uint8_t pins;
+    uint32_t chatter_us; // how long the contacts chatter after each edge
+    uint32_t loopPeriod_us;
+};
+
+const StormProfile PROFILES[] = {
+    {"clean", 4, 1, 0, 1000},
+    {"chatter_5ms", 5, 1, 5000, 1000},
+    {"chatter_50ms", 6, 1, 50000, 1000},
+    {"simultaneous_16_pins_5ms", 16, 16, 5000, 1000},
+    {"simultaneous_16_pins_stalled_loop", 16, 16, 5000, 50000},
+};
+
+struct Change
+{
+    uint32_t t;
+    uint8_t pin;
+    uint8_t level;
+
+    bool operator<(const Change &other) const
+    {
+        return t < other.t || (t == other.t && pin < other.pin);
+    }
+};
+
+static uint32_t clicks;
+static std::vector<uint32_t> callbacks_us;
+
+void countClick()
+{
+    clicks++;
+    callbacks_us.push_back(micros());
+}
+
+// the same storm on every run
+static uint32_t seed;
+uint32_t nextRandom()
+{
+    seed = seed * 1664525 + 1013904223;
+    return seed >> 8;
+}
+
+// an edge to a level followed by chatter, always ending on the level
+void addEdge(std::vector<Change> &changes, uint32_t t, uint8_t pin, uint8_t level, uint32_t chatter_us)
+{
+    changes.push_back({t, pin, level});
+
+    uint8_t current = level;
+    for (uint32_t at = t + 50 + nextRandom() % 250; at < t + chatter_us; at += 50 + nextRandom() % 250)
+    {
+        current = !current;
+        changes.push_back({at, pin, current});
+    }
+    if (current != level)
+    {
+        changes.push_back({t + chatter_us, pin, level});
+    }
+}
+
+// the field of the button stats line that follows a key
+uint32_t statField(const char *key)
+{
+    MockPrint out;
+    printButtonStats(out);
+
+    size_t at = out.text.find(std::string("\"") + key + "\":");
+    return at == std::string::npos ? 0 : strtoul(out.text.c_str() + at + strlen(key) + 3, NULL, 10);
+}
+
+uint32_t percentile(std::vector<uint32_t> values, uint8_t p)
+{
+    std::sort(values.begin(), values.end());
+    return values[(values.size() - 1) * p / 100];
+}
+
+void storm(const StormProfile &profile)
+{
+    for (uint8_t pin = profile.firstPin; pin < profile.firstPin + profile.pins; pin++)
+    {
+        onClick(pin, countClick);
+    }
+
+    std::vector<Change> changes;
+    std::vector<uint32_t> releases_us;
+    for (uint16_t i = 0; i < CLICKS; i++)
+    {
+        uint32_t press = i * CLICK_PERIOD_US + nextRandom() % profile.loopPeriod_us;
+        for (uint8_t pin = profile.firstPin; pin < profile.firstPin + profile.pins; pin++)
+        {
+            addEdge(changes, press, pin, LOW, profile.chatter_us);
+            addEdge(changes, press + PRESS_US, pin, HIGH, profile.chatter_us);
+            releases_us.push_back(press + PRESS_US);
+        }
+    }
+    std::sort(changes.begin(), changes.end());
+
+    clicks = 0;
+    callbacks_us.clear();
+    uint32_t edgesBefore = buttonEdgeCount();
+    uint32_t overflowsBefore = buttonEdgeOverflows();
+    uint32_t recoveredBefore = statField("recovered");
+    uint32_t queuePeak = 0;
+
+    // the interrupt fires on every change in between two loops
+    uint32_t start_us = micros();
+    uint32_t end_us = CLICKS * CLICK_PERIOD_US;
+    size_t next = 0;
+
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    for (uint32_t t = profile.loopPeriod_us; t <= end_us; t += profile.loopPeriod_us)
+    {
+        for (; next < changes.size() && changes[next].t < t; next++)
+        {
+            mockAdvance(start_us + changes[next].t - micros());
+            mockSetPin(changes[next].pin, changes[next].level);
+        }
+        mockAdvance(start_us + t - micros());
+
+        queuePeak = max(queuePeak, edges.size());
+        buttonEventLoop();
+    }
+    double host_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    uint32_t queued = buttonEdgeCount() - edgesBefore;
+    uint32_t overflows = buttonEdgeOverflows() - overflowsBefore;
+    uint32_t expected = CLICKS * profile.pins;
+
+    // a click resolves on release, callbacks come out in release order
+    std::vector<uint32_t> latency_us;
+    std::sort(releases_us.begin(), releases_us.end());
+    for (size_t i = 0; i < min(callbacks_us.size(), releases_us.size()); i++)
+    {
+        latency_us.push_back(callbacks_us[i] - start_us - releases_us[i]);
+    }
+
+    printf("BENCH {\"bench\":\"bounce_storm\",\"profile\":\"%s\",\"pins\":%u,\"clicks\":%u,\"chatter_us\":%u,\"loop_period_us\":%u,"
+           "\"interrupts\":%u,\"edges_queued\":%u,\"edges_recovered\":%u,\"queue_overflows\":%u,\"queue_peak\":%u,"
+           "\"clicks_dropped\":%d,\"latency_us\":{\"p50\":%u,\"p95\":%u,\"p99\":%u,\"max\":%u},"
+           "\"interrupts_per_host_s\":%.0f}\n",
+           profile.name, profile.pins, expected, profile.chatter_us, profile.loopPeriod_us,
+           (unsigned)changes.size(), queued, statField("recovered") - recoveredBefore, overflows, queuePeak,
+           (int)expected - (int)clicks, percentile(latency_us, 50), percentile(latency_us, 95), percentile(latency_us, 99),
+           percentile(latency_us, 100), changes.size() / host_s);
+
+    // no storm gets a click lost, a phantom click or an edge dropped, and
+    // every click is out on the first loop after its release
+    TEST_ASSERT_EQUAL_UINT32(expected, clicks);
+    TEST_ASSERT_EQUAL_UINT32(0, overflows);
+    TEST_ASSERT_EQUAL_UINT32(2 * expected, queued);
+    TEST_ASSERT_LESS_OR_EQUAL(profile.loopPeriod_us, percentile(latency_us, 100));
+}
+
+void setUp()
+{
+    seed = 1;
+}
+
+void tearDown()
+{
+}
+
+void test_clean()
+{
+    storm(PROFILES[0]);
+}
+
+void test_chatter_5ms()
+{
+    storm(PROFILES[1]);
+}
+
+void test_chatter_50ms()
+{
+    storm(PROFILES[2]);
+}
+
+void test_simultaneous_16_pins()
+{
+    storm(PROFILES[3]);
+}
+
+void test_simultaneous_16_pins_stalled_loop()
+{
+    storm(PROFILES[4]);
+}
+
+int main()
+{
+    mockReset();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_clean);
+    RUN_TEST(test_chatter_5ms);
+    RUN_TEST(test_chatter_50ms);
+    RUN_TEST(test_simultaneous_16_pins);
+    RUN_TEST(test_simultaneous_16_pins_stalled_loop);
+    return UNITY_END();
+}
@@ -0,0 +1,339 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <chrono>
+#include <new>
+#include <stack>
+#include <unordered_map>
+#include "buttons.h"
+#include "mock_hal.h"
+
+/*
+ * Loop time of the pin-indexed slot table against the unordered_map
+ * registries it replaced. Prints one "BENCH {json}" line per run.
+ */
+
+const uint32_t LOOPS = 200000;
+
+// every allocation the process makes, to check the loop stays off the heap
+static uint32_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if (p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+/*
+ * The registries and loop as they were before the slot table, trimmed to
+ * what runs every loop: the edge stack, the pending event walk and the
+ * debounce lock sweep
+ */
+namespace legacy
+{
+    const unsigned long DEBOUNCE_THRESHOLD_MS = 100;
+    const unsigned long MULTI_CLICK_THRESHOLD_MS = 300;
+    const unsigned long PRESS_HOLD_THRESHOLD_MS = 1000;
+    const unsigned long EVENT_TIMEOUT = 2000;
+
+    struct Handler
+    {
+        uint8_t pin;
+        unsigned long debounceLock;
+        void (*onClickFn)();
+        void (*onMultiClick)(uint8_t clickCount);
+        void (*onPressHoldFn)();
+    };
+
+    struct PendingEvent
+    {
+        unsigned long lastEvent_ms;
+        uint8_t clickCount;
+        Handler *handler;
+    };
+
+    struct ChangeInterrupt
+    {
+        uint8_t pin;
+        bool rising;
+    };
+
+    std::unordered_map<uint8_t, Handler *> handlers;
+    std::stack<ChangeInterrupt *> changeInterrupts;
+    std::unordered_map<uint8_t, PendingEvent *> pendingEvents;
+
+    void registerPin(uint8_t pin, void (*click)(), void (*multiClick)(uint8_t), void (*hold)())
+    {
+        handlers[pin] = new Handler{pin, 0, click, multiClick, hold};
+    }
+
+    void onChange(uint8_t pin)
+    {
+        Handler *h = handlers.at(pin);
+        if (!h->debounceLock)
+        {
+            changeInterrupts.push(new ChangeInterrupt{pin, digitalRead(pin) == HIGH});
+            h->debounceLock = true;
+        }
+    }
+
+    void processChangeInterrupt(ChangeInterrupt *interrupt)
+    {
+        unsigned long now = millis();
+        Handler *h = handlers[interrupt->pin];
+
+        if (h->debounceLock == true)
+        {
+            h->debounceLock = now;
+        }
+
+        if (pendingEvents.count(interrupt->pin) == 0)
+        {
+            if (!interrupt->rising)
+            {
+                pendingEvents[interrupt->pin] = new PendingEvent{now, 0, h};
+            }
+        }
+        else
+        {
+            PendingEvent *p = pendingEvents[interrupt->pin];
+            p->lastEvent_ms = now;
+            if (interrupt->rising)
+            {
+                p->clickCount++;
+            }
+        }
+    }
+
+    void processPendingEvents()
+    {
+        for (auto i = pendingEvents.begin(); i != pendingEvents.end();)
+        {
+            PendingEvent *e = i->second;
+            unsigned long elapsed = millis() - e->lastEvent_ms;
+            Handler *h = e->handler;
+            int level = digitalRead(h->pin);
+
+            bool done = false;
+            if (h->onMultiClick == NULL && h->onPressHoldFn == NULL && level == HIGH)
+            {
+                h->onClickFn();
+                done = true;
+            }
+            else if (h->onMultiClick != NULL && level == HIGH && elapsed > MULTI_CLICK_THRESHOLD_MS)
+            {
+                if (e->clickCount > 1)
+                {
+                    h->onMultiClick(e->clickCount);
+                }
+                else if (h->onClickFn != NULL)
+                {
+                    h->onClickFn();
+                }
+                done = true;
+            }
+            else if (h->onPressHoldFn != NULL && level == LOW && e->clickCount < 1 && elapsed > PRESS_HOLD_THRESHOLD_MS)
+            {
+                h->onPressHoldFn();
+                done = true;
+            }
+            else if (elapsed > EVENT_TIMEOUT)
+            {
+                done = true;
+            }
+
+            if (done)
+            {
+                delete e;
+                i = pendingEvents.erase(i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    void cleanExpiredDebounceLocks()
+    {
+        unsigned long now = millis();
+        for (std::pair<const uint8_t, Handler *> pair : handlers)
+        {
+            unsigned long lock = pair.second->debounceLock;
+            if (lock && now - lock > DEBOUNCE_THRESHOLD_MS)
+            {
+                pair.second->debounceLock = false;
+            }
+        }
+    }
+
+    void loop()
+    {
+        while (!changeInterrupts.empty())
+        {
+            ChangeInterrupt *interrupt = changeInterrupts.top();
+            processChangeInterrupt(interrupt);
+            delete interrupt;
+            changeInterrupts.pop();
+        }
+
+        processPendingEvents();
+        cleanExpiredDebounceLocks();
+    }
+}
+
+static uint32_t clicks = 0;
+
+void countClick()
+{
+    clicks++;
+}
+
+void countMultiClick(uint8_t count)
+{
+    clicks += count;
+}
+
+void ignoreHold()
+{
+}
+
+/*
+ * Loops at 1 ms ticks, optionally clicking a pin every 600 ms
+ * @param press Sets the pin level and raises its interrupt
+ * @return Host nanoseconds per loop
+ */
+double runLoops(void (*loop)(), void (*press)(uint8_t pin, uint8_t level), uint8_t clickPin, uint32_t &allocs)
+{
+    clicks = 0;
+    uint32_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < LOOPS; i++)
+    {
+        mockAdvance(1000);
+
+        if (press != NULL)
+        {
+            // 150 ms press, long enough for the old 100 ms debounce lock, once every 600 ms
+            uint32_t phase = i % 600;
+            if (phase == 0)
+            {
+                press(clickPin, LOW);
+            }
+            else if (phase == 150)
+            {
+                press(clickPin, HIGH);
+            }
+        }
+
+        loop();
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    allocs = allocations - before;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / LOOPS;
+}
+
+void pressLegacy(uint8_t pin, uint8_t level)
+{
+    mockSetPin(pin, level);
+    legacy::onChange(pin);
+}
+
+void report(const char *scenario, uint8_t pins, double legacy_ns, uint32_t legacyAllocs, double table_ns, uint32_t tableAllocs)
+{
+    printf("BENCH {\"bench\":\"loop_time\",\"scenario\":\"%s\",\"pins\":%u,\"loops\":%u,"
+           "\"legacy_ns_per_loop\":%.1f,\"legacy_allocs\":%u,\"slot_table_ns_per_loop\":%.1f,\"slot_table_allocs\":%u,"
+           "\"speedup\":%.2f}\n",
+           scenario, pins, LOOPS, legacy_ns, legacyAllocs, table_ns, tableAllocs, legacy_ns / table_ns);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_idle_loop()
+{
+    uint32_t legacyAllocs, tableAllocs;
+
+    for (uint8_t pin = 0; pin < 3; pin++)
+    {
+        legacy::registerPin(pin, countClick, countMultiClick, ignoreHold);
+        onClick(pin, countClick);
+        onMultiClick(pin, countMultiClick);
+        onPressHold(pin, ignoreHold);
+    }
+    double legacy3 = runLoops(legacy::loop, NULL, 0, legacyAllocs);
+    double table3 = runLoops(buttonEventLoop, NULL, 0, tableAllocs);
+    report("idle", 3, legacy3, legacyAllocs, table3, tableAllocs);
+
+    for (uint8_t pin = 3; pin < 16; pin++)
+    {
+        legacy::registerPin(pin, countClick, countMultiClick, ignoreHold);
+        onClick(pin, countClick);
+        onMultiClick(pin, countMultiClick);
+        onPressHold(pin, ignoreHold);
+    }
+    double legacy16 = runLoops(legacy::loop, NULL, 0, legacyAllocs);
+    double table16 = runLoops(buttonEventLoop, NULL, 0, tableAllocs);
+    report("idle", 16, legacy16, legacyAllocs, table16, tableAllocs);
+
+    // an idle loop returns before the snapshot, whatever the number of pins
+    TEST_ASSERT_TRUE(legacy3 / table3 >= 1.0);
+    TEST_ASSERT_TRUE(legacy16 / table16 >= 1.0);
+    TEST_ASSERT_EQUAL_UINT32(0, tableAllocs);
+}
+
+void test_click_stream()
+{
+    uint32_t legacyAllocs, tableAllocs;
+
+    // 16 pins from the idle run stay registered, the clicks go to another one
+    const uint8_t LEGACY_PIN = 20;
+    const uint8_t TABLE_PIN = 21;
+    legacy::registerPin(LEGACY_PIN, countClick, countMultiClick, ignoreHold);
+    onClick(TABLE_PIN, countClick);
+    onMultiClick(TABLE_PIN, countMultiClick);
+    onPressHold(TABLE_PIN, ignoreHold);
+
+    double legacy_ns = runLoops(legacy::loop, pressLegacy, LEGACY_PIN, legacyAllocs);
+    uint32_t legacyClicks = clicks;
+    double table_ns = runLoops(buttonEventLoop, mockSetPin, TABLE_PIN, tableAllocs);
+    uint32_t tableClicks = clicks;
+    report("click_every_600ms", 17, legacy_ns, legacyAllocs, table_ns, tableAllocs);
+
+    // both resolve every click, only the slot table does it without the heap
+    TEST_ASSERT_EQUAL_UINT32(LOOPS / 600, legacyClicks);
+    TEST_ASSERT_EQUAL_UINT32(LOOPS / 600, tableClicks);
+    TEST_ASSERT_EQUAL_UINT32(0, tableAllocs);
+    TEST_ASSERT_GREATER_THAN(0, legacyAllocs);
+}
+
+int main()
+{
+    mockReset();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_idle_loop);
+    RUN_TEST(test_click_stream);
+    return UNITY_END();
+}
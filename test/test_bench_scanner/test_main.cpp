@@ -0,0 +1,267 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "buttons.h"
+#include "debounce.h"
+#include "edge_queue.h"
+#include "mock_hal.h"
+
+/*
+ * CPU cost of the GPIO scanner against the pin change interrupt path at 3,
+ * 16 and 32 buttons, over one simulated second in which every button is
+ * clicked once with 5 ms of contact bounce on each edge. The second is run
+ * through both backends to count their calls, and the cost of each kind of
+ * call is timed on its own. Prints one "BENCH {json}" line per button count.
+ */
+
+// the two input backends, normally called from the esp_timer task and the GPIO interrupt
+void scanButtons(void *arg);
+void onPinChange(void *arg);
+
+extern EdgeQueue edges;
+
+const uint32_t SCAN_PERIOD_US = 1000;
+const uint32_t SECOND_US = 1000000;
+const uint32_t PRESS_US = 120000;
+
+// the contacts chatter every 500 us for 5 ms after each edge
+const uint32_t BOUNCE_US = 5000;
+const uint32_t CHATTER_US = 500;
+
+// timed runs of each backend call, the fastest one is kept
+const uint8_t ROUNDS = 5;
+const uint32_t ITERATIONS = 200000;
+
+// pin the backend calls are timed on, kept out of the simulated second
+const uint8_t TIMED_PIN = 39;
+
+typedef std::chrono::steady_clock Clock;
+
+static uint32_t clicks = 0;
+
+void countClick()
+{
+    clicks++;
+}
+
+// time of a button's press within the second, spread so edges rarely coincide
+uint32_t pressTime(uint8_t pin)
+{
+    return (pin * 29 % 800) * 1000 + 1000;
+}
+
+// level of a bouncing button at a time within the second
+uint8_t levelAt(uint8_t pin, uint32_t t)
+{
+    uint32_t press = pressTime(pin);
+    uint32_t release = press + PRESS_US;
+
+    uint32_t edge = t >= release ? release : press;
+    bool pressed = t >= press && t < release;
+    if (t >= press && t - edge < BOUNCE_US)
+    {
+        // odd chatter slots read the opposite level
+        bool flipped = ((t - edge) / CHATTER_US) & 1;
+        pressed = pressed != flipped;
+    }
+    return pressed ? LOW : HIGH;
+}
+
+// move the clock to a time within the second without firing the scan timer
+void moveTo(unsigned long start_us, uint32_t t)
+{
+    delayMicroseconds(start_us + t - micros());
+}
+
+/*
+ * One second of the interrupt path, the routine runs once per level change
+ * @return Calls to the interrupt routine
+ */
+uint32_t runInterruptPath(uint8_t buttons)
+{
+    std::vector<std::pair<uint32_t, uint8_t>> changes;
+    for (uint8_t pin = 0; pin < buttons; pin++)
+    {
+        uint8_t level = HIGH;
+        for (uint32_t t = 0; t < SECOND_US; t += CHATTER_US)
+        {
+            if (levelAt(pin, t) != level)
+            {
+                level = levelAt(pin, t);
+                changes.push_back({t, pin});
+            }
+        }
+    }
+    std::sort(changes.begin(), changes.end());
+
+    unsigned long start_us = micros();
+    for (auto &change : changes)
+    {
+        moveTo(start_us, change.first);
+        mockSetPin(change.second, levelAt(change.second, change.first));
+        onPinChange((void *)(uintptr_t)change.second);
+        buttonEventLoop();
+    }
+
+    moveTo(start_us, SECOND_US);
+    buttonEventLoop();
+    return changes.size();
+}
+
+/*
+ * One second of the scanner, a tick every period whatever the pins do
+ * @return Scanner ticks
+ */
+uint32_t runScanner(uint8_t buttons)
+{
+    unsigned long start_us = micros();
+    uint32_t ticks = 0;
+    for (uint32_t t = 0; t < SECOND_US; t += SCAN_PERIOD_US)
+    {
+        moveTo(start_us, t);
+        for (uint8_t pin = 0; pin < buttons; pin++)
+        {
+            mockSetPin(pin, levelAt(pin, t));
+        }
+        scanButtons(NULL);
+        ticks++;
+        buttonEventLoop();
+    }
+
+    moveTo(start_us, SECOND_US);
+    buttonEventLoop();
+    return ticks;
+}
+
+/*
+ * Fastest of a few timed runs of a loop, per iteration
+ */
+template <typename Body>
+double nanosPerCall(uint32_t iterations, Body body)
+{
+    double best = 1e18;
+    for (uint8_t round = 0; round < ROUNDS; round++)
+    {
+        Clock::time_point start = Clock::now();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            body(i);
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        best = std::min(best, ns / iterations);
+    }
+    return best;
+}
+
+void benchmark(uint8_t buttons)
+{
+    EdgeEvent e;
+
+    for (uint8_t pin = 0; pin < buttons; pin++)
+    {
+        onClick(pin, countClick);
+    }
+
+    // leave the timed pin released, as the edges it queued were popped raw
+    // its handler never sees them
+    mockSetPin(TIMED_PIN, HIGH);
+    for (uint8_t s = 0; s < VerticalDebouncer::SAMPLES; s++)
+    {
+        scanButtons(NULL);
+    }
+    while (edges.pop(e))
+    {
+    }
+
+    // count the work of one second on each backend, and check both resolve every click
+    clicks = 0;
+    uint32_t edgesBefore = buttonEdgeCount();
+    uint32_t isrCalls = runInterruptPath(buttons);
+    uint32_t isrEdges = buttonEdgeCount() - edgesBefore;
+    TEST_ASSERT_EQUAL_UINT32(buttons, clicks);
+
+    clicks = 0;
+    edgesBefore = buttonEdgeCount();
+    uint32_t scanTicks = runScanner(buttons);
+    uint32_t scanEdges = buttonEdgeCount() - edgesBefore;
+    TEST_ASSERT_EQUAL_UINT32(buttons, clicks);
+    TEST_ASSERT_EQUAL_UINT32(2 * buttons, scanEdges);
+
+    // a bounce inside the debounce window, rejected
+    void *timedPin = (void *)(uintptr_t)TIMED_PIN;
+    onPinChange(timedPin);
+    edges.pop(e);
+    double bounce_ns = nanosPerCall(ITERATIONS, [&](uint32_t) { onPinChange(timedPin); });
+
+    // an edge past the debounce window, queued
+    double edge_ns = nanosPerCall(ITERATIONS, [&](uint32_t) {
+        delayMicroseconds(100001);
+        onPinChange(timedPin);
+        edges.pop(e);
+    });
+
+    // a tick that sees nothing change
+    double tick_ns = nanosPerCall(ITERATIONS, [](uint32_t) { scanButtons(NULL); });
+
+    // SAMPLES ticks to confirm a change, one edge queued
+    double flip_ns = nanosPerCall(ITERATIONS / VerticalDebouncer::SAMPLES, [&](uint32_t i) {
+        mockSetPin(TIMED_PIN, i & 1 ? HIGH : LOW);
+        for (uint8_t s = 0; s < VerticalDebouncer::SAMPLES; s++)
+        {
+            scanButtons(NULL);
+        }
+        edges.pop(e);
+    });
+    flip_ns -= VerticalDebouncer::SAMPLES * tick_ns;
+
+    double isr_ns_per_s = isrEdges * edge_ns + (isrCalls - isrEdges) * bounce_ns;
+    double scan_ns_per_s = scanTicks * tick_ns + scanEdges * flip_ns;
+
+    printf("BENCH {\"bench\":\"scanner\",\"buttons\":%u,\"scan_period_us\":%u,"
+           "\"isr_calls_per_s\":%u,\"isr_edges_per_s\":%u,\"isr_ns_per_bounce\":%.1f,\"isr_ns_per_edge\":%.1f,\"isr_ns_per_s\":%.0f,"
+           "\"scan_ticks_per_s\":%u,\"scan_ns_per_tick\":%.1f,\"scan_ns_per_edge\":%.1f,\"scan_ns_per_s\":%.0f}\n",
+           buttons, SCAN_PERIOD_US, isrCalls, isrEdges, bounce_ns, edge_ns, isr_ns_per_s,
+           scanTicks, tick_ns, flip_ns, scan_ns_per_s);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_3_buttons()
+{
+    benchmark(3);
+}
+
+void test_16_buttons()
+{
+    benchmark(16);
+}
+
+void test_32_buttons()
+{
+    benchmark(32);
+}
+
+int main()
+{
+    mockReset();
+
+    // the scanner claims the pins, so no interrupt is attached and
+    // mockSetPin() only sets levels. Its timer never fires, the
+    // benchmark calls both backends itself.
+    useButtonScanner(SCAN_PERIOD_US);
+    onClick(TIMED_PIN, countClick);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_3_buttons);
+    RUN_TEST(test_16_buttons);
+    RUN_TEST(test_32_buttons);
+    return UNITY_END();
+}
@@ -0,0 +1,148 @@
+#include <Arduino.h>
+#include <string.h>
+#include <unity.h>
+#include <chrono>
+#include "BleKeyboard.h"
+#include "mock_hal.h"
+
+/*
+ * Typing throughput of write(buffer, size), which adds a key per report
+ * and only releases when it has to, against write() of one character at a
+ * time with a press and a release each. The text goes over the simulated
+ * link with the default 7 ms gap between reports and with no gap, where
+ * the link's buffers pace it. Prints one "BENCH {json}" line per run:
+ * reports per character, characters per second of link time, and the host
+ * time spent queueing, which includes the simulated stack and is no
+ * measure of the target.
+ */
+
+const uint8_t KEYBOARD_ID = 1;
+
+// a 15 ms interval, the central takes four notifications per event
+const uint16_t CONN_INTERVAL = 12;
+
+struct TypingProfile
+{
+    const char *name;
+    const char *text;
+};
+
+const TypingProfile PROFILES[] = {
+    {"pangram", "The quick brown fox jumps over the lazy dog. Pack my box with five dozen liquor jugs."},
+    {"repeats", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+    {"mixed_case", "HeLLo WoRLD, ThIs Is MiXeD CaSe TeXt WiTh ShIfT ChAnGeS oN mOsT kEyS."},
+};
+
+static BleKeyboard keyboard;
+
+struct TypingResult
+{
+    uint32_t reports;
+    uint64_t link_us;
+    double host_ns;
+};
+
+TypingResult type(const char *text, bool buffered, uint32_t delay_ms)
+{
+    keyboard.setDelay(delay_ms);
+    mockBleClearNotifications();
+    ReportStats before = keyboard.getReportStats();
+
+    const uint8_t *buffer = (const uint8_t *)text;
+    size_t length = strlen(text);
+    double host_ns = 0;
+
+    // the queue takes what fits, the rest waits for the link
+    for (size_t done = 0; done < length;)
+    {
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        size_t n = buffered ? keyboard.write(buffer + done, length - done) : keyboard.write(buffer[done]);
+        host_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+
+        done += n;
+        if (done < length)
+        {
+            keyboard.clearWriteError();
+            mockAdvanceMillis(1);
+        }
+    }
+
+    while (keyboard.pendingReports() > 0)
+    {
+        mockAdvanceMillis(1);
+    }
+    mockAdvanceMillis(100);
+
+    ReportStats after = keyboard.getReportStats();
+    TEST_ASSERT_EQUAL_UINT32(0, after.dropped - before.dropped);
+
+    const std::vector<MockNotification> &sent = mockBleNotifications();
+    TypingResult result = {(uint32_t)sent.size(), sent.back().time_us - sent.front().time_us, host_ns};
+    return result;
+}
+
+void bench(const TypingProfile &profile)
+{
+    size_t chars = strlen(profile.text);
+    TypingResult perChar[2];
+    TypingResult buffered[2];
+
+    const uint32_t DELAYS[] = {7, 0};
+    for (uint8_t d = 0; d < 2; d++)
+    {
+        perChar[d] = type(profile.text, false, DELAYS[d]);
+        buffered[d] = type(profile.text, true, DELAYS[d]);
+
+        const TypingResult *runs[] = {&perChar[d], &buffered[d]};
+        const char *engines[] = {"per_char", "buffered"};
+        for (uint8_t e = 0; e < 2; e++)
+        {
+            const TypingResult &r = *runs[e];
+            printf("BENCH {\"bench\":\"typing\",\"profile\":\"%s\",\"engine\":\"%s\",\"delay_ms\":%u,\"chars\":%u,"
+                   "\"reports\":%u,\"reports_per_char\":%.2f,\"link_ms\":%.1f,\"chars_per_s\":%.1f,\"host_ns_per_char\":%.0f}\n",
+                   profile.name, engines[e], DELAYS[d], (unsigned)chars, r.reports, (double)r.reports / chars,
+                   r.link_us / 1000.0, chars * 1e6 / r.link_us, r.host_ns / chars);
+        }
+
+        // never more reports than a press and a release per character
+        TEST_ASSERT_EQUAL_UINT32(2 * chars, perChar[d].reports);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(2 * chars, buffered[d].reports);
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+    keyboard.setDelay(7);
+}
+
+void test_pangram()
+{
+    bench(PROFILES[0]);
+}
+
+void test_repeats()
+{
+    bench(PROFILES[1]);
+}
+
+void test_mixed_case()
+{
+    bench(PROFILES[2]);
+}
+
+int main()
+{
+    mockReset();
+    keyboard.begin();
+    mockBleConnect(CONN_INTERVAL);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_pangram);
+    RUN_TEST(test_repeats);
+    RUN_TEST(test_mixed_case);
+    return UNITY_END();
+}
@@ -0,0 +1,370 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <unity.h>
+#include "BleKeyboard.h"
+#include "mock_hal.h"
+
+/*
+ * BleKeyboard against the simulated BLE link: reports are queued by the
+ * caller and go out from the sender task as the clock moves, and the
+ * connection policy asks the central for new parameters as the link goes
+ * active and idle.
+ */
+
+const uint8_t KEYBOARD_ID = 1;
+const uint8_t MEDIA_KEYS_ID = 2;
+const uint8_t VOLUME_ID = 3;
+
+const ConnParams ACTIVE = {12, 12, 0, 300};
+const ConnParams IDLE = {96, 120, 10, 600};
+
+static BleKeyboard keyboard;
+
+int8_t takeVolumeSteps(std::atomic<int16_t> &pending);
+
+void runFor(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; i++)
+    {
+        mockAdvanceMillis(1);
+    }
+}
+
+// the notifications of one report, in the order they went out
+std::vector<MockNotification> reports(uint8_t reportId)
+{
+    std::vector<MockNotification> sent;
+    for (const MockNotification &n : mockBleNotifications())
+    {
+        if (n.reportId == reportId && n.uuid == "2a4d")
+        {
+            sent.push_back(n);
+        }
+    }
+    return sent;
+}
+
+void setUp()
+{
+    runFor(100);
+    mockBleClearNotifications();
+}
+
+void tearDown()
+{
+    keyboard.setDelay(7);
+}
+
+void test_write_returns_before_the_release_goes_out()
+{
+    uint32_t before = micros();
+    TEST_ASSERT_EQUAL_UINT32(1, keyboard.write(KEY_MEDIA_PLAY_PAUSE));
+
+    // the press went out right away, the release waits for the gap
+    TEST_ASSERT_EQUAL_UINT32(before, micros());
+    TEST_ASSERT_EQUAL_UINT32(1, reports(MEDIA_KEYS_ID).size());
+    TEST_ASSERT_EQUAL_UINT32(1, keyboard.pendingReports());
+}
+
+void test_press_and_release_are_the_default_gap_apart()
+{
+    keyboard.write(KEY_MEDIA_PLAY_PAUSE);
+    runFor(50);
+
+    std::vector<MockNotification> sent = reports(MEDIA_KEYS_ID);
+    TEST_ASSERT_EQUAL_UINT32(2, sent.size());
+    TEST_ASSERT_EQUAL_UINT8(8, sent[0].data[0]);
+    TEST_ASSERT_EQUAL_UINT8(0, sent[1].data[0]);
+    TEST_ASSERT_EQUAL_UINT32(7000, sent[1].time_us - sent[0].time_us);
+}
+
+void test_zero_delay_sends_back_to_back()
+{
+    keyboard.setDelay(0);
+    keyboard.write(KEY_MEDIA_PLAY_PAUSE);
+    runFor(50);
+
+    std::vector<MockNotification> sent = reports(MEDIA_KEYS_ID);
+    TEST_ASSERT_EQUAL_UINT32(2, sent.size());
+    TEST_ASSERT_EQUAL_UINT32(0, sent[1].time_us - sent[0].time_us);
+}
+
+void test_volume_steps_are_taken_up_to_the_report_range()
+{
+    std::atomic<int16_t> pending{300};
+    TEST_ASSERT_EQUAL_INT8(127, takeVolumeSteps(pending));
+    TEST_ASSERT_EQUAL_INT16(173, pending);
+    TEST_ASSERT_EQUAL_INT8(127, takeVolumeSteps(pending));
+    TEST_ASSERT_EQUAL_INT8(46, takeVolumeSteps(pending));
+    TEST_ASSERT_EQUAL_INT16(0, pending);
+
+    // never -128, the report is symmetric
+    pending = -200;
+    TEST_ASSERT_EQUAL_INT8(-127, takeVolumeSteps(pending));
+    TEST_ASSERT_EQUAL_INT16(-73, pending);
+    TEST_ASSERT_EQUAL_INT8(-73, takeVolumeSteps(pending));
+    TEST_ASSERT_EQUAL_INT8(0, takeVolumeSteps(pending));
+}
+
+void test_steps_while_a_volume_report_is_queued_join_it()
+{
+    ReportStats before = keyboard.getReportStats();
+
+    // the sender sleeps out the gap after the press, the release waits behind it
+    keyboard.write(KEY_MEDIA_PLAY_PAUSE);
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_TRUE(keyboard.stepVolume(1));
+    }
+    TEST_ASSERT_TRUE(keyboard.stepVolume(-2));
+    TEST_ASSERT_EQUAL_UINT32(2, keyboard.pendingReports());
+
+    runFor(50);
+    std::vector<MockNotification> sent = reports(VOLUME_ID);
+    TEST_ASSERT_EQUAL_UINT32(1, sent.size());
+    TEST_ASSERT_EQUAL_INT8(3, (int8_t)sent[0].data[0]);
+
+    ReportStats after = keyboard.getReportStats();
+    TEST_ASSERT_EQUAL_UINT32(7, after.volumeSteps - before.volumeSteps);
+    TEST_ASSERT_EQUAL_UINT32(1, after.volumeReports - before.volumeReports);
+}
+
+void test_steps_past_the_report_range_go_out_in_a_second_report()
+{
+    keyboard.write(KEY_MEDIA_PLAY_PAUSE);
+    keyboard.stepVolume(-100);
+    keyboard.stepVolume(-100);
+    TEST_ASSERT_EQUAL_UINT32(2, keyboard.pendingReports());
+
+    // the sender queues the rest again when it takes the first report, there
+    // is never more than the release and one volume report waiting
+    for (uint8_t i = 0; i < 50; i++)
+    {
+        runFor(1);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(2, keyboard.pendingReports());
+    }
+
+    std::vector<MockNotification> sent = reports(VOLUME_ID);
+    TEST_ASSERT_EQUAL_UINT32(2, sent.size());
+    TEST_ASSERT_EQUAL_INT8(-127, (int8_t)sent[0].data[0]);
+    TEST_ASSERT_EQUAL_INT8(-73, (int8_t)sent[1].data[0]);
+}
+
+void test_full_queue_keeps_room_for_the_volume_report_and_the_marker()
+{
+    ReportStats before = keyboard.getReportStats();
+
+    // hold the sender up after the first report and fill the queue with keys
+    keyboard.setDelay(1000);
+    size_t written = 0;
+    while (keyboard.write(KEY_MEDIA_PLAY_PAUSE) == 1)
+    {
+        written++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, keyboard.press(KEY_MEDIA_MUTE));
+    TEST_ASSERT_EQUAL_UINT32(REPORT_QUEUE_LENGTH - REPORT_QUEUE_RESERVED, keyboard.pendingReports());
+    TEST_ASSERT_EQUAL_UINT32(0, keyboard.press(KEY_MEDIA_NEXT_TRACK));
+
+    TEST_ASSERT_TRUE(keyboard.stepVolume(1));
+    keyboard.markActive();
+    TEST_ASSERT_EQUAL_UINT32(REPORT_QUEUE_LENGTH, keyboard.pendingReports());
+
+    keyboard.setDelay(0);
+    runFor(1100);
+
+    // every key, the mute press and the volume report went out
+    ReportStats after = keyboard.getReportStats();
+    TEST_ASSERT_EQUAL_UINT32(0, after.dropped - before.dropped);
+    TEST_ASSERT_EQUAL_UINT32(2 * written + 2, after.sent - before.sent);
+    TEST_ASSERT_EQUAL_UINT32(1, reports(VOLUME_ID).size());
+
+    keyboard.release(KEY_MEDIA_MUTE);
+}
+
+// the keyboard reports sent, as the modifiers and the keys held
+std::vector<std::string> typed()
+{
+    std::vector<std::string> sent;
+    for (const MockNotification &n : reports(KEYBOARD_ID))
+    {
+        std::string keys = std::to_string(n.data[0]) + ":";
+        for (uint8_t i = 2; i < n.data.size(); i++)
+        {
+            if (n.data[i])
+            {
+                keys += (char)(n.data[i] - 0x04 + 'a');
+            }
+        }
+        sent.push_back(keys);
+    }
+    return sent;
+}
+
+void assertTyped(const std::vector<std::string> &expected)
+{
+    std::vector<std::string> sent = typed();
+    TEST_ASSERT_EQUAL_UINT32(expected.size(), sent.size());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_STRING(expected[i].c_str(), sent[i].c_str());
+    }
+}
+
+void test_typing_adds_a_key_per_report_and_releases_on_a_repeat()
+{
+    TEST_ASSERT_EQUAL_UINT32(5, keyboard.write((const uint8_t *)"hello", 5));
+    runFor(200);
+
+    assertTyped({"0:h", "0:he", "0:hel", "0:", "0:l", "0:lo", "0:"});
+}
+
+void test_shift_change_releases_before_the_next_key()
+{
+    keyboard.write((const uint8_t *)"aBCd", 4);
+    runFor(200);
+
+    assertTyped({"0:a", "0:", "2:b", "2:bc", "0:", "0:d", "0:"});
+}
+
+void test_seventh_key_releases_the_full_report()
+{
+    keyboard.write((const uint8_t *)"abcdefgh", 8);
+    runFor(200);
+
+    assertTyped({"0:a", "0:ab", "0:abc", "0:abcd", "0:abcde", "0:abcdef", "0:", "0:g", "0:gh", "0:"});
+}
+
+void test_modifier_bytes_are_tapped_on_their_own()
+{
+    // like write(KEY_LEFT_CTRL), a modifier in the buffer is pressed and
+    // released, it does not chord with the key after it
+    const uint8_t buffer[] = {KEY_LEFT_CTRL, 'c', KEY_LEFT_SHIFT, KEY_LEFT_SHIFT, 'x'};
+    TEST_ASSERT_EQUAL_UINT32(5, keyboard.write(buffer, sizeof(buffer)));
+    runFor(200);
+
+    assertTyped({"1:", "0:", "0:c", "0:", "2:", "2:", "0:", "0:x", "0:"});
+}
+
+void test_typing_keeps_keys_held_with_press()
+{
+    keyboard.press(KEY_LEFT_SHIFT);
+    keyboard.write((const uint8_t *)"ab", 2);
+    keyboard.releaseAll();
+    runFor(200);
+
+    assertTyped({"2:", "2:a", "2:ab", "2:", "0:"});
+}
+
+void assertParams(const ConnParams &expected, const MockConnParamsRequest &request)
+{
+    TEST_ASSERT_EQUAL_UINT16(expected.minInterval, request.minInterval);
+    TEST_ASSERT_EQUAL_UINT16(expected.maxInterval, request.maxInterval);
+    TEST_ASSERT_EQUAL_UINT16(expected.latency, request.latency);
+    TEST_ASSERT_EQUAL_UINT16(expected.timeout, request.timeout);
+}
+
+void test_idle_link_switches_to_the_idle_parameters()
+{
+    keyboard.write(KEY_MEDIA_PLAY_PAUSE);
+    runFor(100);
+    TEST_ASSERT_EQUAL_UINT16(ACTIVE.minInterval, mockBleConnInterval());
+
+    uint64_t lastReport_us = mockBleNotifications().back().time_us;
+    size_t before = mockBleConnParamsRequests().size();
+
+    // nothing until a minute after the last report
+    runFor((lastReport_us + 60000000 - esp_timer_get_time()) / 1000 - 1);
+    TEST_ASSERT_EQUAL_UINT32(before, mockBleConnParamsRequests().size());
+
+    runFor(2);
+    const std::vector<MockConnParamsRequest> &requests = mockBleConnParamsRequests();
+    TEST_ASSERT_EQUAL_UINT32(before + 1, requests.size());
+    assertParams(IDLE, requests.back());
+    TEST_ASSERT_UINT32_WITHIN(1000, lastReport_us + 60000000, requests.back().time_us);
+    TEST_ASSERT_EQUAL_UINT16(IDLE.minInterval, mockBleConnInterval());
+
+    // and nothing more while it stays idle
+    runFor(120000);
+    TEST_ASSERT_EQUAL_UINT32(before + 1, requests.size());
+}
+
+void test_parameters_in_place_are_not_asked_for_again()
+{
+    keyboard.write(KEY_MEDIA_PLAY_PAUSE);
+    runFor(100);
+    size_t before = mockBleConnParamsRequests().size();
+
+    // the link is already active, more keys and markers change nothing
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        keyboard.write(KEY_MEDIA_NEXT_TRACK);
+        keyboard.stepVolume(1);
+        keyboard.markActive();
+        runFor(1000);
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, mockBleConnParamsRequests().size());
+}
+
+void test_mark_active_wakes_an_idle_link()
+{
+    runFor(61000);
+    TEST_ASSERT_EQUAL_UINT16(IDLE.minInterval, mockBleConnInterval());
+    mockBleClearNotifications();
+    size_t before = mockBleConnParamsRequests().size();
+
+    // straight away, ahead of any report
+    keyboard.markActive();
+    const std::vector<MockConnParamsRequest> &requests = mockBleConnParamsRequests();
+    TEST_ASSERT_EQUAL_UINT32(before + 1, requests.size());
+    assertParams(ACTIVE, requests.back());
+    TEST_ASSERT_EQUAL_UINT16(ACTIVE.minInterval, mockBleConnInterval());
+    TEST_ASSERT_EQUAL_UINT32(0, mockBleNotifications().size());
+
+    // a marker counts as activity, the link stays active for another minute
+    runFor(59000);
+    TEST_ASSERT_EQUAL_UINT32(before + 1, requests.size());
+    runFor(2000);
+    TEST_ASSERT_EQUAL_UINT32(before + 2, requests.size());
+    assertParams(IDLE, requests.back());
+}
+
+void test_new_connection_starts_on_the_active_parameters()
+{
+    runFor(61000);
+    mockBleDisconnect();
+    runFor(100);
+    size_t before = mockBleConnParamsRequests().size();
+
+    mockBleConnect(24);
+    runFor(1);
+    const std::vector<MockConnParamsRequest> &requests = mockBleConnParamsRequests();
+    TEST_ASSERT_EQUAL_UINT32(before + 1, requests.size());
+    assertParams(ACTIVE, requests.back());
+}
+
+int main()
+{
+    mockReset();
+    keyboard.setConnectionPolicy(ACTIVE, IDLE, 60000);
+    keyboard.begin();
+    mockBleConnect();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_write_returns_before_the_release_goes_out);
+    RUN_TEST(test_press_and_release_are_the_default_gap_apart);
+    RUN_TEST(test_zero_delay_sends_back_to_back);
+    RUN_TEST(test_volume_steps_are_taken_up_to_the_report_range);
+    RUN_TEST(test_steps_while_a_volume_report_is_queued_join_it);
+    RUN_TEST(test_steps_past_the_report_range_go_out_in_a_second_report);
+    RUN_TEST(test_full_queue_keeps_room_for_the_volume_report_and_the_marker);
+    RUN_TEST(test_typing_adds_a_key_per_report_and_releases_on_a_repeat);
+    RUN_TEST(test_shift_change_releases_before_the_next_key);
+    RUN_TEST(test_seventh_key_releases_the_full_report);
+    RUN_TEST(test_modifier_bytes_are_tapped_on_their_own);
+    RUN_TEST(test_typing_keeps_keys_held_with_press);
+    RUN_TEST(test_idle_link_switches_to_the_idle_parameters);
+    RUN_TEST(test_parameters_in_place_are_not_asked_for_again);
+    RUN_TEST(test_mark_active_wakes_an_idle_link);
+    RUN_TEST(test_new_connection_starts_on_the_active_parameters);
+    return UNITY_END();
+}
@@ -0,0 +1,265 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "buttons.h"
+#include "mock_hal.h"
+
+/*
+ * Combos registered on overlapping sets of pins. Combos and handlers live
+ * for the whole program and only eight combos fit, so the last tests press
+ * pins an earlier test registered and left released.
+ */
+
+// the combo timers, normally run from buttonEventLoop()
+void processComboTimers(uint32_t now);
+void onPinChange(void *arg);
+
+static uint32_t pairHolds;
+static uint32_t tripleHolds;
+static uint32_t clicks;
+
+void countPairHold()
+{
+    pairHolds++;
+}
+
+void countTripleHold()
+{
+    tripleHolds++;
+}
+
+void countClick()
+{
+    clicks++;
+}
+
+void ignoreRepeat()
+{
+}
+
+// register a pair and a triple that contains it, both held for 500 ms
+void registerCombos(uint8_t a, uint8_t b, uint8_t c)
+{
+    const uint8_t pair[] = {a, b};
+    const uint8_t triple[] = {a, b, c};
+    TEST_ASSERT_TRUE(onComboHold(pair, 2, 500, countPairHold));
+    TEST_ASSERT_TRUE(onComboHold(triple, 3, 500, countTripleHold));
+}
+
+// run the loop every millisecond for a while
+void runFor(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; i++)
+    {
+        mockAdvanceMillis(1);
+        buttonEventLoop();
+    }
+}
+
+void setUp()
+{
+    pairHolds = 0;
+    tripleHolds = 0;
+    clicks = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_pair_fires_once_after_its_hold_time()
+{
+    registerCombos(4, 5, 6);
+
+    mockSetPin(4, LOW);
+    runFor(20);
+    mockSetPin(5, LOW);
+    runFor(500);
+    TEST_ASSERT_EQUAL_UINT32(0, pairHolds);
+
+    runFor(2);
+    TEST_ASSERT_EQUAL_UINT32(1, pairHolds);
+
+    runFor(1000);
+    TEST_ASSERT_EQUAL_UINT32(1, pairHolds);
+    TEST_ASSERT_EQUAL_UINT32(0, tripleHolds);
+
+    mockSetPin(4, HIGH);
+    mockSetPin(5, HIGH);
+    runFor(500);
+}
+
+void test_larger_combo_swallows_the_smaller_one()
+{
+    registerCombos(12, 13, 14);
+
+    mockSetPin(12, LOW);
+    mockSetPin(13, LOW);
+    runFor(200);
+    mockSetPin(14, LOW);
+
+    // the pair would have fired 300 ms from now, the triple takes over
+    runFor(1000);
+    TEST_ASSERT_EQUAL_UINT32(0, pairHolds);
+    TEST_ASSERT_EQUAL_UINT32(1, tripleHolds);
+
+    // letting go of the third pin doesn't revive the pair
+    mockSetPin(14, HIGH);
+    runFor(1000);
+    TEST_ASSERT_EQUAL_UINT32(0, pairHolds);
+
+    mockSetPin(12, HIGH);
+    mockSetPin(13, HIGH);
+    runFor(500);
+}
+
+void test_smaller_combo_inside_a_held_larger_one_stays_quiet()
+{
+    registerCombos(15, 16, 17);
+
+    // the third pin goes down first, the pair completes the triple
+    mockSetPin(17, LOW);
+    runFor(150);
+    mockSetPin(15, LOW);
+    mockSetPin(16, LOW);
+
+    runFor(1000);
+    TEST_ASSERT_EQUAL_UINT32(1, tripleHolds);
+    TEST_ASSERT_EQUAL_UINT32(0, pairHolds);
+
+    mockSetPin(15, HIGH);
+    mockSetPin(16, HIGH);
+    mockSetPin(17, HIGH);
+    runFor(500);
+}
+
+void test_pair_fired_before_the_triple_is_completed()
+{
+    registerCombos(18, 19, 21);
+
+    mockSetPin(18, LOW);
+    mockSetPin(19, LOW);
+    runFor(600);
+    TEST_ASSERT_EQUAL_UINT32(1, pairHolds);
+
+    mockSetPin(21, LOW);
+    runFor(400);
+    TEST_ASSERT_EQUAL_UINT32(0, tripleHolds);
+    runFor(200);
+    TEST_ASSERT_EQUAL_UINT32(1, tripleHolds);
+    TEST_ASSERT_EQUAL_UINT32(1, pairHolds);
+
+    mockSetPin(18, HIGH);
+    mockSetPin(19, HIGH);
+    mockSetPin(21, HIGH);
+    runFor(500);
+}
+
+void test_combo_pins_drop_their_own_gestures()
+{
+    // the pair from the first test
+    onClick(4, countClick);
+    onClick(5, countClick);
+
+    mockSetPin(4, LOW);
+    mockSetPin(5, LOW);
+    runFor(700);
+    mockSetPin(4, HIGH);
+    mockSetPin(5, HIGH);
+    runFor(500);
+
+    TEST_ASSERT_EQUAL_UINT32(1, pairHolds);
+    TEST_ASSERT_EQUAL_UINT32(0, clicks);
+}
+
+void test_late_edge_does_not_fire_a_combo_early()
+{
+    // the pair from the fourth test
+    mockSetPin(18, LOW);
+    mockSetPin(19, LOW);
+    unsigned long armed = micros();
+    buttonEventLoop();
+
+    // a timer pass with a clock sample older than the edge that armed the
+    // combo, as when an edge lands between sampling now and draining
+    processComboTimers(armed - 10);
+    mockAdvanceMillis(1);
+    buttonEventLoop();
+    TEST_ASSERT_EQUAL_UINT32(0, pairHolds);
+
+    runFor(498);
+    TEST_ASSERT_EQUAL_UINT32(0, pairHolds);
+    runFor(3);
+    TEST_ASSERT_EQUAL_UINT32(1, pairHolds);
+
+    mockSetPin(18, HIGH);
+    mockSetPin(19, HIGH);
+    runFor(500);
+}
+
+void test_swallowed_release_leaves_the_combo()
+{
+    // the pair from the second test, one of its pins repeats while held
+    const RepeatCurve curve = {150, 40, 20};
+    TEST_ASSERT_TRUE(onRepeat(13, 400, curve, ignoreRepeat));
+
+    mockSetPin(13, LOW);
+    runFor(450);
+
+    // the release never reaches the interrupt routine, the repeat timer finds the pin up
+    detachInterrupt(13);
+    mockSetPin(13, HIGH);
+    runFor(200);
+    attachInterruptArg(digitalPinToInterrupt(13), onPinChange, (void *)(uintptr_t)13, CHANGE);
+
+    mockSetPin(12, LOW);
+    runFor(1000);
+    TEST_ASSERT_EQUAL_UINT32(0, pairHolds);
+
+    // pressed for real, the pair arms again
+    mockSetPin(13, LOW);
+    runFor(600);
+    TEST_ASSERT_EQUAL_UINT32(1, pairHolds);
+
+    mockSetPin(12, HIGH);
+    mockSetPin(13, HIGH);
+    runFor(500);
+}
+
+void test_recovered_release_is_taken_in_time_order()
+{
+    // the pair from the first test, both pins click on their own
+    mockSetPin(4, LOW);
+    mockAdvanceMillis(30);
+
+    // the release lands inside the debounce window, the other pin goes down after it
+    mockSetPin(4, HIGH);
+    mockAdvanceMillis(20);
+    mockSetPin(5, LOW);
+
+    // one loop drains the press of each and recovers the swallowed release,
+    // which is older than the second press: the pair was never held
+    mockAdvanceMillis(100);
+    buttonEventLoop();
+    runFor(20);
+    mockSetPin(5, HIGH);
+    runFor(500);
+
+    TEST_ASSERT_EQUAL_UINT32(0, pairHolds);
+    TEST_ASSERT_EQUAL_UINT32(2, clicks);
+}
+
+int main()
+{
+    mockReset();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_pair_fires_once_after_its_hold_time);
+    RUN_TEST(test_larger_combo_swallows_the_smaller_one);
+    RUN_TEST(test_smaller_combo_inside_a_held_larger_one_stays_quiet);
+    RUN_TEST(test_pair_fired_before_the_triple_is_completed);
+    RUN_TEST(test_combo_pins_drop_their_own_gestures);
+    RUN_TEST(test_late_edge_does_not_fire_a_combo_early);
+    RUN_TEST(test_swallowed_release_leaves_the_combo);
+    RUN_TEST(test_recovered_release_is_taken_in_time_order);
+    return UNITY_END();
+}
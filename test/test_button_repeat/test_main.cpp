@@ -0,0 +1,138 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "buttons.h"
+#include "mock_hal.h"
+
+/*
+ * Hold-to-repeat through the whole pipeline, with the volume buttons'
+ * schedule: 400 ms to the first repeat, then 150 ms shrinking by 20% down
+ * to 40 ms. Every test uses its own pin, the handler table lives for the
+ * whole program.
+ */
+
+const unsigned long REPEAT_DELAY_MS = 400;
+const RepeatCurve REPEAT_CURVE = {150, 40, 20};
+
+const uint8_t MAX_REPEATS = 64;
+
+static uint32_t clickCount;
+static uint32_t repeatCount;
+static unsigned long repeatTimes[MAX_REPEATS];
+
+void countClick()
+{
+    clickCount++;
+}
+
+void recordRepeat()
+{
+    if (repeatCount < MAX_REPEATS)
+    {
+        repeatTimes[repeatCount] = millis();
+    }
+    repeatCount++;
+}
+
+void registerPin(uint8_t pin)
+{
+    onClick(pin, countClick);
+    TEST_ASSERT_TRUE(onRepeat(pin, REPEAT_DELAY_MS, REPEAT_CURVE, recordRepeat));
+}
+
+// run the loop every millisecond for a while
+void runFor(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; i++)
+    {
+        mockAdvanceMillis(1);
+        buttonEventLoop();
+    }
+}
+
+void setUp()
+{
+    clickCount = 0;
+    repeatCount = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_held_button_repeats_on_the_accelerating_schedule()
+{
+    registerPin(4);
+
+    mockSetPin(4, LOW);
+    unsigned long pressed_ms = millis();
+    runFor(1200);
+    mockSetPin(4, HIGH);
+    runFor(1000);
+
+    // a timer fires on the first tick past its due time, the schedule itself doesn't drift
+    const unsigned long expected[] = {400, 550, 670, 766, 843, 905, 955, 995, 1035, 1075, 1115, 1155, 1195};
+    const uint8_t count = sizeof(expected) / sizeof(expected[0]);
+
+    TEST_ASSERT_EQUAL_UINT32(count, repeatCount);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(pressed_ms + expected[i] + 1, repeatTimes[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, clickCount);
+}
+
+void test_release_before_the_first_repeat_is_a_click()
+{
+    registerPin(5);
+
+    mockSetPin(5, LOW);
+    runFor(300);
+    mockSetPin(5, HIGH);
+    runFor(1000);
+
+    TEST_ASSERT_EQUAL_UINT32(1, clickCount);
+    TEST_ASSERT_EQUAL_UINT32(0, repeatCount);
+}
+
+void test_short_tap_does_not_repeat()
+{
+    registerPin(6);
+
+    // the release falls inside the debounce window
+    mockSetPin(6, LOW);
+    runFor(70);
+    mockSetPin(6, HIGH);
+    runFor(10000);
+
+    TEST_ASSERT_EQUAL_UINT32(1, clickCount);
+    TEST_ASSERT_EQUAL_UINT32(0, repeatCount);
+}
+
+void test_lost_release_stops_the_repeat()
+{
+    registerPin(7);
+
+    mockSetPin(7, LOW);
+    runFor(600);
+    TEST_ASSERT_EQUAL_UINT32(2, repeatCount);
+
+    // the release never reaches the interrupt routine
+    detachInterrupt(7);
+    mockSetPin(7, HIGH);
+    runFor(10000);
+
+    TEST_ASSERT_EQUAL_UINT32(2, repeatCount);
+    TEST_ASSERT_EQUAL_UINT32(0, clickCount);
+}
+
+int main()
+{
+    mockReset();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_held_button_repeats_on_the_accelerating_schedule);
+    RUN_TEST(test_release_before_the_first_repeat_is_a_click);
+    RUN_TEST(test_short_tap_does_not_repeat);
+    RUN_TEST(test_lost_release_stops_the_repeat);
+    return UNITY_END();
+}
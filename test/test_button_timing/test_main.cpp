@@ -0,0 +1,255 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "buttons.h"
+#include "mock_hal.h"
+
+/*
+ * Edges are stamped in the interrupt routine, so gestures resolve the same
+ * way however late the loop gets to them. Every test uses its own pins, the
+ * handler table lives for the whole program. Edges inside the 100 ms
+ * debounce window are only picked up once the window is over.
+ */
+
+static uint32_t clickCount;
+static uint8_t lastMultiClick;
+static uint32_t holdCount;
+
+void countClick()
+{
+    clickCount++;
+}
+
+void recordMultiClick(uint8_t count)
+{
+    lastMultiClick = count;
+}
+
+void countHold()
+{
+    holdCount++;
+}
+
+void registerPin(uint8_t pin)
+{
+    onClick(pin, countClick);
+    onMultiClick(pin, recordMultiClick);
+    onPressHold(pin, countHold);
+}
+
+// move the clock without running the loop, as if it were blocked
+void stall(uint32_t ms)
+{
+    mockAdvanceMillis(ms);
+}
+
+// run the loop every millisecond for a while
+void runFor(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; i++)
+    {
+        mockAdvanceMillis(1);
+        buttonEventLoop();
+    }
+}
+
+// contact bounce: the pin flips back and forth every millisecond before settling
+void bounceTo(uint8_t pin, uint8_t level, uint8_t flips)
+{
+    for (uint8_t i = 0; i < flips; i++)
+    {
+        mockSetPin(pin, i % 2 ? !level : level);
+        mockAdvanceMillis(1);
+    }
+    mockSetPin(pin, level);
+}
+
+void setUp()
+{
+    clickCount = 0;
+    lastMultiClick = 0;
+    holdCount = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_double_click_drained_late_is_a_multi_click()
+{
+    registerPin(4);
+
+    mockSetPin(4, LOW);
+    stall(120);
+    mockSetPin(4, HIGH);
+    stall(150);
+    mockSetPin(4, LOW);
+    stall(120);
+    mockSetPin(4, HIGH);
+
+    // the loop only gets to the edges well after the window closed
+    stall(900);
+    buttonEventLoop();
+
+    TEST_ASSERT_EQUAL_UINT8(2, lastMultiClick);
+    TEST_ASSERT_EQUAL_UINT32(0, clickCount);
+}
+
+void test_clicks_further_apart_than_the_window_stay_single()
+{
+    registerPin(5);
+
+    mockSetPin(5, LOW);
+    stall(120);
+    mockSetPin(5, HIGH);
+    stall(420);
+    mockSetPin(5, LOW);
+    stall(120);
+    mockSetPin(5, HIGH);
+
+    // drained together, but the first window closed 120 ms before the second press
+    stall(900);
+    buttonEventLoop();
+
+    TEST_ASSERT_EQUAL_UINT32(2, clickCount);
+    TEST_ASSERT_EQUAL_UINT8(0, lastMultiClick);
+}
+
+void test_hold_drained_after_the_release_still_holds()
+{
+    registerPin(6);
+
+    mockSetPin(6, LOW);
+    stall(1200);
+    mockSetPin(6, HIGH);
+    stall(300);
+    buttonEventLoop();
+
+    TEST_ASSERT_EQUAL_UINT32(1, holdCount);
+    TEST_ASSERT_EQUAL_UINT32(0, clickCount);
+}
+
+void test_jittered_loop_resolves_a_click_one_tick_past_the_window()
+{
+    registerPin(7);
+    uint32_t seed = 3;
+
+    mockSetPin(7, LOW);
+    unsigned long pressed_ms = millis();
+    stall(120);
+    mockSetPin(7, HIGH);
+
+    unsigned long resolved_ms = 0;
+    while (clickCount == 0 && millis() < pressed_ms + 2000)
+    {
+        seed = seed * 1103515245 + 12345;
+        mockAdvanceMillis(1 + (seed >> 16) % 37);
+        buttonEventLoop();
+        resolved_ms = millis();
+    }
+
+    // 120 ms press, then the 300 ms multi-click window
+    TEST_ASSERT_GREATER_THAN(pressed_ms + 420, resolved_ms);
+    TEST_ASSERT_LESS_OR_EQUAL(pressed_ms + 420 + 37, resolved_ms);
+}
+
+void test_taps_shorter_than_the_debounce_window_click()
+{
+    onClick(8, countClick);
+
+    const uint32_t taps[] = {30, 60, 90};
+    for (uint32_t tap : taps)
+    {
+        clickCount = 0;
+
+        mockSetPin(8, LOW);
+        runFor(tap);
+        mockSetPin(8, HIGH);
+        runFor(500);
+
+        TEST_ASSERT_EQUAL_UINT32(1, clickCount);
+    }
+}
+
+void test_short_tap_on_a_hold_pin_is_a_click()
+{
+    onClick(9, countClick);
+    onPressHold(9, countHold);
+
+    mockSetPin(9, LOW);
+    runFor(80);
+    mockSetPin(9, HIGH);
+    runFor(1500);
+
+    TEST_ASSERT_EQUAL_UINT32(1, clickCount);
+    TEST_ASSERT_EQUAL_UINT32(0, holdCount);
+}
+
+void test_short_release_is_dated_to_the_last_bounce()
+{
+    registerPin(10);
+
+    // two 60 ms taps 150 ms apart, both releases fall inside the window
+    mockSetPin(10, LOW);
+    runFor(60);
+    mockSetPin(10, HIGH);
+    runFor(150);
+    mockSetPin(10, LOW);
+    runFor(60);
+    mockSetPin(10, HIGH);
+    runFor(1000);
+
+    TEST_ASSERT_EQUAL_UINT8(2, lastMultiClick);
+    TEST_ASSERT_EQUAL_UINT32(0, clickCount);
+}
+
+void test_bounces_settling_on_the_accepted_level_add_no_edges()
+{
+    onClick(11, countClick);
+    unsigned long before = buttonEdgeCount();
+
+    bounceTo(11, LOW, 5);
+    runFor(200);
+    bounceTo(11, HIGH, 5);
+    runFor(500);
+
+    TEST_ASSERT_EQUAL_UINT32(1, clickCount);
+    TEST_ASSERT_EQUAL_UINT32(2, buttonEdgeCount() - before);
+}
+
+void test_bouncy_tap_inside_the_window_clicks_once()
+{
+    onClick(12, countClick);
+
+    // the press bounces, the release and its bounce land inside the window
+    bounceTo(12, LOW, 5);
+    runFor(40);
+    bounceTo(12, HIGH, 4);
+    runFor(500);
+
+    TEST_ASSERT_EQUAL_UINT32(1, clickCount);
+
+    // a press straight after the window is its own click
+    mockSetPin(12, LOW);
+    runFor(120);
+    mockSetPin(12, HIGH);
+    runFor(500);
+
+    TEST_ASSERT_EQUAL_UINT32(2, clickCount);
+}
+
+int main()
+{
+    mockReset();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_double_click_drained_late_is_a_multi_click);
+    RUN_TEST(test_clicks_further_apart_than_the_window_stay_single);
+    RUN_TEST(test_hold_drained_after_the_release_still_holds);
+    RUN_TEST(test_jittered_loop_resolves_a_click_one_tick_past_the_window);
+    RUN_TEST(test_taps_shorter_than_the_debounce_window_click);
+    RUN_TEST(test_short_tap_on_a_hold_pin_is_a_click);
+    RUN_TEST(test_short_release_is_dated_to_the_last_bounce);
+    RUN_TEST(test_bounces_settling_on_the_accepted_level_add_no_edges);
+    RUN_TEST(test_bouncy_tap_inside_the_window_clicks_once);
+    return UNITY_END();
+}
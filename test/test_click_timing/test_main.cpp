@@ -0,0 +1,101 @@
+#include <unity.h>
+#include "click_timing.h"
+
+const uint16_t MIN_MS = 150;
+const uint16_t MAX_MS = 600;
+
+// bins are (600 + 15) / 16 = 38 ms wide, the window ends 40 ms past the percentile bin
+const uint16_t BIN_MS = 38;
+const uint16_t MARGIN_MS = 40;
+
+static ClickTiming timing;
+
+void setUp()
+{
+    clickTimingBegin(timing, 4, MIN_MS, MAX_MS, 300);
+}
+
+void tearDown()
+{
+}
+
+void test_valid_only_for_the_same_pin_and_bounds()
+{
+    TEST_ASSERT_TRUE(clickTimingValid(timing, 4, MIN_MS, MAX_MS));
+    TEST_ASSERT_FALSE(clickTimingValid(timing, 5, MIN_MS, MAX_MS));
+    TEST_ASSERT_FALSE(clickTimingValid(timing, 4, MIN_MS, 500));
+
+    ClickTiming blank = {};
+    TEST_ASSERT_FALSE(clickTimingValid(blank, 0, 0, 0));
+}
+
+void test_window_stays_put_until_enough_gaps()
+{
+    for (uint8_t i = 0; i < 7; i++)
+    {
+        TEST_ASSERT_FALSE(clickTimingAddGap(timing, 200));
+    }
+    TEST_ASSERT_EQUAL_UINT16(300, timing.window_ms);
+
+    TEST_ASSERT_TRUE(clickTimingAddGap(timing, 200));
+    TEST_ASSERT_EQUAL_UINT16(6 * BIN_MS + MARGIN_MS, timing.window_ms);
+}
+
+void test_gaps_past_the_largest_window_are_ignored()
+{
+    for (uint8_t i = 0; i < 20; i++)
+    {
+        TEST_ASSERT_FALSE(clickTimingAddGap(timing, 900));
+    }
+    TEST_ASSERT_EQUAL_UINT16(0, timing.samples);
+    TEST_ASSERT_EQUAL_UINT16(300, timing.window_ms);
+}
+
+void test_fast_clicker_is_clamped_to_the_smallest_window()
+{
+    for (uint8_t i = 0; i < 20; i++)
+    {
+        clickTimingAddGap(timing, 60);
+    }
+    TEST_ASSERT_EQUAL_UINT16(MIN_MS, timing.window_ms);
+}
+
+void test_window_covers_the_95th_percentile()
+{
+    // 19 quick gaps and one slow one: the slow one is the top 5 %
+    for (uint8_t i = 0; i < 19; i++)
+    {
+        clickTimingAddGap(timing, 200);
+    }
+    clickTimingAddGap(timing, 500);
+    TEST_ASSERT_EQUAL_UINT16(6 * BIN_MS + MARGIN_MS, timing.window_ms);
+
+    // one more slow one puts it inside
+    clickTimingAddGap(timing, 500);
+    TEST_ASSERT_EQUAL_UINT16(14 * BIN_MS + MARGIN_MS, timing.window_ms);
+}
+
+void test_full_bin_halves_the_histogram()
+{
+    for (uint16_t i = 0; i < 255; i++)
+    {
+        clickTimingAddGap(timing, 200);
+    }
+    TEST_ASSERT_EQUAL_UINT8(255, timing.bins[5]);
+
+    clickTimingAddGap(timing, 200);
+    TEST_ASSERT_EQUAL_UINT8(128, timing.bins[5]);
+    TEST_ASSERT_EQUAL_UINT16(128, timing.samples);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_valid_only_for_the_same_pin_and_bounds);
+    RUN_TEST(test_window_stays_put_until_enough_gaps);
+    RUN_TEST(test_gaps_past_the_largest_window_are_ignored);
+    RUN_TEST(test_fast_clicker_is_clamped_to_the_smallest_window);
+    RUN_TEST(test_window_covers_the_95th_percentile);
+    RUN_TEST(test_full_bin_halves_the_histogram);
+    return UNITY_END();
+}
@@ -0,0 +1,203 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "buttons.h"
+#include "mock_hal.h"
+
+/*
+ * The button pipeline across the wrap of the 32-bit micros(), 71 minutes
+ * after boot on the target. The clock starts a second before it, every
+ * test presses its button on the far side of a wrap. Every test uses its
+ * own pin, the handler table lives for the whole program.
+ */
+
+static uint32_t clickCount;
+static uint32_t multiClickCount;
+static uint32_t holdCount;
+static uint32_t repeatCount;
+static uint32_t comboCount;
+
+void countClick()
+{
+    clickCount++;
+}
+
+void countMultiClick(uint8_t count)
+{
+    if (count == 2)
+    {
+        multiClickCount++;
+    }
+}
+
+void countHold()
+{
+    holdCount++;
+}
+
+void countRepeat()
+{
+    repeatCount++;
+}
+
+void countCombo()
+{
+    comboCount++;
+}
+
+// run the loop every millisecond for a while
+void runFor(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; i++)
+    {
+        mockAdvanceMillis(1);
+        buttonEventLoop();
+    }
+}
+
+// run the loop until micros() is a little short of wrapping
+void runUntilBeforeWrap(uint32_t ms)
+{
+    while (micros() < 0xFFFFFFFFUL - ms * 1000UL)
+    {
+        mockAdvanceMillis(1);
+        buttonEventLoop();
+    }
+}
+
+void setUp()
+{
+    clickCount = 0;
+    multiClickCount = 0;
+    holdCount = 0;
+    repeatCount = 0;
+    comboCount = 0;
+
+    mockReset(MOCK_WRAP_START_US);
+}
+
+void tearDown()
+{
+}
+
+void test_click_across_the_wrap()
+{
+    onClick(4, countClick);
+    onPressHold(4, countHold);
+
+    runUntilBeforeWrap(50);
+    mockSetPin(4, LOW);
+    runFor(150);
+    mockSetPin(4, HIGH);
+    runFor(2000);
+
+    // the clock did wrap
+    TEST_ASSERT_LESS_THAN_UINT32(3000000, micros());
+    TEST_ASSERT_EQUAL_UINT32(1, clickCount);
+    TEST_ASSERT_EQUAL_UINT32(0, holdCount);
+}
+
+void test_hold_across_the_wrap()
+{
+    onClick(5, countClick);
+    onPressHold(5, countHold);
+
+    runUntilBeforeWrap(500);
+    mockSetPin(5, LOW);
+    runFor(900);
+    TEST_ASSERT_EQUAL_UINT32(0, holdCount);
+    runFor(200);
+    TEST_ASSERT_EQUAL_UINT32(1, holdCount);
+
+    mockSetPin(5, HIGH);
+    runFor(1000);
+    TEST_ASSERT_EQUAL_UINT32(0, clickCount);
+}
+
+void test_double_click_across_the_wrap()
+{
+    onClick(6, countClick);
+    onMultiClick(6, countMultiClick);
+
+    // the gap between the clicks spans the wrap
+    runUntilBeforeWrap(200);
+    mockSetPin(6, LOW);
+    runFor(120);
+    mockSetPin(6, HIGH);
+    runFor(150);
+    mockSetPin(6, LOW);
+    runFor(120);
+    mockSetPin(6, HIGH);
+    runFor(1000);
+
+    TEST_ASSERT_EQUAL_UINT32(1, multiClickCount);
+    TEST_ASSERT_EQUAL_UINT32(0, clickCount);
+}
+
+void test_bounce_across_the_wrap_is_still_ignored()
+{
+    onClick(7, countClick);
+
+    runUntilBeforeWrap(20);
+    mockSetPin(7, LOW);
+    runFor(40);
+
+    // a bounce past the wrap is still inside the debounce window of the press
+    mockSetPin(7, HIGH);
+    mockSetPin(7, LOW);
+    runFor(200);
+    mockSetPin(7, HIGH);
+    runFor(1000);
+
+    TEST_ASSERT_EQUAL_UINT32(1, clickCount);
+}
+
+void test_repeat_across_the_wrap()
+{
+    const RepeatCurve curve = {150, 40, 20};
+    onClick(8, countClick);
+    TEST_ASSERT_TRUE(onRepeat(8, 400, curve, countRepeat));
+
+    // repeats at 400, 550 and 670 ms, the second one lands past the wrap
+    runUntilBeforeWrap(500);
+    mockSetPin(8, LOW);
+    runFor(700);
+    mockSetPin(8, HIGH);
+    runFor(1000);
+
+    TEST_ASSERT_EQUAL_UINT32(3, repeatCount);
+    TEST_ASSERT_EQUAL_UINT32(0, clickCount);
+}
+
+void test_combo_hold_across_the_wrap()
+{
+    uint8_t pins[] = {9, 10};
+    onClick(9, countClick);
+    onClick(10, countClick);
+    onComboHold(pins, sizeof(pins), 1000, countCombo);
+
+    runUntilBeforeWrap(500);
+    mockSetPin(9, LOW);
+    mockSetPin(10, LOW);
+    runFor(900);
+    TEST_ASSERT_EQUAL_UINT32(0, comboCount);
+    runFor(200);
+    TEST_ASSERT_EQUAL_UINT32(1, comboCount);
+
+    mockSetPin(9, HIGH);
+    mockSetPin(10, HIGH);
+    runFor(1000);
+}
+
+int main()
+{
+    mockReset();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_click_across_the_wrap);
+    RUN_TEST(test_hold_across_the_wrap);
+    RUN_TEST(test_double_click_across_the_wrap);
+    RUN_TEST(test_bounce_across_the_wrap_is_still_ignored);
+    RUN_TEST(test_repeat_across_the_wrap);
+    RUN_TEST(test_combo_hold_across_the_wrap);
+    return UNITY_END();
+}
@@ -0,0 +1,132 @@
+#include <unity.h>
+#include "edge_queue.h"
+
+static EdgeQueue *queue;
+
+void setUp()
+{
+    queue = new EdgeQueue();
+}
+
+void tearDown()
+{
+    delete queue;
+}
+
+void test_starts_empty()
+{
+    EdgeEvent e;
+
+    TEST_ASSERT_EQUAL_UINT32(0, queue->size());
+    TEST_ASSERT_FALSE(queue->pop(e));
+    TEST_ASSERT_EQUAL_UINT32(0, queue->overflowCount());
+}
+
+void test_pops_what_was_pushed()
+{
+    EdgeEvent e;
+
+    TEST_ASSERT_TRUE(queue->push(4, 0, 1234));
+    TEST_ASSERT_EQUAL_UINT32(1, queue->size());
+
+    TEST_ASSERT_TRUE(queue->pop(e));
+    TEST_ASSERT_EQUAL_UINT8(4, e.pin);
+    TEST_ASSERT_EQUAL_UINT8(0, e.level);
+    TEST_ASSERT_EQUAL_UINT32(1234, e.time);
+    TEST_ASSERT_EQUAL_UINT32(0, queue->size());
+}
+
+void test_keeps_order_across_the_end_of_the_ring()
+{
+    EdgeEvent e;
+
+    // run the indexes past the end of the buffer a few times
+    for (uint32_t i = 0; i < EdgeQueue::CAPACITY * 3 + 5; i++)
+    {
+        TEST_ASSERT_TRUE(queue->push(i % 40, i & 1, i));
+        TEST_ASSERT_TRUE(queue->push((i + 1) % 40, (i + 1) & 1, i + 1));
+
+        TEST_ASSERT_TRUE(queue->pop(e));
+        TEST_ASSERT_EQUAL_UINT32(i, e.time);
+        TEST_ASSERT_TRUE(queue->pop(e));
+        TEST_ASSERT_EQUAL_UINT32(i + 1, e.time);
+        TEST_ASSERT_EQUAL_UINT8((i + 1) % 40, e.pin);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(0, queue->size());
+}
+
+void test_holds_capacity_edges()
+{
+    for (uint32_t i = 0; i < EdgeQueue::CAPACITY; i++)
+    {
+        TEST_ASSERT_TRUE(queue->push(1, 0, i));
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(EdgeQueue::CAPACITY, queue->size());
+    TEST_ASSERT_EQUAL_UINT32(0, queue->overflowCount());
+}
+
+void test_flood_drops_the_newest_edges_and_counts_them()
+{
+    EdgeEvent e;
+
+    // a bounce storm while the consumer is busy elsewhere
+    const uint32_t pushed = EdgeQueue::CAPACITY * 2 + 7;
+    uint32_t accepted = 0;
+    for (uint32_t i = 0; i < pushed; i++)
+    {
+        accepted += queue->push(i % 40, i & 1, 1000 + i);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(EdgeQueue::CAPACITY, accepted);
+    TEST_ASSERT_EQUAL_UINT32(pushed - EdgeQueue::CAPACITY, queue->overflowCount());
+    TEST_ASSERT_EQUAL_UINT32(EdgeQueue::CAPACITY, queue->size());
+
+    // what was kept comes out oldest first, nothing overwritten
+    for (uint32_t i = 0; i < EdgeQueue::CAPACITY; i++)
+    {
+        TEST_ASSERT_TRUE(queue->pop(e));
+        TEST_ASSERT_EQUAL_UINT32(1000 + i, e.time);
+        TEST_ASSERT_EQUAL_UINT8(i % 40, e.pin);
+        TEST_ASSERT_EQUAL_UINT8(i & 1, e.level);
+    }
+    TEST_ASSERT_FALSE(queue->pop(e));
+}
+
+void test_accepts_edges_again_once_drained()
+{
+    EdgeEvent e;
+
+    for (uint32_t i = 0; i <= EdgeQueue::CAPACITY; i++)
+    {
+        queue->push(2, 0, i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, queue->overflowCount());
+
+    TEST_ASSERT_TRUE(queue->pop(e));
+    TEST_ASSERT_TRUE(queue->push(2, 1, 500));
+    TEST_ASSERT_FALSE(queue->push(2, 0, 501));
+    TEST_ASSERT_EQUAL_UINT32(2, queue->overflowCount());
+
+    // the edge pushed after the drain is last in line
+    for (uint32_t i = 1; i < EdgeQueue::CAPACITY; i++)
+    {
+        TEST_ASSERT_TRUE(queue->pop(e));
+        TEST_ASSERT_EQUAL_UINT32(i, e.time);
+    }
+    TEST_ASSERT_TRUE(queue->pop(e));
+    TEST_ASSERT_EQUAL_UINT32(500, e.time);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_starts_empty);
+    RUN_TEST(test_pops_what_was_pushed);
+    RUN_TEST(test_keeps_order_across_the_end_of_the_ring);
+    RUN_TEST(test_holds_capacity_edges);
+    RUN_TEST(test_flood_drops_the_newest_edges_and_counts_them);
+    RUN_TEST(test_accepts_edges_again_once_drained);
+    return UNITY_END();
+}
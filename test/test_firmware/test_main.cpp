@@ -0,0 +1,216 @@
+#include <Arduino.h>
+#include <string.h>
+#include <unity.h>
+#include "battery.h"
+#include "mock_hal.h"
+
+/*
+ * The firmware in main.cpp run against the simulated HAL, BLE link and
+ * serial port: setup() once, then loop() every millisecond. The tests run
+ * in order on the same boot, the clock starts 20 s before micros() wraps.
+ */
+
+void setup();
+void loop();
+
+const uint8_t PLAY_PAUSE = 15;
+const uint8_t VOL_UP = 18;
+const uint8_t VOL_DOWN = 19;
+const uint8_t VBAT_SENSE = 35;
+
+const uint8_t MEDIA_KEYS_ID = 2;
+const uint8_t VOLUME_ID = 3;
+
+// run the firmware's loop every millisecond for a while
+void runFor(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; i++)
+    {
+        mockAdvanceMillis(1);
+        loop();
+    }
+}
+
+void click(uint8_t pin)
+{
+    mockSetPin(pin, LOW);
+    runFor(120);
+    mockSetPin(pin, HIGH);
+}
+
+// the notifications of one report, in the order they went out
+std::vector<std::vector<uint8_t>> reports(uint8_t reportId)
+{
+    std::vector<std::vector<uint8_t>> sent;
+    for (const MockNotification &n : mockBleNotifications())
+    {
+        if (n.reportId == reportId && n.uuid == "2a4d")
+        {
+            sent.push_back(n.data);
+        }
+    }
+    return sent;
+}
+
+void setUp()
+{
+    mockBleClearNotifications();
+}
+
+void tearDown()
+{
+}
+
+void test_connecting_publishes_the_battery_and_asks_for_the_active_interval()
+{
+    mockBleConnect();
+    runFor(10);
+
+    TEST_ASSERT_EQUAL_UINT8(getBatteryChargeLevel(VBAT_SENSE), mockBleBatteryLevel());
+
+    // the predicted runtime goes out next to the level, -1 while it is unknown
+    bool runtimeSent = false;
+    for (const MockNotification &n : mockBleNotifications())
+    {
+        runtimeSent |= n.uuid == "6e0b4a3e-5f37-4c1e-9d8a-2f7c1b0e9a51" && n.data.size() == 4;
+    }
+    TEST_ASSERT_TRUE(runtimeSent);
+
+    const std::vector<MockConnParamsRequest> &requests = mockBleConnParamsRequests();
+    TEST_ASSERT_EQUAL_UINT32(1, requests.size());
+    TEST_ASSERT_EQUAL_UINT16(12, requests[0].minInterval);
+    TEST_ASSERT_EQUAL_UINT16(12, requests[0].maxInterval);
+    TEST_ASSERT_EQUAL_UINT16(12, mockBleConnInterval());
+}
+
+void test_play_pause_click_sends_the_media_key()
+{
+    click(PLAY_PAUSE);
+    runFor(500);
+
+    std::vector<std::vector<uint8_t>> sent = reports(MEDIA_KEYS_ID);
+    TEST_ASSERT_EQUAL_UINT32(2, sent.size());
+    TEST_ASSERT_EQUAL_UINT8(8, sent[0][0]);
+    TEST_ASSERT_EQUAL_UINT8(0, sent[1][0]);
+}
+
+void test_double_click_skips_to_the_next_track()
+{
+    click(PLAY_PAUSE);
+    runFor(120);
+    click(PLAY_PAUSE);
+    runFor(500);
+
+    std::vector<std::vector<uint8_t>> sent = reports(MEDIA_KEYS_ID);
+    TEST_ASSERT_EQUAL_UINT32(2, sent.size());
+    TEST_ASSERT_EQUAL_UINT8(1, sent[0][0]);
+}
+
+void test_volume_click_sends_one_relative_step()
+{
+    click(VOL_UP);
+    runFor(200);
+    click(VOL_DOWN);
+    runFor(200);
+
+    std::vector<std::vector<uint8_t>> sent = reports(VOLUME_ID);
+    TEST_ASSERT_EQUAL_UINT32(2, sent.size());
+    TEST_ASSERT_EQUAL_INT8(1, (int8_t)sent[0][0]);
+    TEST_ASSERT_EQUAL_INT8(-1, (int8_t)sent[1][0]);
+}
+
+void test_stats_command_prints_both_stats_lines()
+{
+    mockSerialOutput();
+    mockSerialInput("stats\n");
+    runFor(1);
+
+    std::string out = mockSerialOutput();
+    TEST_ASSERT_TRUE(out.find("\"edges\":") != std::string::npos);
+    TEST_ASSERT_TRUE(out.find("\"reports_sent\":") != std::string::npos);
+    TEST_ASSERT_TRUE(out.find("\"conn_interval\":12") != std::string::npos);
+}
+
+void test_click_across_the_micros_wrap()
+{
+    while (micros() < 0xFFFFFFFFUL - 50000)
+    {
+        runFor(1);
+    }
+
+    click(PLAY_PAUSE);
+    runFor(500);
+    TEST_ASSERT_LESS_THAN_UINT32(1000000, micros());
+
+    std::vector<std::vector<uint8_t>> sent = reports(MEDIA_KEYS_ID);
+    TEST_ASSERT_EQUAL_UINT32(2, sent.size());
+    TEST_ASSERT_EQUAL_UINT8(8, sent[0][0]);
+}
+
+void test_idle_link_drops_to_the_idle_interval()
+{
+    size_t before = mockBleConnParamsRequests().size();
+    runFor(61000);
+
+    const std::vector<MockConnParamsRequest> &requests = mockBleConnParamsRequests();
+    TEST_ASSERT_EQUAL_UINT32(before + 1, requests.size());
+    TEST_ASSERT_EQUAL_UINT16(96, requests.back().minInterval);
+    TEST_ASSERT_EQUAL_UINT16(120, requests.back().maxInterval);
+    TEST_ASSERT_EQUAL_UINT16(10, requests.back().latency);
+
+    // a button edge wakes the link up again before the click resolves
+    mockSetPin(VOL_UP, LOW);
+    runFor(2);
+    TEST_ASSERT_EQUAL_UINT32(before + 2, requests.size());
+    TEST_ASSERT_EQUAL_UINT16(12, mockBleConnInterval());
+    mockSetPin(VOL_UP, HIGH);
+    runFor(200);
+}
+
+void test_battery_sampler_reads_a_few_times_per_update()
+{
+    uint32_t before = mockAnalogReads();
+    runFor(120000);
+
+    // 16 reads per 5 minute update instead of one every 100 ms
+    TEST_ASSERT_UINT32_WITHIN(1, 120000 * 16 / 300000, mockAnalogReads() - before);
+
+    mockSerialOutput();
+    mockSerialInput("battery\n");
+    runFor(1);
+
+    std::string out = mockSerialOutput();
+    size_t at = out.find("\"adc_reads\":");
+    TEST_ASSERT_TRUE(at != std::string::npos);
+    TEST_ASSERT_EQUAL_UINT32(mockAnalogReads(), strtoul(out.c_str() + at + 12, NULL, 10));
+}
+
+void test_sleep_combo_goes_to_deep_sleep()
+{
+    mockSetPin(PLAY_PAUSE, LOW);
+    mockSetPin(VOL_DOWN, LOW);
+    runFor(1100);
+    mockSetPin(PLAY_PAUSE, HIGH);
+    mockSetPin(VOL_DOWN, HIGH);
+
+    TEST_ASSERT_EQUAL_UINT32(1, mockSleeps());
+}
+
+int main()
+{
+    mockReset(MOCK_WRAP_START_US - 19000000);
+    mockSetAnalogValue(VBAT_SENSE, 2300);
+    setup();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_connecting_publishes_the_battery_and_asks_for_the_active_interval);
+    RUN_TEST(test_play_pause_click_sends_the_media_key);
+    RUN_TEST(test_double_click_skips_to_the_next_track);
+    RUN_TEST(test_volume_click_sends_one_relative_step);
+    RUN_TEST(test_stats_command_prints_both_stats_lines);
+    RUN_TEST(test_click_across_the_micros_wrap);
+    RUN_TEST(test_idle_link_drops_to_the_idle_interval);
+    RUN_TEST(test_battery_sampler_reads_a_few_times_per_update);
+    RUN_TEST(test_sleep_combo_goes_to_deep_sleep);
+    return UNITY_END();
+}
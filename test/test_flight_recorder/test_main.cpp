@@ -0,0 +1,265 @@
+#include <Arduino.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include "buttons.h"
+#include "flight_recorder.h"
+#include "flight_replay.h"
+#include "mock_hal.h"
+
+/*
+ * Round trip of the flight recorder: a session is recorded, dumped,
+ * decoded on the host and its edges replayed through the simulated pins,
+ * which must record the same entries again.
+ *
+ * With FLIGHT_DUMP set to the "FLIGHT ..." line of a device's dump, the
+ * dump is replayed through the firmware instead, and both the decoded
+ * records and the ones the replay recorded are listed.
+ */
+
+void setup();
+void loop();
+
+const uint8_t BOUNCY = 4;
+const uint8_t CLEAN = 5;
+
+static uint32_t clicks;
+static uint32_t multiClicks;
+static uint32_t holds;
+
+void countClick()
+{
+    clicks++;
+}
+
+void countMultiClick(uint8_t)
+{
+    multiClicks++;
+}
+
+void countHold()
+{
+    holds++;
+}
+
+std::vector<FlightRecord> dump()
+{
+    MockPrint out;
+    flightRecorderDump(out);
+
+    std::vector<FlightRecord> records;
+    TEST_ASSERT_TRUE(decodeFlightDump(out.text, records));
+    return records;
+}
+
+// the records from the last boot on
+std::vector<FlightRecord> lastBoot(const std::vector<FlightRecord> &records)
+{
+    size_t boot = 0;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        if (records[i].kind == FLIGHT_BOOT)
+        {
+            boot = i;
+        }
+    }
+    return std::vector<FlightRecord>(records.begin() + boot, records.end());
+}
+
+void runMillis(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; i++)
+    {
+        mockAdvance(1000);
+        buttonEventLoop();
+    }
+}
+
+// a pin change part way into the next loop period
+void edgeAt(uint32_t us, uint8_t pin, uint8_t level)
+{
+    mockAdvance(us);
+    mockSetPin(pin, level);
+    mockAdvance(1000 - us);
+    buttonEventLoop();
+}
+
+void setUp()
+{
+    clicks = multiClicks = holds = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_dump_decodes_to_the_entries_recorded()
+{
+    flightRecorderBegin(3);
+    uint32_t start = micros();
+    flightRecord(FLIGHT_EDGE, 4, LOW, 0, start + 1500);
+    flightRecord(FLIGHT_GESTURE, 4, 2, 3, start + 400000);
+    flightRecord(FLIGHT_SEND, 18, 1, (uint8_t)-2, start + 400100);
+
+    std::vector<FlightRecord> records = lastBoot(dump());
+    TEST_ASSERT_EQUAL_UINT32(4, records.size());
+
+    TEST_ASSERT_EQUAL_UINT8(FLIGHT_BOOT, records[0].kind);
+    TEST_ASSERT_EQUAL_UINT8(3, records[0].detail);
+
+    TEST_ASSERT_EQUAL_INT32(1500, records[1].delta_us);
+    TEST_ASSERT_EQUAL_UINT8(FLIGHT_EDGE, records[1].kind);
+    TEST_ASSERT_EQUAL_UINT8(4, records[1].pin);
+
+    TEST_ASSERT_EQUAL_INT32(398500, records[2].delta_us);
+    TEST_ASSERT_EQUAL_UINT8(2, records[2].detail);
+    TEST_ASSERT_EQUAL_UINT8(3, records[2].extra);
+
+    TEST_ASSERT_EQUAL_INT32(100, records[3].delta_us);
+    TEST_ASSERT_EQUAL_INT8(-2, (int8_t)records[3].extra);
+}
+
+void test_dump_of_a_full_ring_starts_at_the_oldest_entry()
+{
+    flightRecorderBegin(0);
+    for (uint8_t i = 0; i < 200; i++)
+    {
+        flightRecord(FLIGHT_SEND, 18, 1, i, micros() + i);
+    }
+
+    std::vector<FlightRecord> records = dump();
+    TEST_ASSERT_EQUAL_UINT32(128, records.size());
+    for (uint8_t i = 0; i < 128; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(72 + i, records[i].extra);
+    }
+}
+
+void test_incomplete_dump_is_rejected()
+{
+    std::vector<FlightRecord> records;
+    TEST_ASSERT_FALSE(decodeFlightDump("", records));
+    TEST_ASSERT_FALSE(decodeFlightDump("FLIGHT 2 0100000001040000", records));
+    TEST_ASSERT_FALSE(decodeFlightDump("FLIGHT 1 01000000010400zz", records));
+    TEST_ASSERT_TRUE(decodeFlightDump("[12:00:01] FLIGHT 1 0100000001040000", records));
+    TEST_ASSERT_EQUAL_UINT8(FLIGHT_EDGE, records[0].kind);
+}
+
+void test_replayed_session_records_the_same_entries()
+{
+    onClick(CLEAN, countClick);
+    onMultiClick(BOUNCY, countMultiClick);
+    onPressHold(BOUNCY, countHold);
+
+    // a double click on a bouncing switch, a hold and a clean click
+    flightRecorderBegin(0);
+    runMillis(3);
+    edgeAt(120, BOUNCY, LOW);
+    edgeAt(80, BOUNCY, HIGH);
+    edgeAt(310, BOUNCY, LOW);
+    runMillis(90);
+    edgeAt(450, BOUNCY, HIGH);
+    edgeAt(60, BOUNCY, LOW);
+    edgeAt(200, BOUNCY, HIGH);
+    runMillis(150);
+    edgeAt(730, BOUNCY, LOW);
+    runMillis(100);
+    edgeAt(20, BOUNCY, HIGH);
+    runMillis(600);
+    edgeAt(990, BOUNCY, LOW);
+    runMillis(1200);
+    edgeAt(510, BOUNCY, HIGH);
+    runMillis(400);
+    edgeAt(5, CLEAN, LOW);
+    runMillis(110);
+    edgeAt(999, CLEAN, HIGH);
+    runMillis(1000);
+
+    std::vector<FlightRecord> recorded = lastBoot(dump());
+    uint32_t recordedClicks = clicks;
+    uint32_t recordedMultiClicks = multiClicks;
+    uint32_t recordedHolds = holds;
+    TEST_ASSERT_EQUAL_UINT32(1, recordedClicks);
+    TEST_ASSERT_EQUAL_UINT32(1, recordedMultiClicks);
+    TEST_ASSERT_EQUAL_UINT32(1, recordedHolds);
+
+    clicks = multiClicks = holds = 0;
+    uint32_t boot_us = micros();
+    flightRecorderBegin(0);
+    uint32_t edges = replayFlightEdges(recorded, boot_us, buttonEventLoop, 1000, 1000000);
+    std::vector<FlightRecord> replayed = lastBoot(dump());
+
+    uint32_t recordedEdges = 0;
+    for (const FlightRecord &r : recorded)
+    {
+        recordedEdges += r.kind == FLIGHT_EDGE;
+    }
+    TEST_ASSERT_EQUAL_UINT32(recordedEdges, edges);
+    TEST_ASSERT_EQUAL_UINT32(recordedClicks, clicks);
+    TEST_ASSERT_EQUAL_UINT32(recordedMultiClicks, multiClicks);
+    TEST_ASSERT_EQUAL_UINT32(recordedHolds, holds);
+
+    // the replay lasts until a second after the last edge, the session a
+    // second after the last edge too, so every entry lines up
+    TEST_ASSERT_EQUAL_UINT32(recorded.size(), replayed.size());
+    TEST_ASSERT_EQUAL_MEMORY(recorded.data(), replayed.data(), recorded.size() * sizeof(FlightRecord));
+}
+
+void test_listing_has_times_since_boot()
+{
+    std::vector<FlightRecord> records = {{-5000, FLIGHT_SEND, 18, 1, 1}, {7, FLIGHT_BOOT, 0, 2, 0},
+                                         {1500, FLIGHT_EDGE, 15, 0, 0}, {2500, FLIGHT_EDGE, 15, 1, 0}};
+
+    MockPrint out;
+    printFlightRecords(records, out);
+    TEST_ASSERT_EQUAL_STRING("     -5000 send    pin=18 detail=1 extra=1\n"
+                             "         0 boot    pin=0 detail=2 extra=0\n"
+                             "      1500 edge    pin=15 detail=0 extra=0\n"
+                             "      4000 edge    pin=15 detail=1 extra=0\n",
+                             out.text.c_str());
+}
+
+// replay a dump from a device through the firmware and list what it did
+int replayDeviceDump(const char *line)
+{
+    std::vector<FlightRecord> records;
+    if (!decodeFlightDump(line, records))
+    {
+        printf("FLIGHT_DUMP is not a complete dump\n");
+        return 1;
+    }
+
+    MockPrint out;
+    printFlightRecords(records, out);
+    printf("recorded on the device:\n%s", out.text.c_str());
+
+    uint32_t boot_us = micros();
+    setup();
+    replayFlightEdges(records, boot_us, loop, 1000, 2000000);
+
+    MockPrint replayed;
+    flightRecorderDump(replayed);
+    decodeFlightDump(replayed.text, records);
+    out.text.clear();
+    printFlightRecords(lastBoot(records), out);
+    printf("replayed:\n%s", out.text.c_str());
+    return 0;
+}
+
+int main()
+{
+    mockReset();
+
+    if (getenv("FLIGHT_DUMP") != NULL)
+    {
+        return replayDeviceDump(getenv("FLIGHT_DUMP"));
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_dump_decodes_to_the_entries_recorded);
+    RUN_TEST(test_dump_of_a_full_ring_starts_at_the_oldest_entry);
+    RUN_TEST(test_incomplete_dump_is_rejected);
+    RUN_TEST(test_replayed_session_records_the_same_entries);
+    RUN_TEST(test_listing_has_times_since_boot);
+    return UNITY_END();
+}
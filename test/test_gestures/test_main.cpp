@@ -0,0 +1,250 @@
+#include <unity.h>
+#include "gestures.h"
+
+const uint8_t CLICK_ONLY = 0;
+const uint8_t MULTI_CLICK_HOLD = GESTURE_PROFILE_MULTI_CLICK | GESTURE_PROFILE_PRESS_HOLD;
+
+const uint32_t SCHEDULE[GESTURE_REPEAT_STEPS] = {400000, 150000, 120000, 96000, 77000, 77000, 77000, 77000,
+                                                 77000, 77000, 77000, 77000, 77000, 77000, 77000, 77000};
+
+static GestureSlot slot;
+
+void setUp()
+{
+    slot = {};
+    slot.repeatSchedule = SCHEDULE;
+}
+
+void tearDown()
+{
+}
+
+GestureAction press(uint8_t profile, uint32_t ms)
+{
+    return gestureStep(slot, profile, GESTURE_INPUT_PRESS, ms * 1000);
+}
+
+GestureAction release(uint8_t profile, uint32_t ms)
+{
+    return gestureStep(slot, profile, GESTURE_INPUT_RELEASE, ms * 1000);
+}
+
+GestureAction tick(uint8_t profile, uint32_t ms)
+{
+    return gestureStep(slot, profile, GESTURE_INPUT_TIMER, ms * 1000);
+}
+
+void test_click_only_resolves_on_release()
+{
+    TEST_ASSERT_EQUAL(GESTURE_NONE, press(CLICK_ONLY, 10));
+    TEST_ASSERT_EQUAL(GESTURE_NONE, tick(CLICK_ONLY, 50));
+    TEST_ASSERT_EQUAL(GESTURE_CLICK, release(CLICK_ONLY, 90));
+    TEST_ASSERT_EQUAL(GESTURE_IDLE, slot.state);
+}
+
+void test_single_click_waits_out_the_multi_click_window()
+{
+    press(MULTI_CLICK_HOLD, 0);
+    TEST_ASSERT_EQUAL(GESTURE_NONE, release(MULTI_CLICK_HOLD, 80));
+
+    // the window is 300 ms after the release
+    TEST_ASSERT_EQUAL(GESTURE_NONE, tick(MULTI_CLICK_HOLD, 380));
+    TEST_ASSERT_EQUAL(GESTURE_CLICK, tick(MULTI_CLICK_HOLD, 381));
+    TEST_ASSERT_EQUAL(GESTURE_IDLE, slot.state);
+}
+
+void test_presses_within_the_window_count_as_one_multi_click()
+{
+    press(MULTI_CLICK_HOLD, 0);
+    release(MULTI_CLICK_HOLD, 80);
+    press(MULTI_CLICK_HOLD, 250);
+    release(MULTI_CLICK_HOLD, 330);
+    press(MULTI_CLICK_HOLD, 500);
+    release(MULTI_CLICK_HOLD, 560);
+
+    TEST_ASSERT_EQUAL(GESTURE_NONE, tick(MULTI_CLICK_HOLD, 700));
+    TEST_ASSERT_EQUAL(GESTURE_MULTI_CLICK, tick(MULTI_CLICK_HOLD, 861));
+    TEST_ASSERT_EQUAL_UINT8(3, slot.clicks);
+}
+
+void test_window_can_be_overridden()
+{
+    slot.multiClickWindow_us = 150000;
+
+    press(MULTI_CLICK_HOLD, 0);
+    release(MULTI_CLICK_HOLD, 80);
+
+    TEST_ASSERT_EQUAL(GESTURE_CLICK, tick(MULTI_CLICK_HOLD, 231));
+}
+
+void test_hold_resolves_once_the_press_outlasts_the_threshold()
+{
+    press(MULTI_CLICK_HOLD, 0);
+
+    TEST_ASSERT_EQUAL(GESTURE_NONE, tick(MULTI_CLICK_HOLD, 1000));
+    TEST_ASSERT_EQUAL(GESTURE_HOLD, tick(MULTI_CLICK_HOLD, 1001));
+    TEST_ASSERT_EQUAL(GESTURE_HELD, slot.state);
+
+    // the release after a hold is not a click
+    TEST_ASSERT_EQUAL(GESTURE_NONE, release(MULTI_CLICK_HOLD, 1500));
+    TEST_ASSERT_EQUAL(GESTURE_NONE, tick(MULTI_CLICK_HOLD, 3000));
+}
+
+void test_hold_after_a_click_is_dropped()
+{
+    press(MULTI_CLICK_HOLD, 0);
+    release(MULTI_CLICK_HOLD, 80);
+    press(MULTI_CLICK_HOLD, 200);
+
+    TEST_ASSERT_EQUAL(GESTURE_NONE, tick(MULTI_CLICK_HOLD, 1300));
+    TEST_ASSERT_EQUAL(GESTURE_HELD, slot.state);
+}
+
+void test_repeat_follows_the_schedule()
+{
+    press(GESTURE_PROFILE_REPEAT, 0);
+
+    TEST_ASSERT_EQUAL(GESTURE_NONE, tick(GESTURE_PROFILE_REPEAT, 400));
+    TEST_ASSERT_EQUAL(GESTURE_REPEAT, tick(GESTURE_PROFILE_REPEAT, 401));
+    TEST_ASSERT_EQUAL(GESTURE_NONE, tick(GESTURE_PROFILE_REPEAT, 550));
+    TEST_ASSERT_EQUAL(GESTURE_REPEAT, tick(GESTURE_PROFILE_REPEAT, 551));
+    TEST_ASSERT_EQUAL(GESTURE_REPEAT, tick(GESTURE_PROFILE_REPEAT, 671));
+    TEST_ASSERT_EQUAL_UINT8(3, slot.clicks);
+
+    TEST_ASSERT_EQUAL(GESTURE_NONE, release(GESTURE_PROFILE_REPEAT, 700));
+    TEST_ASSERT_EQUAL(GESTURE_IDLE, slot.state);
+}
+
+void test_short_press_on_a_repeat_pin_clicks()
+{
+    press(GESTURE_PROFILE_REPEAT, 0);
+
+    TEST_ASSERT_EQUAL(GESTURE_CLICK, release(GESTURE_PROFILE_REPEAT, 120));
+}
+
+void test_timer_due_leaves_the_slot_alone()
+{
+    press(GESTURE_PROFILE_REPEAT, 0);
+
+    TEST_ASSERT_FALSE(gestureTimerDue(slot, GESTURE_PROFILE_REPEAT, 400000));
+    TEST_ASSERT_TRUE(gestureTimerDue(slot, GESTURE_PROFILE_REPEAT, 401000));
+    TEST_ASSERT_EQUAL(GESTURE_PRESSED, slot.state);
+
+    // held and idle slots have no timer
+    slot.state = GESTURE_HELD;
+    TEST_ASSERT_FALSE(gestureTimerDue(slot, GESTURE_PROFILE_REPEAT, 5000000));
+}
+
+void test_cancel_ignores_everything_until_the_next_press()
+{
+    press(MULTI_CLICK_HOLD, 0);
+    gestureCancel(slot);
+
+    TEST_ASSERT_EQUAL(GESTURE_NONE, release(MULTI_CLICK_HOLD, 80));
+    TEST_ASSERT_EQUAL(GESTURE_NONE, tick(MULTI_CLICK_HOLD, 2000));
+
+    press(MULTI_CLICK_HOLD, 3000);
+    release(MULTI_CLICK_HOLD, 3080);
+    TEST_ASSERT_EQUAL(GESTURE_CLICK, tick(MULTI_CLICK_HOLD, 3381));
+}
+
+// loop ticks that arrive 1-37 ms apart, like a loop that blocks on BLE now and then
+static uint32_t jitteredTick(uint32_t &seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return 1 + (seed >> 16) % 37;
+}
+
+void test_jittered_ticks_resolve_on_the_first_tick_past_the_window()
+{
+    uint32_t seed = 7;
+
+    for (uint8_t round = 0; round < 50; round++)
+    {
+        setUp();
+        press(MULTI_CLICK_HOLD, 0);
+        release(MULTI_CLICK_HOLD, 80);
+
+        uint32_t resolvedAt = 0;
+        for (uint32_t t = 80; resolvedAt == 0; t += jitteredTick(seed))
+        {
+            if (tick(MULTI_CLICK_HOLD, t) == GESTURE_CLICK)
+            {
+                resolvedAt = t;
+            }
+        }
+
+        // never early, and no later than one tick past the 300 ms window
+        TEST_ASSERT_GREATER_THAN(380, resolvedAt);
+        TEST_ASSERT_LESS_OR_EQUAL(380 + 37, resolvedAt);
+    }
+}
+
+void test_late_tick_after_a_second_press_keeps_the_multi_click()
+{
+    press(MULTI_CLICK_HOLD, 0);
+    release(MULTI_CLICK_HOLD, 80);
+
+    // the loop stalls, the second press comes in before the window closes
+    // and is fed before any tick. Only then does the late tick arrive.
+    press(MULTI_CLICK_HOLD, 300);
+    release(MULTI_CLICK_HOLD, 360);
+    TEST_ASSERT_EQUAL(GESTURE_NONE, tick(MULTI_CLICK_HOLD, 361));
+
+    TEST_ASSERT_EQUAL(GESTURE_MULTI_CLICK, tick(MULTI_CLICK_HOLD, 900));
+    TEST_ASSERT_EQUAL_UINT8(2, slot.clicks);
+}
+
+void test_tick_sampled_before_a_queued_edge_is_not_elapsed()
+{
+    // now is sampled, then an edge stamped a little later is classified,
+    // then the tick with the older now arrives
+    press(MULTI_CLICK_HOLD, 0);
+    release(MULTI_CLICK_HOLD, 1500);
+
+    TEST_ASSERT_EQUAL(GESTURE_NONE, tick(MULTI_CLICK_HOLD, 1490));
+    TEST_ASSERT_EQUAL(GESTURE_RELEASED, slot.state);
+}
+
+void test_jittered_ticks_resolve_a_hold_in_time()
+{
+    uint32_t seed = 99;
+
+    for (uint8_t round = 0; round < 50; round++)
+    {
+        setUp();
+        press(MULTI_CLICK_HOLD, 0);
+
+        uint32_t resolvedAt = 0;
+        for (uint32_t t = 0; resolvedAt == 0; t += jitteredTick(seed))
+        {
+            if (tick(MULTI_CLICK_HOLD, t) == GESTURE_HOLD)
+            {
+                resolvedAt = t;
+            }
+        }
+
+        TEST_ASSERT_GREATER_THAN(1000, resolvedAt);
+        TEST_ASSERT_LESS_OR_EQUAL(1000 + 37, resolvedAt);
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_click_only_resolves_on_release);
+    RUN_TEST(test_single_click_waits_out_the_multi_click_window);
+    RUN_TEST(test_presses_within_the_window_count_as_one_multi_click);
+    RUN_TEST(test_window_can_be_overridden);
+    RUN_TEST(test_hold_resolves_once_the_press_outlasts_the_threshold);
+    RUN_TEST(test_hold_after_a_click_is_dropped);
+    RUN_TEST(test_repeat_follows_the_schedule);
+    RUN_TEST(test_short_press_on_a_repeat_pin_clicks);
+    RUN_TEST(test_timer_due_leaves_the_slot_alone);
+    RUN_TEST(test_cancel_ignores_everything_until_the_next_press);
+    RUN_TEST(test_jittered_ticks_resolve_on_the_first_tick_past_the_window);
+    RUN_TEST(test_late_tick_after_a_second_press_keeps_the_multi_click);
+    RUN_TEST(test_tick_sampled_before_a_queued_edge_is_not_elapsed);
+    RUN_TEST(test_jittered_ticks_resolve_a_hold_in_time);
+    return UNITY_END();
+}
@@ -0,0 +1,144 @@
+#include <unity.h>
+#include "HidDescriptor.h"
+
+const uint8_t INPUT_TAG = 0x80;
+const uint8_t OUTPUT_TAG = 0x90;
+
+// boot keyboard, report ID 1: modifiers, a reserved byte, the LED output and six keys
+static constexpr auto KEYBOARD = hidDescriptor(
+    0x05, 0x01, // USAGE_PAGE (Generic Desktop Ctrls)
+    0x09, 0x06, // USAGE (Keyboard)
+    0xA1, 0x01, // COLLECTION (Application)
+    0x85, 0x01, //   REPORT_ID (1)
+    0x05, 0x07, //   USAGE_PAGE (Kbrd/Keypad)
+    0x19, 0xE0, //   USAGE_MINIMUM (0xE0)
+    0x29, 0xE7, //   USAGE_MAXIMUM (0xE7)
+    0x15, 0x00, //   LOGICAL_MINIMUM (0)
+    0x25, 0x01, //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01, //   REPORT_SIZE (1)
+    0x95, 0x08, //   REPORT_COUNT (8)
+    0x81, 0x02, //   INPUT (Data,Var,Abs)
+    0x95, 0x01, //   REPORT_COUNT (1)
+    0x75, 0x08, //   REPORT_SIZE (8)
+    0x81, 0x01, //   INPUT (Const)
+    0x95, 0x05, //   REPORT_COUNT (5)
+    0x75, 0x01, //   REPORT_SIZE (1)
+    0x05, 0x08, //   USAGE_PAGE (LEDs)
+    0x19, 0x01, //   USAGE_MINIMUM (Num Lock)
+    0x29, 0x05, //   USAGE_MAXIMUM (Kana)
+    0x91, 0x02, //   OUTPUT (Data,Var,Abs)
+    0x95, 0x01, //   REPORT_COUNT (1)
+    0x75, 0x03, //   REPORT_SIZE (3)
+    0x91, 0x01, //   OUTPUT (Const)
+    0x95, 0x06, //   REPORT_COUNT (6)
+    0x75, 0x08, //   REPORT_SIZE (8)
+    0x15, 0x00, //   LOGICAL_MINIMUM (0)
+    0x25, 0x65, //   LOGICAL_MAXIMUM (0x65)
+    0x05, 0x07, //   USAGE_PAGE (Kbrd/Keypad)
+    0x19, 0x00, //   USAGE_MINIMUM (0)
+    0x29, 0x65, //   USAGE_MAXIMUM (0x65)
+    0x81, 0x00, //   INPUT (Data,Array,Abs)
+    0xC0        // END_COLLECTION
+);
+
+// consumer control, report ID 2: 16 one bit usages. Leaves REPORT_SIZE (1) behind for the next collection.
+static constexpr auto CONSUMER = hidDescriptor(
+    0x05, 0x0C, // USAGE_PAGE (Consumer)
+    0x09, 0x01, // USAGE (Consumer Control)
+    0xA1, 0x01, // COLLECTION (Application)
+    0x85, 0x02, //   REPORT_ID (2)
+    0x15, 0x00, //   LOGICAL_MINIMUM (0)
+    0x25, 0x01, //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01, //   REPORT_SIZE (1)
+    0x95, 0x10, //   REPORT_COUNT (16)
+    0x81, 0x02, //   INPUT (Data,Var,Abs)
+    0xC0        // END_COLLECTION
+);
+
+// system control, report ID 3: relies on the REPORT_SIZE (1) it inherits
+static constexpr auto SYSTEM_CONTROL = hidDescriptor(
+    0x05, 0x01, // USAGE_PAGE (Generic Desktop Ctrls)
+    0x09, 0x80, // USAGE (System Control)
+    0xA1, 0x01, // COLLECTION (Application)
+    0x85, 0x03, //   REPORT_ID (3)
+    0x95, 0x08, //   REPORT_COUNT (8)
+    0x81, 0x02, //   INPUT (Data,Var,Abs)
+    0xC0        // END_COLLECTION
+);
+
+static constexpr auto FULL = hidCollection<true>(KEYBOARD) + hidCollection<true>(CONSUMER) + hidCollection<true>(SYSTEM_CONTROL);
+static constexpr auto CONSUMER_ONLY = hidCollection<false>(KEYBOARD) + hidCollection<true>(CONSUMER) + hidCollection<false>(SYSTEM_CONTROL);
+
+// the checks BleKeyboard makes have to hold at compile time
+static_assert(hidReportBits(KEYBOARD, 1, INPUT_TAG) == 64, "boot keyboard input is 8 bytes");
+static_assert(FULL.size == KEYBOARD.size + CONSUMER.size + SYSTEM_CONTROL.size, "joined size");
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_bytes_are_kept_in_order()
+{
+    constexpr auto d = hidDescriptor(0x05, 0x01, 0xC0);
+
+    TEST_ASSERT_EQUAL_UINT32(3, d.size);
+    TEST_ASSERT_EQUAL_HEX8(0x05, d.data[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x01, d.data[1]);
+    TEST_ASSERT_EQUAL_HEX8(0xC0, d.data[2]);
+}
+
+void test_joined_descriptors_are_concatenated()
+{
+    TEST_ASSERT_EQUAL_MEMORY(KEYBOARD.data, FULL.data, KEYBOARD.size);
+    TEST_ASSERT_EQUAL_MEMORY(CONSUMER.data, FULL.data + KEYBOARD.size, CONSUMER.size);
+    TEST_ASSERT_EQUAL_MEMORY(SYSTEM_CONTROL.data, FULL.data + KEYBOARD.size + CONSUMER.size, SYSTEM_CONTROL.size);
+}
+
+void test_disabled_collections_are_left_out()
+{
+    TEST_ASSERT_EQUAL_UINT32(0, decltype(hidCollection<false>(KEYBOARD))::size);
+    TEST_ASSERT_EQUAL_UINT32(CONSUMER.size, CONSUMER_ONLY.size);
+    TEST_ASSERT_EQUAL_MEMORY(CONSUMER.data, CONSUMER_ONLY.data, CONSUMER.size);
+}
+
+void test_report_bits_are_counted_per_id_and_direction()
+{
+    TEST_ASSERT_EQUAL_UINT32(64, hidReportBits(FULL, 1, INPUT_TAG));
+    TEST_ASSERT_EQUAL_UINT32(8, hidReportBits(FULL, 1, OUTPUT_TAG));
+    TEST_ASSERT_EQUAL_UINT32(16, hidReportBits(FULL, 2, INPUT_TAG));
+    TEST_ASSERT_EQUAL_UINT32(0, hidReportBits(FULL, 2, OUTPUT_TAG));
+    TEST_ASSERT_EQUAL_UINT32(0, hidReportBits(FULL, 4, INPUT_TAG));
+}
+
+void test_global_items_carry_over_between_collections()
+{
+    // REPORT_SIZE (1) from the consumer collection
+    TEST_ASSERT_EQUAL_UINT32(8, hidReportBits(FULL, 3, INPUT_TAG));
+
+    // alone it has no report size, so the host would see an empty report
+    TEST_ASSERT_EQUAL_UINT32(0, hidReportBits(SYSTEM_CONTROL, 3, INPUT_TAG));
+}
+
+void test_long_items_are_skipped_whole()
+{
+    // a four byte LOGICAL_MAXIMUM whose data looks like an INPUT item
+    constexpr auto d = hidDescriptor(0x85, 0x01, 0x75, 0x08, 0x95, 0x02, 0x27, 0x81, 0x02, 0x81, 0x02, 0x81, 0x02);
+
+    TEST_ASSERT_EQUAL_UINT32(16, hidReportBits(d, 1, INPUT_TAG));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_bytes_are_kept_in_order);
+    RUN_TEST(test_joined_descriptors_are_concatenated);
+    RUN_TEST(test_disabled_collections_are_left_out);
+    RUN_TEST(test_report_bits_are_counted_per_id_and_direction);
+    RUN_TEST(test_global_items_carry_over_between_collections);
+    RUN_TEST(test_long_items_are_skipped_whole);
+    return UNITY_END();
+}
@@ -0,0 +1,196 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "buttons.h"
+#include "key_matrix.h"
+#include "mock_hal.h"
+
+/*
+ * A simulated 3x3 matrix wired to the mock GPIO. Without diodes current
+ * flows both ways through a pressed key, so a driven row pulls down every
+ * column it reaches through any chain of pressed keys, which is what makes
+ * the fourth corner of a rectangle read as pressed.
+ */
+
+const uint8_t ROWS = 3;
+const uint8_t COLS = 3;
+const uint8_t ROW_PINS[ROWS] = {12, 13, 14};
+const uint8_t COL_PINS[COLS] = {25, 26, 27};
+
+static bool keyDown[ROWS][COLS];
+static bool wiredWithDiodes;
+
+uint64_t matrixLevels(uint64_t levels, uint64_t drivenLow)
+{
+    bool rowLow[ROWS] = {};
+    bool colLow[COLS] = {};
+    for (uint8_t r = 0; r < ROWS; r++)
+    {
+        rowLow[r] = (drivenLow >> ROW_PINS[r]) & 1;
+    }
+
+    // spread the low level through pressed keys until nothing changes
+    for (bool spread = true; spread;)
+    {
+        spread = false;
+        for (uint8_t r = 0; r < ROWS; r++)
+        {
+            for (uint8_t c = 0; c < COLS; c++)
+            {
+                if (!keyDown[r][c])
+                {
+                    continue;
+                }
+                if (rowLow[r] && !colLow[c])
+                {
+                    colLow[c] = spread = true;
+                }
+                // a diode only lets the row pull the column down
+                if (!wiredWithDiodes && colLow[c] && !rowLow[r])
+                {
+                    rowLow[r] = spread = true;
+                }
+            }
+        }
+    }
+
+    for (uint8_t c = 0; c < COLS; c++)
+    {
+        if (colLow[c])
+        {
+            levels &= ~((uint64_t)1 << COL_PINS[c]);
+        }
+    }
+    return levels;
+}
+
+uint32_t key(uint8_t row, uint8_t col)
+{
+    return (uint32_t)1 << (row * COLS + col);
+}
+
+static KeyMatrix matrix;
+
+void setUp()
+{
+    mockReset();
+    mockSetInputHook(matrixLevels);
+    memset(keyDown, 0, sizeof(keyDown));
+    wiredWithDiodes = false;
+
+    matrix = KeyMatrix();
+    matrix.begin(ROW_PINS, ROWS, COL_PINS, COLS, false);
+}
+
+void tearDown()
+{
+}
+
+void test_find_ghost_rows_flags_rectangles()
+{
+    // rows 0 and 2 share columns 1 and 3
+    const uint8_t rectangle[] = {0x0A, 0x01, 0x0B};
+    TEST_ASSERT_EQUAL_HEX8(0x05, findGhostRows(rectangle, 3));
+
+    // sharing a single column is a plain column of keys
+    const uint8_t column[] = {0x02, 0x02, 0x02};
+    TEST_ASSERT_EQUAL_HEX8(0x00, findGhostRows(column, 3));
+
+    // two columns on one row, nothing else
+    const uint8_t row[] = {0x00, 0x06, 0x00};
+    TEST_ASSERT_EQUAL_HEX8(0x00, findGhostRows(row, 3));
+
+    // two rectangles, one row in both
+    const uint8_t chain[] = {0x03, 0x03, 0x0C, 0x0C, 0x01};
+    TEST_ASSERT_EQUAL_HEX8(0x0F, findGhostRows(chain, 5));
+}
+
+void test_single_keys_read_where_they_are()
+{
+    keyDown[1][2] = true;
+    TEST_ASSERT_EQUAL_HEX32(key(1, 2), matrix.scan());
+
+    keyDown[0][0] = true;
+    keyDown[2][1] = true;
+    TEST_ASSERT_EQUAL_HEX32(key(1, 2) | key(0, 0) | key(2, 1), matrix.scan());
+}
+
+void test_rows_are_released_after_a_scan()
+{
+    keyDown[0][1] = true;
+    matrix.scan();
+
+    // no row left pulling its keys' columns down
+    for (uint8_t c = 0; c < COLS; c++)
+    {
+        TEST_ASSERT_EQUAL(HIGH, digitalRead(COL_PINS[c]));
+    }
+}
+
+void test_rectangle_without_diodes_keeps_the_last_good_rows()
+{
+    keyDown[0][0] = true;
+    keyDown[0][1] = true;
+    TEST_ASSERT_EQUAL_HEX32(key(0, 0) | key(0, 1), matrix.scan());
+
+    // the third corner makes (1, 1) read as pressed too, rows 0 and 1 are
+    // ambiguous and hold on to what they had
+    keyDown[1][0] = true;
+    TEST_ASSERT_EQUAL_HEX32(key(0, 0) | key(0, 1), matrix.scan());
+
+    // an unrelated row still reads normally
+    keyDown[2][2] = true;
+    TEST_ASSERT_EQUAL_HEX32(key(0, 0) | key(0, 1) | key(2, 2), matrix.scan());
+
+    // breaking the rectangle resolves both rows again
+    keyDown[0][1] = false;
+    TEST_ASSERT_EQUAL_HEX32(key(0, 0) | key(1, 0) | key(2, 2), matrix.scan());
+}
+
+void test_rectangle_with_diodes_is_trusted()
+{
+    wiredWithDiodes = true;
+    matrix = KeyMatrix();
+    matrix.begin(ROW_PINS, ROWS, COL_PINS, COLS, true);
+
+    keyDown[0][0] = true;
+    keyDown[0][1] = true;
+    keyDown[1][0] = true;
+    keyDown[1][1] = true;
+
+    TEST_ASSERT_EQUAL_HEX32(key(0, 0) | key(0, 1) | key(1, 0) | key(1, 1), matrix.scan());
+}
+
+static uint32_t clicks;
+
+void countClick()
+{
+    clicks++;
+}
+
+void test_matrix_key_clicks_through_the_scanner()
+{
+    clicks = 0;
+    TEST_ASSERT_TRUE(beginKeyMatrix(ROW_PINS, ROWS, COL_PINS, COLS));
+    onClick(matrixKey(2, 0), countClick);
+
+    mockAdvanceMillis(10);
+    keyDown[2][0] = true;
+    mockAdvanceMillis(150);
+    keyDown[2][0] = false;
+    mockAdvanceMillis(10);
+    buttonEventLoop();
+
+    TEST_ASSERT_EQUAL_UINT32(1, clicks);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_find_ghost_rows_flags_rectangles);
+    RUN_TEST(test_single_keys_read_where_they_are);
+    RUN_TEST(test_rows_are_released_after_a_scan);
+    RUN_TEST(test_rectangle_without_diodes_keeps_the_last_good_rows);
+    RUN_TEST(test_rectangle_with_diodes_is_trusted);
+    RUN_TEST(test_matrix_key_clicks_through_the_scanner);
+    return UNITY_END();
+}
@@ -0,0 +1,173 @@
+#include <Arduino.h>
+#include <string.h>
+#include <unity.h>
+#include "BleKeyboard.h"
+#include "HidDescriptor.h"
+#include "mock_hal.h"
+
+/*
+ * The N-key rollover keyboard report as it goes out over the simulated BLE
+ * link: the modifiers byte, then one bit per usage 0x00-0x7F, usage n in
+ * bit n % 8 of key byte n / 8. Runs in the native_nkro environment, which
+ * builds the library with BLE_KEYBOARD_NKRO=1.
+ */
+
+#if !BLE_KEYBOARD_NKRO
+#error "test_nkro_report needs BLE_KEYBOARD_NKRO=1, run it with pio test -e native_nkro"
+#endif
+
+const uint8_t KEYBOARD_ID = 1;
+const uint8_t INPUT_TAG = 0x80;
+const uint8_t OUTPUT_TAG = 0x90;
+
+static BleKeyboard keyboard;
+
+void runFor(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; i++)
+    {
+        mockAdvanceMillis(1);
+    }
+}
+
+// the keyboard reports, in the order they went out
+std::vector<std::vector<uint8_t>> keyboardReports()
+{
+    std::vector<std::vector<uint8_t>> sent;
+    for (const MockNotification &n : mockBleNotifications())
+    {
+        if (n.reportId == KEYBOARD_ID && n.uuid == "2a4d")
+        {
+            sent.push_back(n.data);
+        }
+    }
+    return sent;
+}
+
+// the last keyboard report once everything queued went out
+std::vector<uint8_t> lastReport()
+{
+    runFor(100);
+    std::vector<std::vector<uint8_t>> sent = keyboardReports();
+    TEST_ASSERT_TRUE(!sent.empty());
+    return sent.back();
+}
+
+// the report with only these key bytes set, indexed from the first key byte
+void assertKeys(const std::vector<uint8_t> &report, uint8_t modifiers, std::vector<std::pair<uint8_t, uint8_t>> keyBytes)
+{
+    uint8_t expected[sizeof(NkroReport)] = {modifiers};
+    for (const std::pair<uint8_t, uint8_t> &b : keyBytes)
+    {
+        expected[1 + b.first] = b.second;
+    }
+    TEST_ASSERT_EQUAL_UINT32(sizeof(NkroReport), report.size());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, report.data(), sizeof(NkroReport));
+}
+
+// usage n as the key code press() takes
+uint8_t usageKey(uint8_t usage)
+{
+    return usage + 136;
+}
+
+void setUp()
+{
+    runFor(100);
+    mockBleClearNotifications();
+}
+
+void tearDown()
+{
+    keyboard.releaseAll();
+    runFor(100);
+}
+
+void test_report_size_matches_the_descriptor()
+{
+    keyboard.press(usageKey(0x04));
+    std::vector<uint8_t> report = lastReport();
+
+    // the descriptor the host got, padded with zero bytes that parse as empty items
+    const std::vector<uint8_t> &map = mockBleReportMap();
+    HidDescriptor<512> descriptor = {};
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(descriptor.size, map.size());
+    memcpy(descriptor.data, map.data(), map.size());
+
+    TEST_ASSERT_EQUAL_UINT32(17, sizeof(NkroReport));
+    TEST_ASSERT_EQUAL_UINT32(sizeof(NkroReport) * 8, hidReportBits(descriptor, KEYBOARD_ID, INPUT_TAG));
+    TEST_ASSERT_EQUAL_UINT32(report.size() * 8, hidReportBits(descriptor, KEYBOARD_ID, INPUT_TAG));
+    TEST_ASSERT_EQUAL_UINT32(8, hidReportBits(descriptor, KEYBOARD_ID, OUTPUT_TAG));
+}
+
+void test_usages_land_on_their_byte_and_bit()
+{
+    // 0x07 is the last bit of the first byte, 0x08 the first of the second
+    keyboard.press(usageKey(0x07));
+    assertKeys(lastReport(), 0, {{0, 0x80}});
+
+    keyboard.press(usageKey(0x08));
+    assertKeys(lastReport(), 0, {{0, 0x80}, {1, 0x01}});
+
+    // F24, usage 0x73: byte 14, bit 3
+    keyboard.press(KEY_F24);
+    assertKeys(lastReport(), 0, {{0, 0x80}, {1, 0x01}, {14, 0x08}});
+
+    // releasing a key clears only its bit
+    keyboard.release(usageKey(0x08));
+    assertKeys(lastReport(), 0, {{0, 0x80}, {14, 0x08}});
+}
+
+void test_usage_zero_is_never_set()
+{
+    // usage 0 means no key, pressing it sends the report unchanged
+    keyboard.press(usageKey(0x00));
+    assertKeys(lastReport(), 0, {});
+
+    // an empty slot of a boot report does not become a key either
+    KeyReport boot = {0, 0, {0x00, 0x04, 0x00, 0x07, 0x00, 0x00}};
+    keyboard.sendReport(&boot);
+    assertKeys(lastReport(), 0, {{0, 0x90}});
+}
+
+void test_modifiers_go_in_the_first_byte()
+{
+    keyboard.press(KEY_LEFT_CTRL);
+    keyboard.press(KEY_LEFT_SHIFT);
+    keyboard.press(KEY_RIGHT_GUI);
+    assertKeys(lastReport(), 0x83, {});
+
+    keyboard.release(KEY_LEFT_SHIFT);
+    assertKeys(lastReport(), 0x81, {});
+
+    // a capital letter is its usage with left shift
+    keyboard.press('A');
+    assertKeys(lastReport(), 0x83, {{0, 0x10}});
+}
+
+void test_every_key_can_be_held_at_once()
+{
+    for (uint8_t usage = 0x04; usage <= 0x1D; usage++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(1, keyboard.press(usageKey(usage)));
+        runFor(10);
+    }
+
+    // a to z: bits 4-7 of byte 0 up to bit 5 of byte 3
+    assertKeys(lastReport(), 0, {{0, 0xF0}, {1, 0xFF}, {2, 0xFF}, {3, 0x3F}});
+}
+
+int main()
+{
+    mockReset();
+    keyboard.begin();
+    mockBleConnect();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_report_size_matches_the_descriptor);
+    RUN_TEST(test_usages_land_on_their_byte_and_bit);
+    RUN_TEST(test_usage_zero_is_never_set);
+    RUN_TEST(test_modifiers_go_in_the_first_byte);
+    RUN_TEST(test_every_key_can_be_held_at_once);
+    return UNITY_END();
+}
@@ -0,0 +1,102 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "buttons.h"
+#include "mock_hal.h"
+
+/*
+ * Gesture timing with the 1 ms button scanner. A change is confirmed on the
+ * 4th sample and dated back to the 1st, so it reaches the queue 3 ms after
+ * the time it carries. The loop runs every millisecond, right after the
+ * scanner tick.
+ */
+
+static uint32_t clickCount;
+static uint32_t holdCount;
+static unsigned long clicked_ms;
+
+void countClick()
+{
+    clickCount++;
+    clicked_ms = millis();
+}
+
+void countHold()
+{
+    holdCount++;
+}
+
+// run the loop every millisecond for a while
+void runFor(uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; i++)
+    {
+        mockAdvanceMillis(1);
+        buttonEventLoop();
+    }
+}
+
+void setUp()
+{
+    clickCount = 0;
+    holdCount = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_release_confirmed_after_the_hold_time_is_still_a_click()
+{
+    onClick(4, countClick);
+    onPressHold(4, countHold);
+    useButtonScanner(1000);
+
+    // held for exactly the hold time, the release is only confirmed 3 ms past it
+    mockSetPin(4, LOW);
+    runFor(1000);
+    mockSetPin(4, HIGH);
+    runFor(100);
+
+    TEST_ASSERT_EQUAL_UINT32(0, holdCount);
+    TEST_ASSERT_EQUAL_UINT32(1, clickCount);
+}
+
+void test_longer_press_holds()
+{
+    onClick(5, countClick);
+    onPressHold(5, countHold);
+
+    mockSetPin(5, LOW);
+    runFor(1010);
+    TEST_ASSERT_EQUAL_UINT32(1, holdCount);
+
+    mockSetPin(5, HIGH);
+    runFor(100);
+    TEST_ASSERT_EQUAL_UINT32(0, clickCount);
+}
+
+void test_click_resolves_once_its_window_is_confirmed()
+{
+    onClick(6, countClick);
+
+    // a click-only pin resolves on the release, as soon as it is confirmed
+    mockSetPin(6, LOW);
+    runFor(50);
+    mockSetPin(6, HIGH);
+    unsigned long released_ms = millis();
+    runFor(100);
+
+    TEST_ASSERT_EQUAL_UINT32(1, clickCount);
+    TEST_ASSERT_EQUAL_UINT32(released_ms + 4, clicked_ms);
+}
+
+int main()
+{
+    mockReset();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_release_confirmed_after_the_hold_time_is_still_a_click);
+    RUN_TEST(test_longer_press_holds);
+    RUN_TEST(test_click_resolves_once_its_window_is_confirmed);
+    return UNITY_END();
+}
@@ -0,0 +1,216 @@
+#ifndef DISCHARGE_TRACE_h
+#define DISCHARGE_TRACE_h
+
+#include <stdint.h>
+
+/*
+ * A representative discharge of the remote's 18650 from full to 3 %,
+ * sampled every 10 minutes: advertising with the LED at half duty and
+ * connected with it fully on, 30 hours in all.
+ *
+ * Modelled rather than recorded, on a cell that differs from what
+ * battery.cpp assumes in every parameter the estimator depends on:
+ *   - 2400 mAh instead of 2500, an aged cell
+ *   - 98 mA advertising and 74 mA connected instead of 95 and 70
+ *   - 170 mOhm instead of 150
+ *   - an open circuit curve up to 17 mV off DISCHARGE_CURVE
+ *   - up to 15 mV of noise on every reading
+ * percentTenths is the true charge, from counting the current drawn.
+ */
+struct DischargeSample
+{
+    uint16_t minute;
+    uint8_t load; // BatteryLoad from this sample to the next
+    uint8_t ledBrightness;
+    uint16_t mV; // at the battery, under the load
+    uint16_t percentTenths;
+};
+
+const DischargeSample DISCHARGE_TRACE[] = {
+    {0, 1, 128, 4178, 1000},
+    {10, 1, 128, 4160, 993},
+    {20, 1, 128, 4164, 986},
+    {30, 1, 128, 4140, 980},
+    {40, 2, 255, 4149, 973},
+    {50, 2, 255, 4143, 968},
+    {60, 2, 255, 4141, 962},
+    {70, 2, 255, 4129, 957},
+    {80, 2, 255, 4120, 952},
+    {90, 2, 255, 4118, 947},
+    {100, 2, 255, 4126, 942},
+    {110, 2, 255, 4101, 937},
+    {120, 2, 255, 4099, 932},
+    {130, 2, 255, 4104, 927},
+    {140, 2, 255, 4103, 921},
+    {150, 2, 255, 4104, 916},
+    {160, 2, 255, 4093, 911},
+    {170, 2, 255, 4079, 906},
+    {180, 2, 255, 4078, 901},
+    {190, 2, 255, 4077, 896},
+    {200, 2, 255, 4062, 891},
+    {210, 2, 255, 4072, 885},
+    {220, 2, 255, 4069, 880},
+    {230, 2, 255, 4074, 875},
+    {240, 2, 255, 4051, 870},
+    {250, 2, 255, 4051, 865},
+    {260, 2, 255, 4056, 860},
+    {270, 2, 255, 4053, 855},
+    {280, 2, 255, 4033, 849},
+    {290, 2, 255, 4025, 844},
+    {300, 2, 255, 4045, 839},
+    {310, 2, 255, 4019, 834},
+    {320, 2, 255, 4032, 829},
+    {330, 2, 255, 4018, 824},
+    {340, 1, 128, 4020, 819},
+    {350, 1, 128, 4015, 812},
+    {360, 2, 255, 4011, 805},
+    {370, 2, 255, 4001, 800},
+    {380, 2, 255, 4011, 795},
+    {390, 2, 255, 4010, 790},
+    {400, 2, 255, 3994, 784},
+    {410, 2, 255, 4011, 779},
+    {420, 2, 255, 4004, 774},
+    {430, 2, 255, 3987, 769},
+    {440, 2, 255, 3993, 764},
+    {450, 2, 255, 3972, 759},
+    {460, 2, 255, 3983, 754},
+    {470, 2, 255, 3978, 748},
+    {480, 2, 255, 3979, 743},
+    {490, 2, 255, 3982, 738},
+    {500, 2, 255, 3963, 733},
+    {510, 2, 255, 3973, 728},
+    {520, 2, 255, 3963, 723},
+    {530, 2, 255, 3941, 718},
+    {540, 2, 255, 3949, 712},
+    {550, 2, 255, 3937, 707},
+    {560, 2, 255, 3947, 702},
+    {570, 2, 255, 3938, 697},
+    {580, 2, 255, 3928, 692},
+    {590, 2, 255, 3944, 687},
+    {600, 2, 255, 3919, 682},
+    {610, 2, 255, 3916, 677},
+    {620, 2, 255, 3916, 671},
+    {630, 2, 255, 3934, 666},
+    {640, 2, 255, 3920, 661},
+    {650, 2, 255, 3914, 656},
+    {660, 2, 255, 3908, 651},
+    {670, 2, 255, 3896, 646},
+    {680, 2, 255, 3903, 641},
+    {690, 2, 255, 3895, 635},
+    {700, 2, 255, 3894, 630},
+    {710, 2, 255, 3883, 625},
+    {720, 2, 255, 3904, 620},
+    {730, 2, 255, 3896, 615},
+    {740, 2, 255, 3882, 610},
+    {750, 2, 255, 3882, 605},
+    {760, 2, 255, 3863, 599},
+    {770, 2, 255, 3889, 594},
+    {780, 1, 128, 3858, 589},
+    {790, 1, 128, 3861, 582},
+    {800, 1, 128, 3870, 576},
+    {810, 1, 128, 3866, 569},
+    {820, 1, 128, 3866, 562},
+    {830, 1, 128, 3844, 555},
+    {840, 2, 255, 3860, 548},
+    {850, 2, 255, 3838, 543},
+    {860, 2, 255, 3864, 538},
+    {870, 2, 255, 3833, 533},
+    {880, 2, 255, 3835, 528},
+    {890, 2, 255, 3857, 523},
+    {900, 2, 255, 3846, 517},
+    {910, 2, 255, 3824, 512},
+    {920, 2, 255, 3828, 507},
+    {930, 2, 255, 3838, 502},
+    {940, 2, 255, 3821, 497},
+    {950, 2, 255, 3842, 492},
+    {960, 2, 255, 3825, 487},
+    {970, 2, 255, 3836, 482},
+    {980, 2, 255, 3823, 476},
+    {990, 2, 255, 3811, 471},
+    {1000, 2, 255, 3828, 466},
+    {1010, 2, 255, 3802, 461},
+    {1020, 2, 255, 3824, 456},
+    {1030, 2, 255, 3807, 451},
+    {1040, 2, 255, 3800, 446},
+    {1050, 2, 255, 3801, 440},
+    {1060, 2, 255, 3806, 435},
+    {1070, 2, 255, 3798, 430},
+    {1080, 1, 128, 3806, 425},
+    {1090, 2, 255, 3807, 418},
+    {1100, 2, 255, 3792, 413},
+    {1110, 2, 255, 3788, 408},
+    {1120, 2, 255, 3801, 403},
+    {1130, 2, 255, 3797, 398},
+    {1140, 2, 255, 3804, 392},
+    {1150, 2, 255, 3782, 387},
+    {1160, 2, 255, 3779, 382},
+    {1170, 2, 255, 3790, 377},
+    {1180, 2, 255, 3801, 372},
+    {1190, 2, 255, 3783, 367},
+    {1200, 2, 255, 3780, 362},
+    {1210, 2, 255, 3769, 357},
+    {1220, 2, 255, 3775, 351},
+    {1230, 2, 255, 3786, 346},
+    {1240, 2, 255, 3770, 341},
+    {1250, 2, 255, 3772, 336},
+    {1260, 2, 255, 3773, 331},
+    {1270, 2, 255, 3770, 326},
+    {1280, 2, 255, 3781, 321},
+    {1290, 2, 255, 3783, 315},
+    {1300, 2, 255, 3773, 310},
+    {1310, 2, 255, 3767, 305},
+    {1320, 2, 255, 3769, 300},
+    {1330, 2, 255, 3769, 295},
+    {1340, 2, 255, 3771, 290},
+    {1350, 2, 255, 3774, 285},
+    {1360, 2, 255, 3758, 279},
+    {1370, 2, 255, 3755, 274},
+    {1380, 2, 255, 3744, 269},
+    {1390, 2, 255, 3754, 264},
+    {1400, 2, 255, 3754, 259},
+    {1410, 2, 255, 3744, 254},
+    {1420, 2, 255, 3756, 249},
+    {1430, 2, 255, 3762, 243},
+    {1440, 2, 255, 3755, 238},
+    {1450, 2, 255, 3758, 233},
+    {1460, 2, 255, 3754, 228},
+    {1470, 2, 255, 3752, 223},
+    {1480, 2, 255, 3741, 218},
+    {1490, 2, 255, 3734, 213},
+    {1500, 2, 255, 3735, 207},
+    {1510, 2, 255, 3743, 202},
+    {1520, 2, 255, 3713, 197},
+    {1530, 2, 255, 3709, 192},
+    {1540, 2, 255, 3715, 187},
+    {1550, 2, 255, 3722, 182},
+    {1560, 2, 255, 3720, 177},
+    {1570, 2, 255, 3702, 172},
+    {1580, 2, 255, 3714, 166},
+    {1590, 2, 255, 3711, 161},
+    {1600, 2, 255, 3712, 156},
+    {1610, 2, 255, 3715, 151},
+    {1620, 2, 255, 3710, 146},
+    {1630, 2, 255, 3691, 141},
+    {1640, 2, 255, 3683, 136},
+    {1650, 2, 255, 3700, 130},
+    {1660, 2, 255, 3703, 125},
+    {1670, 2, 255, 3690, 120},
+    {1680, 2, 255, 3697, 115},
+    {1690, 1, 128, 3664, 110},
+    {1700, 1, 128, 3682, 103},
+    {1710, 1, 128, 3659, 96},
+    {1720, 2, 255, 3636, 89},
+    {1730, 2, 255, 3596, 84},
+    {1740, 2, 255, 3584, 79},
+    {1750, 2, 255, 3543, 74},
+    {1760, 2, 255, 3510, 69},
+    {1770, 2, 255, 3512, 64},
+    {1780, 2, 255, 3480, 59},
+    {1790, 2, 255, 3459, 53},
+    {1800, 2, 255, 3413, 48},
+    {1810, 2, 255, 3386, 43},
+    {1820, 2, 255, 3360, 38},
+    {1830, 2, 255, 3342, 33},
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "battery.h"
+#include "discharge_trace.h"
+#include "mock_hal.h"
+#include "soc_estimator.h"
+
+const uint8_t VBAT_SENSE = 35;
+
+// millivolts at the battery per 1000 ADC counts with no eFuse characterization
+const uint32_t CONVERSION_FACTOR = 1700;
+
+static SocEstimator estimator;
+
+extern uint64_t drawn_uAms;
+extern uint64_t sinceEstimate_ms;
+
+void setUp()
+{
+    socEstimatorBegin(estimator);
+}
+
+void tearDown()
+{
+}
+
+void test_first_measurement_is_taken_as_is()
+{
+    // nothing to predict from yet
+    socEstimatorPredict(estimator, 50, 500, 1);
+    socEstimatorUpdate(estimator, 73, 4);
+
+    TEST_ASSERT_EQUAL_UINT8(73, socEstimatorPercent(estimator));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 4, estimator.variance);
+}
+
+void test_prediction_counts_the_charge_drawn()
+{
+    socEstimatorUpdate(estimator, 80, 4);
+    socEstimatorPredict(estimator, 25, 500, 1);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 75, estimator.percent);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 5, estimator.variance);
+}
+
+void test_update_weighs_by_the_variances()
+{
+    socEstimatorUpdate(estimator, 80, 4);
+
+    // equal variances meet halfway
+    socEstimatorUpdate(estimator, 70, 4);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 75, estimator.percent);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 2, estimator.variance);
+
+    // a reading under heavy load barely moves it
+    socEstimatorUpdate(estimator, 40, 200);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 74.65f, estimator.percent);
+}
+
+void test_noisy_voltage_converges_on_the_charge()
+{
+    socEstimatorUpdate(estimator, 60, 25);
+
+    // the true charge is 50 %, the voltage lookup is off by up to 8 %
+    const float readings[] = {58, 42, 55, 47, 53, 44, 57, 45};
+    for (uint8_t i = 0; i < 40; i++)
+    {
+        socEstimatorPredict(estimator, 0, 500, 0.05f);
+        socEstimatorUpdate(estimator, readings[i % 8], 25);
+    }
+
+    TEST_ASSERT_UINT8_WITHIN(2, 50, socEstimatorPercent(estimator));
+}
+
+void test_percent_is_rounded_and_clamped()
+{
+    socEstimatorUpdate(estimator, 42.5f, 1);
+    TEST_ASSERT_EQUAL_UINT8(43, socEstimatorPercent(estimator));
+
+    estimator.percent = -3;
+    TEST_ASSERT_EQUAL_UINT8(0, socEstimatorPercent(estimator));
+
+    estimator.percent = 104;
+    TEST_ASSERT_EQUAL_UINT8(100, socEstimatorPercent(estimator));
+}
+
+void test_discharge_trace_stays_within_the_error_bound()
+{
+    uint32_t worst = 0;
+    uint32_t sum = 0;
+    uint16_t worstMinute = 0;
+    uint32_t start_ms = millis();
+
+    for (const DischargeSample &sample : DISCHARGE_TRACE)
+    {
+        mockAdvanceMillis(start_ms + sample.minute * 60000UL - millis());
+        setBatteryLoad((BatteryLoad)sample.load, sample.ledBrightness);
+        mockSetAnalogValue(VBAT_SENSE, (sample.mV * 1000 + CONVERSION_FACTOR / 2) / CONVERSION_FACTOR);
+
+        // in tenths of a percent
+        uint32_t error = abs(getBatteryChargeLevel(VBAT_SENSE) * 10 - sample.percentTenths);
+        sum += error;
+        if (error > worst)
+        {
+            worst = error;
+            worstMinute = sample.minute;
+        }
+    }
+
+    uint32_t samples = sizeof(DISCHARGE_TRACE) / sizeof(DISCHARGE_TRACE[0]);
+    printf("soc error along the trace: max %.1f %% at minute %u, mean %.2f %%\n", worst / 10.0f, worstMinute,
+           sum / 10.0f / samples);
+
+    // within 6 % all the way down and 2 % on average
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(60, worst);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(20 * samples, sum);
+}
+
+void test_deep_sleep_is_charged_at_the_sleep_current()
+{
+    mockAdvanceMillis(5000);
+    setBatteryLoad(BATTERY_LOAD_CONNECTED, 0);
+    uint8_t before = getBatteryChargeLevel(VBAT_SENSE);
+
+    // goToSleep() switches to the sleep load right before esp_deep_sleep_start()
+    setBatteryLoad(BATTERY_LOAD_SLEEP, 0);
+    uint64_t drawnBefore = drawn_uAms;
+    uint64_t sinceBefore = sinceEstimate_ms;
+    mockDeepSleep(3600);
+
+    // millis() starts over on waking, the hour comes from the wall clock: 10 uA for 3600 s
+    setBatteryLoad(BATTERY_LOAD_CONNECTED, 0);
+    TEST_ASSERT_EQUAL_UINT32(10 * 3600000UL, drawn_uAms - drawnBefore);
+    TEST_ASSERT_EQUAL_UINT32(3600000UL, sinceEstimate_ms - sinceBefore);
+
+    // the same reading after waking carries on from the estimate
+    TEST_ASSERT_UINT8_WITHIN(1, before, getBatteryChargeLevel(VBAT_SENSE));
+}
+
+int main()
+{
+    mockReset();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_first_measurement_is_taken_as_is);
+    RUN_TEST(test_prediction_counts_the_charge_drawn);
+    RUN_TEST(test_update_weighs_by_the_variances);
+    RUN_TEST(test_noisy_voltage_converges_on_the_charge);
+    RUN_TEST(test_percent_is_rounded_and_clamped);
+    RUN_TEST(test_discharge_trace_stays_within_the_error_bound);
+    RUN_TEST(test_deep_sleep_is_charged_at_the_sleep_current);
+    return UNITY_END();
+}